@@ -1,4 +1,19 @@
 #include "adc.h"
+#include "nvic.h"
+#include "timer.h"
+
+/* burst engine state */
+typedef struct {
+  const RingBufferStatic* rings[8];   // output ring per channel
+  uint32_t sum[8];                    // oversampling accumulators
+  uint8_t channelMask;                // sampled channels
+  uint8_t oversampleBits;             // extra bits by oversampling
+  uint8_t oversampleCount;            // conversions summed so far (per scan)
+  bool timed;                         // CT32B0 is used as sample clock
+  volatile uint32_t overrunCount;     // lost samples
+} ADC_BurstState;
+
+static ADC_BurstState adcBurst;
 
 void ADC_Init() {
 	/* 2. Power and peripheral clock: In the SYSAHBCLKCTRL register, set bit
@@ -65,3 +80,130 @@ int32_t ADC_Read(uint8_t channel) {
 //  }
   return (((*DRx) >> 6) & 0x3ff);
 }
+
+/* common part of burst and timed sampling: expects the rings to be set up,
+   arms the interrupt and writes the control register */
+static void ADC_StartEngine(uint8_t channelMask, uint8_t oversampleBits, uint32_t cr) {
+  uint8_t channel;
+  for (channel = 0; channel < 8; channel++) {
+    if (adcBurst.rings[channel]) RingBufferInit(adcBurst.rings[channel]);
+    adcBurst.sum[channel] = 0;
+  }
+  adcBurst.channelMask = channelMask;
+  adcBurst.oversampleBits = oversampleBits;
+  adcBurst.oversampleCount = 0;
+  adcBurst.overrunCount = 0;
+
+  // interrupt when the highest channel is done - that's the end of a scan
+  uint8_t lastChannel = 31 - __builtin_clz(channelMask);
+  volatile uint32_t* INTEN = (uint32_t*)(&(ADC_HW->AD0INTEN));
+  *INTEN = 1 << lastChannel;
+
+  volatile uint32_t* CR = (uint32_t*)(&(ADC_HW->AD0CR));
+  *CR = cr;
+
+  NVIC_EnableInterrupt(NVIC_ADC);
+}
+
+bool ADC_StartBurst(uint8_t channelMask,
+                    uint8_t clockDiv,
+                    uint8_t oversampleBits,
+                    const RingBufferStatic* const* rings) {
+  if ((channelMask == 0) || (clockDiv < 15) || (oversampleBits > ADC_MAX_OVERSAMPLE_BITS)) return false;
+  ADC_StopSampling();
+
+  uint8_t channel;
+  for (channel = 0; channel < 8; channel++) {
+    adcBurst.rings[channel] = (channelMask & (1 << channel)) ? rings[channel] : NULL;
+  }
+  // SEL = mask, CLKDIV, BURST, 11 clocks / 10 bits, START must be 0 in burst mode
+  ADC_StartEngine(channelMask, oversampleBits, channelMask | (clockDiv << 8) | (ADC_BURST_HW << 16));
+  return true;
+}
+
+bool ADC_StartTimed(uint8_t channel,
+                    uint32_t sampleRate,
+                    uint8_t oversampleBits,
+                    const RingBufferStatic* ring) {
+  if ((channel > 7) || (oversampleBits > ADC_MAX_OVERSAMPLE_BITS)) return false;
+  uint32_t conversionRate = sampleRate << (2 * oversampleBits);
+  if ((conversionRate == 0) || (conversionRate > ADC_MAX_CONVERSION_RATE)) return false;
+  ADC_StopSampling();
+
+  uint8_t i;
+  for (i = 0; i < 8; i++) adcBurst.rings[i] = NULL;
+  adcBurst.rings[channel] = ring;
+
+  // CT32B0 MAT0 toggles on each match: one rising edge every 2 matches
+  Timer_Enable(CT32B0, true);
+  Timer_Stop(CT32B0);
+  Timer_Reset(CT32B0);
+  Timer_SetPrescale(CT32B0, 0);
+  Timer_SetMatchValue(CT32B0, 0, (36000000 / conversionRate) - 1);
+  Timer_SetMatchBehaviour(CT32B0, 0, TIMER_MATCH_RESET);
+  TIMER[CT32B0].EMR = EMC0_TOGGLE;
+
+  // SEL = channel, fastest ADC clock (4.5 MHz), start on rising CT32B0_MAT0 edge
+  ADC_StartEngine(1 << channel, oversampleBits, (1 << channel) | (15 << 8) | (ADC_START_32M0 << 24));
+  Timer_Start(CT32B0);
+  adcBurst.timed = true;
+  return true;
+}
+
+void ADC_StopSampling() {
+  volatile uint32_t* CR = (uint32_t*)(&(ADC_HW->AD0CR));
+  *CR &= ~((ADC_BURST_HW << 16) | (0x07 << 24));   // clear BURST and START
+  if (adcBurst.timed) {
+    Timer_Stop(CT32B0);
+    adcBurst.timed = false;
+  }
+  NVIC_DisableInterrupt(NVIC_ADC);
+  volatile uint32_t* INTEN = (uint32_t*)(&(ADC_HW->AD0INTEN));
+  *INTEN = 0;
+}
+
+uint16_t ADC_SamplesAvailable(uint8_t channel) {
+  if ((channel > 7) || !adcBurst.rings[channel]) return 0;
+  return RingBufferReadBytesAvailable(adcBurst.rings[channel]) / sizeof(uint16_t);
+}
+
+uint16_t ADC_ReadBlock(uint8_t channel, uint16_t* buffer, uint16_t maxSamples) {
+  uint16_t samples = ADC_SamplesAvailable(channel);
+  if (samples > maxSamples) samples = maxSamples;
+  if (samples == 0) return 0;
+  return RingBufferReadBuffer(adcBurst.rings[channel], (uint8_t*)buffer, samples * sizeof(uint16_t)) / sizeof(uint16_t);
+}
+
+uint32_t ADC_GetOverrunCount() {
+  return adcBurst.overrunCount;
+}
+
+/* Called once per scan. All results of the scan are picked up here. The
+   data registers must be read before the next scan overwrites them. */
+void adc_handler(void) {
+  volatile uint32_t* DR = (uint32_t*)(ADC_HW->AD0DR);
+  uint32_t mask = adcBurst.channelMask;
+  bool emit = (++adcBurst.oversampleCount) >> (2 * adcBurst.oversampleBits);
+  if (emit) adcBurst.oversampleCount = 0;
+  while (mask) {
+    uint8_t channel = __builtin_ctz(mask);
+    mask &= mask - 1;
+    uint32_t val = DR[channel];   // reading clears DONE and OVERRUN
+    if (val & (1 << 30)) adcBurst.overrunCount++;
+    uint32_t sum = adcBurst.sum[channel] + ((val >> 6) & 0x3ff);
+    if (!emit) {
+      adcBurst.sum[channel] = sum;
+      continue;
+    }
+    adcBurst.sum[channel] = 0;
+    uint16_t sample = sum >> adcBurst.oversampleBits;   // decimate: 4^n conversions -> 10+n bits
+    const RingBufferStatic* rb = adcBurst.rings[channel];
+    uint8_t* data;
+    if (RingBufferPeekWrite(rb, &data) >= sizeof(uint16_t)) {   // ring sizes and indexes are even: no split
+      *((uint16_t*)data) = sample;
+      RingBufferCommitWrite(rb, sizeof(uint16_t));
+    } else {
+      adcBurst.overrunCount++;
+    }
+  }
+}
@@ -3,6 +3,8 @@
 
 #include "types.h"
 #include "memorymap.h"
+#include "ringbuffer.h"
+#include "timer.h"
 
 
 //typedef struct {
@@ -33,6 +35,76 @@ void    ADC_Init();
 void    ADC_Disable();
 int32_t ADC_Read(uint8_t channel);
 
+/*
+  Burst mode sampling engine: the ADC scans all channels of a mask
+  continuously in hardware, the ADC interrupt collects the results
+  into one ring buffer per channel. Samples are stored as uint16_t
+  (2 bytes per sample, so ring sizes are bytes = 2 * samples).
+
+  Per-channel sample rate:
+    72 MHz / (clockDiv + 1) / 11 / channels / (4 ^ oversampleBits)
+  (ADC clock must not exceed 4.5 MHz, so clockDiv >= 15). With all 8
+  channels and no oversampling, that's ~48 ksps per channel.
+
+  Timed sampling: ADC_StartTimed converts a single channel on each
+  rising edge of CT32B0's MAT0 signal. The sample clock is generated by
+  the timer hardware, so there's no software jitter. Samples end up in
+  the same kind of ring and are read the same way.
+
+  Oversampling: oversampleBits > 0 sums 4^oversampleBits conversions
+  and decimates the sum to 10 + oversampleBits bits (e.g. 2: 16
+  conversions -> 12 bit result).
+*/
+
+/* maximum number of extra bits by oversampling */
+#define ADC_MAX_OVERSAMPLE_BITS 2
+
+/* starts burst mode sampling. ADC_Init must have been called, pins
+   must be set to ADC function.
+   channelMask: bit mask of channels to sample (bit 0 = channel 0)
+   clockDiv: ADC clock divider (15..255), see above
+   oversampleBits: 0 (10 bit results) .. ADC_MAX_OVERSAMPLE_BITS
+   rings: array of 8 ring buffer pointers indexed by channel. Only
+     channels in the mask need a valid ring, they are cleared here.
+   Returns false if parameters are invalid. */
+bool ADC_StartBurst(uint8_t channelMask,
+                    uint8_t clockDiv,
+                    uint8_t oversampleBits,
+                    const RingBufferStatic* const* rings);
+
+/* maximum conversions per second: 11 ADC clocks at 4.5 MHz */
+#define ADC_MAX_CONVERSION_RATE 400000
+
+/* starts timer-clocked sampling of a single channel. ADC_Init must have
+   been called, the pin must be set to ADC function. CT32B0 is used as
+   sample clock and must not be used otherwise meanwhile (MAT0 may be
+   routed to PIO1_6 to watch the clock on a scope).
+   channel: channel to sample (0..7)
+   sampleRate: output samples per second. Conversions run at
+     sampleRate * 4^oversampleBits, which must not exceed
+     ADC_MAX_CONVERSION_RATE.
+   oversampleBits: 0 (10 bit results) .. ADC_MAX_OVERSAMPLE_BITS
+   ring: output ring, cleared here.
+   Returns false if parameters are invalid. */
+bool ADC_StartTimed(uint8_t channel,
+                    uint32_t sampleRate,
+                    uint8_t oversampleBits,
+                    const RingBufferStatic* ring);
+
+/* stops burst or timed sampling. Samples remaining in the rings may still be read. */
+void ADC_StopSampling();
+
+/* returns the number of samples waiting for a channel */
+uint16_t ADC_SamplesAvailable(uint8_t channel);
+
+/* reads up to maxSamples samples of a channel. Does not block.
+   Returns the number of samples read. */
+uint16_t ADC_ReadBlock(uint8_t channel, uint16_t* buffer, uint16_t maxSamples);
+
+/* returns the number of samples lost since sampling was started, either
+   because a ring was full or because the interrupt came too late */
+uint32_t ADC_GetOverrunCount();
+
 /* A/D Control Register 20.6.1*/
 typedef struct {
 	unsigned SEL      :8;
@@ -11,6 +11,7 @@
 #include "timer.h"
 #include "i2c.h"
 #include "adc.h"
+#include "ringbuffer.h"
 #include "uart.h"
 #include "nvic.h"
 #include "wdt.h"
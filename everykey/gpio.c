@@ -1,5 +1,14 @@
 #include "gpio.h"
 #include "memorymap.h"
+#include "nvic.h"
+
+/* interrupt dispatch and debounce state, indexed by [port][pin] */
+static every_gpio_handler gpioHandlers[4][12];
+static uint8_t gpioDebounceTime[4][12];		//ms, 0 = no debouncing
+static uint8_t gpioDebounceCount[4][12];	//remaining ms while masked
+static uint16_t gpioDebouncing[4];			//pins currently masked
+static uint16_t gpioDebounceLevel[4];		//pin level at the last event
+static TimerId gpioDebounceTimer;
 
 void every_gpio_set_dir(uint8_t port, uint8_t pin, every_gpio_direction dir) {
 	switch (dir) {
@@ -20,6 +29,84 @@ bool every_gpio_read(uint8_t port, uint8_t pin) {
 	return (GPIO[port].DATA & (1<<pin)) ? true : false;
 }
 
+void every_gpio_write_mask(uint8_t port, uint16_t mask, uint16_t value) {
+	//the word address selects the pins to change (MASKED_DATA[0xfff] is DATA)
+	GPIO[port].MASKED_DATA[mask & 0xfff] = value;
+}
+
+uint16_t every_gpio_read_port(uint8_t port) {
+	return GPIO[port].DATA & 0xfff;
+}
+
+void every_gpio_group_init(every_gpio_pin_group* group) {
+	uint8_t i;
+	group->count = 0;
+	for (i = 0; i < 4; i++) group->portMask[i] = 0;
+}
+
+int8_t every_gpio_group_add(every_gpio_pin_group* group, uint8_t port, uint8_t pin) {
+	if (group->count >= EVERY_GPIO_GROUP_MAX_PINS) return -1;
+	uint8_t idx = group->count++;
+	group->port[idx] = port;
+	group->bit[idx] = 1 << pin;
+	group->portMask[port] |= 1 << pin;
+	return idx;
+}
+
+void every_gpio_group_set_dir(const every_gpio_pin_group* group, every_gpio_direction dir) {
+	uint8_t port;
+	for (port = 0; port < 4; port++) {
+		if (dir == OUTPUT) GPIO[port].DIR |= group->portMask[port];
+		else GPIO[port].DIR &= ~(group->portMask[port]);
+	}
+}
+
+void every_gpio_group_write(const every_gpio_pin_group* group, uint32_t values) {
+	uint16_t portValues[4] = { 0, 0, 0, 0 };
+	uint8_t i;
+	for (i = 0; i < group->count; i++) {
+		if (values & (1 << i)) portValues[group->port[i]] |= group->bit[i];
+	}
+	//all values are ready: do the stores back to back to keep skew between ports low
+	for (i = 0; i < 4; i++) {
+		if (group->portMask[i]) GPIO[i].MASKED_DATA[group->portMask[i]] = portValues[i];
+	}
+}
+
+void every_gpio_group_prepare(const every_gpio_pin_group* group, uint32_t values, every_gpio_group_output* out) {
+	uint16_t portValues[4] = { 0, 0, 0, 0 };
+	uint8_t i;
+	for (i = 0; i < group->count; i++) {
+		if (values & (1 << i)) portValues[group->port[i]] |= group->bit[i];
+	}
+	out->count = 0;
+	for (i = 0; i < 4; i++) {
+		if (group->portMask[i]) {
+			out->reg[out->count] = &(GPIO[i].MASKED_DATA[group->portMask[i]]);
+			out->value[out->count] = portValues[i];
+			out->count++;
+		}
+	}
+}
+
+void every_gpio_group_apply(const every_gpio_group_output* out) {
+	uint8_t i;
+	for (i = 0; i < out->count; i++) *(out->reg[i]) = out->value[i];
+}
+
+uint32_t every_gpio_group_read(const every_gpio_pin_group* group) {
+	uint16_t portValues[4];
+	uint32_t values = 0;
+	uint8_t i;
+	for (i = 0; i < 4; i++) {
+		if (group->portMask[i]) portValues[i] = GPIO[i].DATA;
+	}
+	for (i = 0; i < group->count; i++) {
+		if (portValues[group->port[i]] & group->bit[i]) values |= 1 << i;
+	}
+	return values;
+}
+
 void every_gpio_set_pull(HW_RW* pin, every_gpio_pull_mode mode) {
 	*pin = ((*pin) & (~REPEAT)) | mode;
 }
@@ -64,3 +151,95 @@ uint32_t every_gpio_get_interrupt_mask(uint8_t port) {
 void every_gpio_clear_interrupt_mask(uint8_t port, uint32_t mask) {
 	GPIO[port].IC = mask;
 }
+
+/** calls a pin's callback and starts its debounce period */
+static void every_gpio_fire(uint8_t port, uint8_t pin) {
+	uint16_t bit = 1 << pin;
+	if (gpioDebounceTime[port][pin]) {
+		GPIO[port].IE &= ~bit;
+		gpioDebounceCount[port][pin] = gpioDebounceTime[port][pin];
+		if (GPIO[port].DATA & bit) gpioDebounceLevel[port] |= bit;
+		else gpioDebounceLevel[port] &= ~bit;
+		if (!(gpioDebouncing[0] | gpioDebouncing[1] | gpioDebouncing[2] | gpioDebouncing[3])) {
+			Timer_Reset(gpioDebounceTimer);
+			Timer_Start(gpioDebounceTimer);
+		}
+		gpioDebouncing[port] |= bit;
+	}
+	gpioHandlers[port][pin](port, pin);
+}
+
+void every_gpio_attach_interrupt(uint8_t port, uint8_t pin, every_gpio_interrupt_mode mode, every_gpio_handler handler, uint8_t debounceMs) {
+	every_gpio_set_interrupt_mode(port, pin, TRIGGER_NONE);
+	gpioHandlers[port][pin] = handler;
+	gpioDebounceTime[port][pin] = debounceMs;
+	gpioDebouncing[port] &= ~(1 << pin);
+	GPIO[port].IC = 1 << pin;
+	every_gpio_set_interrupt_mode(port, pin, mode);
+	NVIC_EnableInterrupt(NVIC_PIO_0 - port);
+}
+
+void every_gpio_detach_interrupt(uint8_t port, uint8_t pin) {
+	every_gpio_set_interrupt_mode(port, pin, TRIGGER_NONE);
+	gpioDebouncing[port] &= ~(1 << pin);
+	gpioHandlers[port][pin] = NULL;
+}
+
+void every_gpio_dispatch(uint8_t port) {
+	uint32_t pending = GPIO[port].MIS;
+	while (pending) {
+		uint8_t pin = 31 - __builtin_clz(pending);
+		uint16_t bit = 1 << pin;
+		pending &= ~bit;
+		GPIO[port].IC = bit;
+		if (gpioHandlers[port][pin]) every_gpio_fire(port, pin);
+		else GPIO[port].IE &= ~bit;		//nobody cares: don't come back
+	}
+}
+
+void every_gpio_debounce_init(TimerId timer) {
+	gpioDebounceTimer = timer;
+	//1 MHz count, interrupt and restart every ms
+	Timer_Enable(timer, true);
+	Timer_Stop(timer);
+	Timer_SetPrescale(timer, 71);
+	Timer_SetMatchValue(timer, 0, 1000);
+	Timer_SetMatchBehaviour(timer, 0, TIMER_MATCH_INTERRUPT | TIMER_MATCH_RESET);
+	NVIC_EnableInterrupt(NVIC_CT16B0 + timer);
+}
+
+void every_gpio_debounce_timer_handler(void) {
+	Timer_ClearInterruptMask(gpioDebounceTimer, TIMER_MR0INT);
+	uint8_t port;
+	for (port = 0; port < 4; port++) {
+		uint32_t pending = gpioDebouncing[port];
+		while (pending) {
+			uint8_t pin = 31 - __builtin_clz(pending);
+			uint16_t bit = 1 << pin;
+			pending &= ~bit;
+			if (--gpioDebounceCount[port][pin]) continue;
+
+			//period over: drop bounces, unmask
+			gpioDebouncing[port] &= ~bit;
+			GPIO[port].IC = bit;
+			GPIO[port].IE |= bit;
+
+			//catch up with an edge we missed while masked
+			uint16_t level = GPIO[port].DATA & bit;
+			if ((GPIO[port].IS & bit) || (level == (gpioDebounceLevel[port] & bit))) continue;
+			if ((GPIO[port].IBE & bit) || ((GPIO[port].IEV & bit) ? level : !level)) {
+				every_gpio_fire(port, pin);
+			}
+		}
+	}
+	if (!(gpioDebouncing[0] | gpioDebouncing[1] | gpioDebouncing[2] | gpioDebouncing[3])) {
+		Timer_Stop(gpioDebounceTimer);
+	}
+}
+
+/* default port interrupt handlers: dispatch to attached callbacks. Weak, so applications
+   may still implement their own. */
+void __attribute__ ((weak)) gpio0_handler(void) { every_gpio_dispatch(0); }
+void __attribute__ ((weak)) gpio1_handler(void) { every_gpio_dispatch(1); }
+void __attribute__ ((weak)) gpio2_handler(void) { every_gpio_dispatch(2); }
+void __attribute__ ((weak)) gpio3_handler(void) { every_gpio_dispatch(3); }
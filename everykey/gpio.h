@@ -3,6 +3,7 @@
 
 #include "types.h"
 #include "memorymap.h"
+#include "timer.h"
 
 
 typedef enum {
@@ -58,6 +59,85 @@ void every_gpio_write(uint8_t port, uint8_t pin, bool value);
 */ 
 bool every_gpio_read(uint8_t port, uint8_t pin);
 
+/** writes multiple pins of a port in a single store. Pins outside the mask
+	are not affected, so this is safe against other code using the same port.
+	@param port the port
+	@param mask ORed pins to write (bits 0..11)
+	@param value the new pin values. Only bits set in mask are used.
+*/
+void every_gpio_write_mask(uint8_t port, uint16_t mask, uint16_t value);
+
+/** reads all pins of a port at once
+	@param port the port
+	@return pin states, pin 0 in bit 0 etc. (bits 0..11)
+*/
+uint16_t every_gpio_read_port(uint8_t port);
+
+/** maximum number of pins in a pin group */
+#define EVERY_GPIO_GROUP_MAX_PINS 16
+
+/** a group of pins that are written or read together. Pins may be spread
+	over multiple ports. The group precomputes a mask per port, so writing
+	a group takes a single store per port involved, i.e. all pins of a port
+	change at the same time. Pins are addressed by their index in the group
+	(the order in which they were added). */
+typedef struct {
+	uint8_t count;			//number of pins in the group
+	uint8_t port[EVERY_GPIO_GROUP_MAX_PINS];	//port of each pin
+	uint16_t bit[EVERY_GPIO_GROUP_MAX_PINS];	//port bit of each pin (1 << pin)
+	uint16_t portMask[4];	//all pins of the group on each port
+} every_gpio_pin_group;
+
+/** empties a pin group
+	@param group the group to initialize
+*/
+void every_gpio_group_init(every_gpio_pin_group* group);
+
+/** adds a pin to a group. The pin gets the next free index.
+	@param group the group
+	@param port the port
+	@param pin the pin
+	@return the pin's index in the group, or -1 if the group is full
+*/
+int8_t every_gpio_group_add(every_gpio_pin_group* group, uint8_t port, uint8_t pin);
+
+/** sets the direction of all pins of a group.
+	@param group the group
+	@param dir the direction
+*/
+void every_gpio_group_set_dir(const every_gpio_pin_group* group, every_gpio_direction dir);
+
+/** writes all pins of a group, one store per port.
+	@param group the group
+	@param values pin values by group index: bit 0 is the pin that was added first
+*/
+void every_gpio_group_write(const every_gpio_pin_group* group, uint32_t values);
+
+/** group pin values prepared for writing: the port stores of every_gpio_group_write,
+	computed ahead of time. Lets time critical code (e.g. a timer interrupt) write a
+	group with nothing but the stores. */
+typedef struct {
+	uint8_t count;			//number of stores
+	HW_RW* reg[4];			//masked data register of each store
+	uint16_t value[4];		//value of each store
+} every_gpio_group_output;
+
+/** prepares pin values of a group for every_gpio_group_apply().
+	@param group the group
+	@param values pin values by group index: bit 0 is the pin that was added first
+	@param out prepared stores */
+void every_gpio_group_prepare(const every_gpio_pin_group* group, uint32_t values, every_gpio_group_output* out);
+
+/** writes prepared pin values, one store per port.
+	@param out values prepared by every_gpio_group_prepare() */
+void every_gpio_group_apply(const every_gpio_group_output* out);
+
+/** reads all pins of a group, one load per port.
+	@param group the group
+	@return pin values by group index: bit 0 is the pin that was added first
+*/
+uint32_t every_gpio_group_read(const every_gpio_pin_group* group);
+
 /** sets the pullup/pulldown resistors of an IO pin. 
 	@param pin pointer to a pin register in the IOCON struct. Must be a pin that supports pullup/pulldown, in a supported mode
 	@param mode mode to set to
@@ -161,5 +241,45 @@ uint32_t every_gpio_get_interrupt_mask(uint8_t port);
 	@param mask ORed pins to clear */
 void every_gpio_clear_interrupt_mask(uint8_t port, uint32_t mask);
 
+/** pin interrupt callback, see every_gpio_attach_interrupt
+	@param port the port of the pin that caused the interrupt
+	@param pin the pin that caused the interrupt */
+typedef void (*every_gpio_handler)(uint8_t port, uint8_t pin);
+
+/** registers a callback for a pin interrupt and sets the pin's interrupt mode.
+	The library's default gpioX_handler functions dispatch port interrupts to the
+	registered callbacks, so applications using this don't implement gpioX_handler
+	themselves (doing so disables dispatching for that port).
+	@param port the GPIO port
+	@param pin the GPIO pin
+	@param mode the interrupt behaviour
+	@param handler callback, called from the port interrupt
+	@param debounceMs 0 for no debouncing. Otherwise, the pin is masked for this number
+		of milliseconds (1..255) after each event, and bounces meanwhile are dropped. If the
+		pin ended up in a state that would trigger the interrupt mode, the callback is called
+		once more when the mask is lifted. Requires every_gpio_debounce_init. */
+void every_gpio_attach_interrupt(uint8_t port, uint8_t pin, every_gpio_interrupt_mode mode, every_gpio_handler handler, uint8_t debounceMs);
+
+/** disables a pin interrupt and removes its callback
+	@param port the GPIO port
+	@param pin the GPIO pin */
+void every_gpio_detach_interrupt(uint8_t port, uint8_t pin);
+
+/** dispatches pending interrupts of a port to the registered callbacks. This is what the
+	default gpioX_handler functions do - call it from your own handler if you need one.
+	@param port the GPIO port */
+void every_gpio_dispatch(uint8_t port);
+
+/** sets up the debounce service for attached interrupts. One timer serves all pins, it only
+	runs while pins are masked. Its interrupt handler must call every_gpio_debounce_timer_handler
+	and must have the same priority as the GPIO interrupts, e.g.:
+
+		void ct16b0_handler(void) { every_gpio_debounce_timer_handler(); }
+
+	@param timer the timer to use, reserved for the debounce service */
+void every_gpio_debounce_init(TimerId timer);
+
+/** to be called from the debounce timer's interrupt handler */
+void every_gpio_debounce_timer_handler(void);
 
 #endif
@@ -10,15 +10,14 @@ static volatile uint8_t latestI2CState = 0;
 
 void I2C_Init(I2C_MODE mode, I2C_State* inState) {
 	i2c_state = inState;
-	i2c_state->refcon = 0;
-	i2c_state->slaveAddress = 0;
-	i2c_state->toWrite = 0;
-	i2c_state->writeBuffer = NULL;
-	i2c_state->toRead = 0;
-	i2c_state->readBuffer = NULL;
-	i2c_state->completionHandler = NULL;
-	i2c_state->flags = 0;
+	i2c_state->head = NULL;
+	i2c_state->tail = NULL;
+	i2c_state->written = 0;
+	i2c_state->read = 0;
+	i2c_state->holding = false;
 	i2c_state->ignoreNack = false;
+	i2c_state->single.status = I2C_STATUS_OK;
+	i2c_state->single.next = NULL;
 
 	uint32_t scl = 360;	//default: 100kbps
 	switch (mode) {		//set pin functions and I2C clock rate: 2 * SCL * data rate = CPU clock
@@ -59,114 +58,186 @@ void I2C_SetIgnoreNACK(bool ignore) {
 }
 
 void I2C_WriteNextByte() {	//very low level, just push next byte from buffer
-	I2C->DAT = *(i2c_state->writeBuffer);
-	i2c_state->writeBuffer++;
-	i2c_state->toWrite--;
+	I2C_Transaction* t = i2c_state->head;
+	I2C->DAT = t->writeBuffer[i2c_state->written];
+	i2c_state->written++;
+}
+
+/** stores a received byte into the current transaction's read buffer */
+static void I2C_StoreReadByte() {
+	I2C_Transaction* t = i2c_state->head;
+	uint8_t val = I2C->DAT;
+	if (i2c_state->read < t->readLen) {
+		t->readBuffer[i2c_state->read] = val;
+		i2c_state->read++;
+	}
+}
+
+/** sets AA depending on whether the current transaction reads more than one byte (ACK) or just the last one (NACK) */
+static void I2C_SetReadAck() {
+	I2C_Transaction* t = i2c_state->head;
+	if ((t->readLen - i2c_state->read) > 1) I2C->CONSET = I2C_CONSET_AA;
+	else I2C->CONCLR = I2C_CONCLR_AAC;
+}
+
+/** the current transaction moved all its data: continue with reading (repeated start) or complete it
+ @return true if the transaction completed */
+static bool I2C_WriteDone() {
+	I2C_Transaction* t = i2c_state->head;
+	if (i2c_state->read < t->readLen) {
+		I2C->CONSET = I2C_CONSET_STA;	//repeated start for reading
+		return false;
+	}
+	return true;
+}
+
+/** dequeues the current transaction, notifies the user and sets up the bus for the next one.
+ Bus idle time between transactions is avoided: If another transaction is queued (also from within
+ the completion handler), it follows with a repeated start (or directly continues writing after
+ I2C_FLAGS_WRITE_MORE). Clears SI unless the bus is held.
+ @param status result of the current transaction
+ @param busOwned false if we lost the bus (arbitration lost) */
+static void I2C_CompleteTransaction(I2C_STATUS status, bool busOwned) {
+	I2C_Transaction* t = i2c_state->head;
+	i2c_state->head = t->next;
+	if (!(i2c_state->head)) i2c_state->tail = NULL;
+	i2c_state->written = 0;
+	i2c_state->read = 0;
+	t->next = NULL;
+	t->status = status;
+	if (t->completionHandler) t->completionHandler(t->refcon, status);
+
+	I2C_Transaction* next = i2c_state->head;
+	bool ok = (status == I2C_STATUS_OK);
+	if (ok && (t->flags & I2C_FLAGS_WRITE_MORE)) {
+		if (next) {							//continue with the next transaction's data
+			if (next->writeLen > 0) I2C_WriteNextByte();
+			else I2C->CONSET = I2C_CONSET_STA;
+			I2C->CONCLR = I2C_CONCLR_SIC;
+		} else {							//hold the bus (SCL low) until the next submission
+			i2c_state->holding = true;
+			NVIC_DisableInterrupt(NVIC_I2C0);
+		}
+	} else {
+		if (!busOwned) {					//bus released by hardware, just retry
+			if (next) I2C->CONSET = I2C_CONSET_STA;
+		} else if (next && ok && !(t->flags & I2C_FLAGS_STOP)) {
+			I2C->CONSET = I2C_CONSET_STA;	//repeated start
+		} else {
+			I2C->CONSET = I2C_CONSET_STO | (next ? I2C_CONSET_STA : 0);	//stop, then start if needed
+		}
+		I2C->CONCLR = I2C_CONCLR_SIC;
+	}
 }
 
 void i2c_handler(void) {
 	uint32_t status = 0xf8 & I2C->STAT;
 	if (status) latestI2CState = status;
 
-	I2C_STATUS userStatus = I2C_STATUS_OK; 	//status code to return
+	I2C_Transaction* t = i2c_state->head;
+	if (!t) {	//nothing to do (e.g. cancelled) - release the bus
+		I2C->CONSET = I2C_CONSET_STO;
+		I2C->CONCLR = I2C_CONCLR_SIC | I2C_CONCLR_STAC;
+		return;
+	}
 
 	switch (status) {
 		case I2C_STAT_START_SENT:			//Start condition: load address+read/write, clear start
 		case I2C_STAT_REP_START_SENT:
-			I2C->DAT = (i2c_state->slaveAddress << 1) | ((i2c_state->toWrite > 0) ? 0 : 1);	//SLA+R/W
+			I2C->DAT = (t->slaveAddress << 1) | (((i2c_state->written < t->writeLen) || (t->readLen == 0)) ? 0 : 1);	//SLA+R/W
 			I2C->CONCLR = I2C_CONCLR_STAC;
 			break;
 		case I2C_STAT_SLAW_NACKED:			//SLAW failed -> finish, notify
 			if (!(i2c_state->ignoreNack)) {
 				I2C->CONCLR = I2C_CONCLR_STAC | I2C_CONCLR_AAC;
-				userStatus = I2C_STATUS_ADDRESSING_FAILED;
-				goto stopAndNotifyUser;
-				break;
+				I2C_CompleteTransaction(I2C_STATUS_ADDRESSING_FAILED, true);
+				return;
 			}
 		case I2C_STAT_DATA_WRITE_NACKED:	//Data write failed -> finish, notify
 			if (!(i2c_state->ignoreNack)) {
 				I2C->CONCLR = I2C_CONCLR_STAC | I2C_CONCLR_AAC;
-				userStatus = I2C_STATUS_DATA_FAILED;
-				goto stopAndNotifyUser;
-				break;
+				I2C_CompleteTransaction(I2C_STATUS_DATA_FAILED, true);
+				return;
 			}
 		case I2C_STAT_SLAW_ACKED:			//Write addressing succeeded
 		case I2C_STAT_DATA_WRITE_ACKED:		//Byte successfully written
-			if (i2c_state->toWrite > 0) {		//more to write
+			if (i2c_state->written < t->writeLen) {		//more to write
 				I2C_WriteNextByte();
-			} else {
-				if (i2c_state->flags & I2C_FLAGS_WRITE_MORE) {
-					i2c_state->flags |= I2C_FLAGS_WRITING;
-					userStatus = I2C_STATUS_OK;
-					goto notifyUser;
-				} else {
-					if (i2c_state->toRead > 0) {		//write done, have something to read
-						I2C->CONSET = I2C_CONSET_STA;
-					} else {						//nothing to read or write any more -> stop
-						userStatus = I2C_STATUS_OK;
-						goto stopAndNotifyUser;
-					}	
-				}
+			} else if (I2C_WriteDone()) {
+				I2C_CompleteTransaction(I2C_STATUS_OK, true);
+				return;
 			}
 			break;
 		case I2C_STAT_ARBITRATION_LOST:		//Arbitration lost -> finish, notify
-			i2c_state->toWrite = 0;
-			i2c_state->toRead = 0;
 			I2C->CONCLR = I2C_CONCLR_STAC | I2C_CONCLR_AAC;
-			userStatus = I2C_STATUS_ARBITRATION_LOST;
-			goto notifyUser;
-			break;
+			I2C_CompleteTransaction(I2C_STATUS_ARBITRATION_LOST, false);
+			return;
 		case I2C_STAT_SLAR_NACKED:			//SLAR nacked -> finish, notify
 			if (!(i2c_state->ignoreNack)) {
 				I2C->CONCLR = I2C_CONCLR_STAC | I2C_CONCLR_AAC;
-				userStatus = I2C_STATUS_ADDRESSING_FAILED;
-				goto stopAndNotifyUser;
-				break;
+				I2C_CompleteTransaction(I2C_STATUS_ADDRESSING_FAILED, true);
+				return;
 			}
 		case I2C_STAT_SLAR_ACKED:
-			if (i2c_state->toRead > 1) I2C->CONSET = I2C_CONSET_AA;
-			else I2C->CONCLR = I2C_CONCLR_AAC;
+			I2C_SetReadAck();
 			break;
 		case I2C_STAT_DATA_READ_ACKED:		//byte read and acked (more to come)
-			{
-				uint8_t val = I2C->DAT;
-				if (i2c_state->toRead > 0) {
-					*(i2c_state->readBuffer) = val;
-					i2c_state->readBuffer++;
-					i2c_state->toRead--;
-				}
-			}
-			if (i2c_state->toRead > 1) I2C->CONSET = I2C_CONSET_AA;
-			else I2C->CONCLR = I2C_CONCLR_AAC;
+			I2C_StoreReadByte();
+			I2C_SetReadAck();
 			break;
 		case I2C_STAT_DATA_READ_NACKED:		//byte read and nacked (done)
-			{
-				uint8_t val = I2C->DAT;
-				if (i2c_state->toRead > 0) {
-					*(i2c_state->readBuffer) = val;
-					i2c_state->readBuffer++;
-					i2c_state->toRead--;
-				}
-			}
-			userStatus = I2C_STATUS_OK;
-			goto stopAndNotifyUser;
-			break;
+			I2C_StoreReadByte();
+			I2C_CompleteTransaction(I2C_STATUS_OK, true);
+			return;
 		default: 	//Should not happen
-			userStatus = I2C_STATUS_INTERNAL_ERROR;
-			goto stopAndNotifyUser;
-			break;
+			I2C_CompleteTransaction(I2C_STATUS_INTERNAL_ERROR, true);
+			return;
 	}
 
 	I2C->CONCLR = I2C_CONCLR_SIC; 	//Clear interrupt - continue bus
-	return;
-
-stopAndNotifyUser:
-	i2c_state->toWrite = 0;
-	i2c_state->toRead = 0;
-	I2C->CONSET = I2C_CONSET_STO;
-notifyUser:
-	I2C->CONCLR = I2C_CONCLR_SIC;
-	if (i2c_state->completionHandler) i2c_state->completionHandler(i2c_state->refcon, userStatus);
+}
+
+I2C_STATUS I2C_Submit(I2C_Transaction* transaction) {
+	if (i2c_state == POINTER_NOT_SET) return I2C_STATUS_UNINITIALIZED;
+	if (transaction->status == I2C_STATUS_BUSY) return I2C_STATUS_BUSY;
+	transaction->status = I2C_STATUS_BUSY;
+	transaction->next = NULL;
+
+	bool inHandler = NVIC_IsInterruptActive(NVIC_I2C0);	//submitted from a completion handler?
+	NVIC_DisableInterrupt(NVIC_I2C0);
+	if (i2c_state->tail) i2c_state->tail->next = transaction;
+	else i2c_state->head = transaction;
+	i2c_state->tail = transaction;
+	if (i2c_state->holding) {
+		//bus is held after a I2C_FLAGS_WRITE_MORE transaction: the pending interrupt continues with this one
+		i2c_state->holding = false;
+	} else if ((i2c_state->head == transaction) && !inHandler) {
+		//bus idle: start. From within the handler, I2C_CompleteTransaction takes care of this.
+		I2C->CONSET = I2C_CONSET_STA;
+	}
+	NVIC_EnableInterrupt(NVIC_I2C0);
+	return I2C_STATUS_OK;
+}
+
+I2C_STATUS I2C_SubmitWriteRead(I2C_Transaction* transaction,
+							   uint8_t addr,
+							   uint16_t writeLen,
+							   const uint8_t* writeBuf,
+							   uint16_t readLen,
+							   uint8_t* readBuf,
+							   uint8_t flags,
+							   I2C_CompletionHandler handler,
+							   uint32_t refcon) {
+	if (transaction->status == I2C_STATUS_BUSY) return I2C_STATUS_BUSY;
+	transaction->slaveAddress = addr;
+	transaction->flags = flags;
+	transaction->writeLen = writeLen;
+	transaction->writeBuffer = writeBuf;
+	transaction->readLen = readLen;
+	transaction->readBuffer = readBuf;
+	transaction->completionHandler = handler;
+	transaction->refcon = refcon;
+	return I2C_Submit(transaction);
 }
 
 I2C_STATUS I2C_Write(uint8_t addr,
@@ -194,39 +265,30 @@ I2C_STATUS I2C_WriteRead(uint8_t addr,
 						I2C_CompletionHandler handler,
 						uint32_t refcon) {
 	if (i2c_state == POINTER_NOT_SET) return I2C_STATUS_UNINITIALIZED;
-	if (I2C_TransactionRunning()) return I2C_STATUS_BUSY;
-	i2c_state->refcon = refcon;
-	i2c_state->slaveAddress = addr;
-	i2c_state->toWrite = writeLen;
-	i2c_state->writeBuffer = writeBuf;
-	i2c_state->toRead = readLen;
-	i2c_state->readBuffer = readBuf;
-	i2c_state->completionHandler = handler;
-
-	//parse flags from last transaction
-	bool continueWrite = (i2c_state->flags & I2C_FLAGS_WRITING) && (i2c_state->toWrite > 0);
-	//clear all old flags
-	i2c_state->flags = 0;
-	//set relevant flags for new transaction
-	if (moreToSend) {
-		i2c_state->flags |= I2C_FLAGS_WRITE_MORE;
-	}
-	//start
-	if (continueWrite) {	//continued write
-		I2C_WriteNextByte();
-	} else {
-		I2C->CONSET = I2C_CONSET_STA; //send start condition.
-	}
-	return I2C_STATUS_OK;
+	return I2C_SubmitWriteRead(&(i2c_state->single), addr, writeLen, writeBuf, readLen, readBuf,
+		moreToSend ? I2C_FLAGS_WRITE_MORE : 0, handler, refcon);
 }
 
 bool I2C_TransactionRunning() {
-	return ((i2c_state->toRead > 0) || (i2c_state->toWrite > 0));
+	if (i2c_state == POINTER_NOT_SET) return false;
+	return (i2c_state->head != NULL);
 }
 
 void I2C_CancelTransaction() {
-	i2c_state->completionHandler = NULL;
-	i2c_state->toWrite = 0;
-	i2c_state->toRead = 0;
+	if (i2c_state == POINTER_NOT_SET) return;
+	NVIC_DisableInterrupt(NVIC_I2C0);
+	I2C_Transaction* t = i2c_state->head;
+	while (t) {
+		I2C_Transaction* next = t->next;
+		t->next = NULL;
+		t->status = I2C_STATUS_CANCELLED;
+		t = next;
+	}
+	i2c_state->head = NULL;
+	i2c_state->tail = NULL;
+	i2c_state->written = 0;
+	i2c_state->read = 0;
+	i2c_state->holding = false;
 	I2C->CONSET = I2C_CONSET_STO; //send stop condition (which will hopefully stop everything)
+	NVIC_EnableInterrupt(NVIC_I2C0);
 }
@@ -21,6 +21,7 @@ typedef enum {
 	I2C_STATUS_ARBITRATION_LOST,
 	I2C_STATUS_TIMEOUT,
 	I2C_STATUS_INTERNAL_ERROR,	//Something weird happened
+	I2C_STATUS_CANCELLED,		//Transaction was cancelled before it completed
 } I2C_STATUS;
 
 /** User-supplied callback when a I2C transaction finished.
@@ -84,23 +85,38 @@ typedef enum {
 } I2C_STAT_CODE;
 
 
-/** transaction flags (current or last transaction) */
+/** transaction flags */
 typedef enum {
-	I2C_FLAGS_WRITE_MORE         = 0x01,  //go back to user after writing, don't stop the transaction
-	I2C_FLAGS_WRITING            = 0x02   //bus write in progress
+	I2C_FLAGS_WRITE_MORE         = 0x01,  //keep the bus after writing: the next transaction continues writing without new start and address
+	I2C_FLAGS_STOP               = 0x02   //always send STOP after this transaction (e.g. to commit EEPROM writes), even if more are queued
 } I2C_FLAGS;
 
+/** A queued I2C transaction: writes (optional), then reads (optional) using a repeated start.
+ The structure is owned by the I2C engine from submission until its completion handler was called,
+ so it must stay valid (in RAM) until then. Multiple transactions may be queued - they are executed
+ back-to-back from the interrupt handler, linked by repeated starts unless I2C_FLAGS_STOP is set. */
+typedef struct _I2C_Transaction {
+	uint8_t slaveAddress;                     //slave address to talk to
+	uint8_t flags;                            //bitwise or of I2C_FLAGS
+	uint16_t writeLen;                        //number of bytes to write
+	const uint8_t* writeBuffer;               //data to write
+	uint16_t readLen;                         //number of bytes to read
+	uint8_t* readBuffer;                      //buffer to store read data
+	I2C_CompletionHandler completionHandler;  //called when the transaction completed, may be NULL
+	uint32_t refcon;                          //user-supplied value passed to the completion handler
+	volatile I2C_STATUS status;               //I2C_STATUS_BUSY while queued or running, result afterwards
+	struct _I2C_Transaction* volatile next;   //internal: queue link
+} I2C_Transaction;
+
 /** structure for housekeeping of transactions */
 typedef struct {
-	volatile uint32_t refcon;		//user-supplied refcon for this transaction
-	volatile uint8_t slaveAddress;  //slave address to talk to
-	volatile uint16_t toWrite;      //remaining number of bytes to write
-	volatile const uint8_t* writeBuffer;  //pointer to next byte to write
-	volatile uint16_t toRead;       //remaining number of bytes to read
-	volatile uint8_t* readBuffer;   //pointer to next byte to read
-	volatile I2C_CompletionHandler completionHandler;  //callback when transaction is completed
-	volatile uint8_t flags;			//flags (bitwise or of I2C_FLAGS)iting (still active)
-	volatile bool ignoreNack;		//if true, NACK is treated just like ACK
+	I2C_Transaction* volatile head;  //transaction currently on the bus, NULL if none
+	I2C_Transaction* volatile tail;  //last queued transaction
+	volatile uint16_t written;       //number of bytes of the head transaction already written
+	volatile uint16_t read;          //number of bytes of the head transaction already read
+	volatile bool holding;           //bus is held after a I2C_FLAGS_WRITE_MORE transaction
+	volatile bool ignoreNack;        //if true, NACK is treated just like ACK
+	I2C_Transaction single;          //transaction used by I2C_Write, I2C_Read and I2C_WriteRead
 } I2C_State;
 
 /** Codes for bus speed */
@@ -121,7 +137,36 @@ I2C must be initialized
 @param ignore if true, NACK is treated like an ACK */
 void I2C_SetIgnoreNACK(bool ignore);
 
-/** Writes data to I2C. 
+/** Queues a transaction. The transaction starts immediately if the bus is idle, otherwise it
+ follows the queued ones without returning to the main loop. Fill all public fields of the transaction
+ before submitting. May also be called from completion handlers.
+ @param transaction transaction to queue. Must stay valid until its completion handler was called.
+ @return status of submission (does not indicate success of transaction): I2C_STATUS_BUSY if the
+ transaction is already queued */
+I2C_STATUS I2C_Submit(I2C_Transaction* transaction);
+
+/** Fills and queues a transaction (see I2C_Submit)
+ @param transaction transaction to fill and queue. Must stay valid until its completion handler was called.
+ @param addr slave address
+ @param writeLen number of bytes to write
+ @param writeBuf data to write. Must be valid during transaction
+ @param readLen number of bytes to read
+ @param readBuf buffer to store read data. Must be valid during transaction
+ @param flags bitwise or of I2C_FLAGS
+ @param handler function to call after completion of transaction
+ @param refcon user value that will be passed on to completion handler
+ @return status of submission (does not indicate success of transaction) */
+I2C_STATUS I2C_SubmitWriteRead(I2C_Transaction* transaction,
+							   uint8_t addr,
+							   uint16_t writeLen,
+							   const uint8_t* writeBuf,
+							   uint16_t readLen,
+							   uint8_t* readBuf,
+							   uint8_t flags,
+							   I2C_CompletionHandler handler,
+							   uint32_t refcon);
+
+/** Writes data to I2C. Uses the single built-in transaction, see I2C_Submit for queueing multiple ones.
  @param addr slave address
  @param len number of bytes to write
  @param buf data to write. Must be valid during transaction
@@ -134,7 +179,7 @@ I2C_STATUS I2C_Write(uint8_t addr,
                		I2C_CompletionHandler handler,
                		uint32_t refcon);
 
-/** Reads data from I2C. 
+/** Reads data from I2C. Uses the single built-in transaction, see I2C_Submit for queueing multiple ones.
  @param addr slave address
  @param len number of bytes to read
  @param buf buffer to store read data. Must be valid during transaction
@@ -147,7 +192,8 @@ I2C_STATUS I2C_Read(uint8_t addr,
 	           		I2C_CompletionHandler handler,
 	           		uint32_t refcon);
 
-/** First writes to, then reads data from I2C (combined transaction)
+/** First writes to, then reads data from I2C (combined transaction). Uses the single built-in
+ transaction, see I2C_Submit for queueing multiple ones.
  @param addr slave address
  @param writeLen number of bytes to write
  @param writeBuf data to write. Must be valid during transaction
@@ -171,7 +217,8 @@ I2C_STATUS I2C_WriteRead(uint8_t addr,
 bool I2C_TransactionRunning();
 
 
-/** tries to cancel a pending transaction */
+/** tries to cancel all pending transactions. Their status is set to I2C_STATUS_CANCELLED,
+ completion handlers are not called. */
 void I2C_CancelTransaction();
 
 
@@ -0,0 +1,140 @@
+#include "ringbuffer.h"
+#include "utils.h"
+
+/** Make sure data accesses complete before an index update becomes visible to the other side
+ (and vice versa). Also keeps the compiler from reordering memory accesses across it. */
+#ifdef EVERYKEY_HOST_TEST
+#define RINGBUFFER_BARRIER { __sync_synchronize(); }
+#else
+#define RINGBUFFER_BARRIER { __asm volatile ( "DMB\n" : : : "memory"); }
+#endif
+
+void RingBufferInit(const RingBufferStatic* rb) {
+	rb->dynamic->readIdx = 0;
+	rb->dynamic->writeIdx = 0;
+}
+
+/** returns the number of bytes available for reading */
+uint16_t RingBufferReadBytesAvailable(const RingBufferStatic* rb) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	return (uint16_t)(rbdyn->writeIdx - rbdyn->readIdx);
+}
+
+/** returns the number of bytes available for writing */
+uint16_t RingBufferWriteBytesAvailable(const RingBufferStatic* rb) {
+	return (rb->length) - RingBufferReadBytesAvailable(rb);
+}
+
+/** reads a single byte into a ring buffer.
+ @param rb ring buffer
+ @param data data to return by reference
+ @return true if the data could be read, false otherwise */
+bool RingBufferReadByte(const RingBufferStatic* rb, uint8_t* data) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	uint16_t idx = rbdyn->readIdx;
+	if (rbdyn->writeIdx == idx) return false;
+	RINGBUFFER_BARRIER;
+	*data = rbdyn->data[idx & (rb->length - 1)];
+	RINGBUFFER_BARRIER;
+	rbdyn->readIdx = idx + 1;
+	return true;
+}
+
+/** writes a single byte into a ring buffer.
+ @param rb ring buffer
+ @param data data to insert
+ @return true if the data could be written, false otherwise */
+bool RingBufferWriteByte(const RingBufferStatic* rb, uint8_t data) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	uint16_t idx = rbdyn->writeIdx;
+	if ((uint16_t)(idx - rbdyn->readIdx) >= rb->length) return false;
+	RINGBUFFER_BARRIER;
+	rbdyn->data[idx & (rb->length - 1)] = data;
+	RINGBUFFER_BARRIER;
+	rbdyn->writeIdx = idx + 1;
+	return true;
+}
+
+/** reads bytes from a ring buffer. Reads partially if the data does not fit.
+ @param rb ring buffer
+ @param data pointer to data to write to
+ @param length (max) number of bytes to read
+ @return the number of bytes actually read from the ring buffer */
+uint16_t RingBufferReadBuffer(const RingBufferStatic* rb, uint8_t* data, uint16_t length) {
+	uint16_t read = 0;
+	while (read < length) {		//at most two rounds: up to the buffer end, then from the start
+		const uint8_t* block;
+		uint16_t blockLen = RingBufferPeekRead(rb, &block);
+		if (blockLen == 0) break;
+		if (blockLen > length - read) blockLen = length - read;
+		memcpy(data + read, block, blockLen);
+		RingBufferCommitRead(rb, blockLen);
+		read += blockLen;
+	}
+	return read;
+}
+
+/** writes bytes into a ring buffer. Writes partially if the data does not fit.
+ @param rb ring buffer
+ @param data pointer to data to read from
+ @param length (max) number of bytes to write
+ @return the number of bytes actually written into the ring buffer */
+uint16_t RingBufferWriteBuffer(const RingBufferStatic* rb, const uint8_t* data, uint16_t length) {
+	uint16_t written = 0;
+	while (written < length) {	//at most two rounds: up to the buffer end, then from the start
+		uint8_t* block;
+		uint16_t blockLen = RingBufferPeekWrite(rb, &block);
+		if (blockLen == 0) break;
+		if (blockLen > length - written) blockLen = length - written;
+		memcpy(block, data + written, blockLen);
+		RingBufferCommitWrite(rb, blockLen);
+		written += blockLen;
+	}
+	return written;
+}
+
+int32_t RingBufferIndexOf(const RingBufferStatic* rb, uint8_t value) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	uint16_t rIdx = rbdyn->readIdx;
+	uint16_t avail = (uint16_t)(rbdyn->writeIdx - rIdx);
+	uint16_t mask = rb->length - 1;
+	uint16_t i;
+	RINGBUFFER_BARRIER;
+	for (i=0; i<avail; i++) {
+		if (rbdyn->data[(rIdx + i) & mask] == value) return i;
+	}
+	return -1;
+}
+
+uint16_t RingBufferPeekRead(const RingBufferStatic* rb, const uint8_t** data) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	uint16_t rIdx = rbdyn->readIdx;
+	uint16_t avail = (uint16_t)(rbdyn->writeIdx - rIdx);
+	uint16_t offset = rIdx & (rb->length - 1);
+	uint16_t toEnd = rb->length - offset;
+	RINGBUFFER_BARRIER;		//data must not be read before we saw the write index
+	*data = &(rbdyn->data[offset]);
+	return (avail < toEnd) ? avail : toEnd;
+}
+
+void RingBufferCommitRead(const RingBufferStatic* rb, uint16_t length) {
+	RINGBUFFER_BARRIER;		//finish reading before the space is handed back to the writer
+	rb->dynamic->readIdx += length;
+}
+
+uint16_t RingBufferPeekWrite(const RingBufferStatic* rb, uint8_t** data) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	uint16_t wIdx = rbdyn->writeIdx;
+	uint16_t free = rb->length - (uint16_t)(wIdx - rbdyn->readIdx);
+	uint16_t offset = wIdx & (rb->length - 1);
+	uint16_t toEnd = rb->length - offset;
+	RINGBUFFER_BARRIER;		//space must not be written before we saw the read index
+	*data = &(rbdyn->data[offset]);
+	return (free < toEnd) ? free : toEnd;
+}
+
+void RingBufferCommitWrite(const RingBufferStatic* rb, uint16_t length) {
+	RINGBUFFER_BARRIER;		//finish writing before the data is handed to the reader
+	rb->dynamic->writeIdx += length;
+}
+
@@ -0,0 +1,91 @@
+#ifndef _RINGBUFFER_
+#define _RINGBUFFER_
+
+/** a simple single-producer, single-consumer ring buffer implementation. One side (e.g. an
+ interrupt handler) may write while the other side (e.g. main code) reads without disabling
+ interrupts. Indexes run freely and are masked on access, so the full length can be used. */
+ 
+
+#include "types.h"
+
+/** runtime-dynamic components of the ring buffer - must be in RAM */
+typedef struct RingBufferDynamic {
+	volatile uint16_t readIdx;       //free-running index of next data to be read. Only modified by the reader.
+	volatile uint16_t writeIdx;      //free-running index of next data to be written. Only modified by the writer.
+	//If readIdx and writeIdx are equal, the buffer is considered empty.
+	uint8_t data[1];        //resize memory for this structure to fit
+} RingBufferDynamic;
+
+/** static components of the ring buffer - may be in Flash */
+typedef struct RingBufferStatic {
+	uint16_t length;			//size in bytes. Must be a power of two, 32768 max.
+	RingBufferDynamic* dynamic;	//pointer to dynamic components. Must be large enough for structure with data length
+} RingBufferStatic;
+
+/** clears and resets the ring buffer */
+void RingBufferInit(const RingBufferStatic* rb);
+
+/** returns the number of bytes available for reading */
+uint16_t RingBufferReadBytesAvailable(const RingBufferStatic* rb);
+
+/** returns the number of bytes available for writing */
+uint16_t RingBufferWriteBytesAvailable(const RingBufferStatic* rb);
+
+/** reads a single byte into a ring buffer.
+ @param rb ring buffer
+ @param data data to return by reference
+ @return true if the data could be read, false otherwise */
+bool RingBufferReadByte(const RingBufferStatic* rb, uint8_t* data);
+
+/** writes a single byte into a ring buffer.
+ @param rb ring buffer
+ @param data data to insert
+ @return true if the data could be written, false otherwise */
+bool RingBufferWriteByte(const RingBufferStatic* rb, uint8_t data);
+
+/** reads bytes from a ring buffer. Reads partially if the data does not fit.
+ @param rb ring buffer
+ @param data pointer to data to write to
+ @param length (max) number of bytes to read
+ @return the number of bytes actually read from the ring buffer */
+uint16_t RingBufferReadBuffer(const RingBufferStatic* rb, uint8_t* data, uint16_t length);
+
+/** writes bytes into a ring buffer. Writes partially if the data does not fit.
+ @param rb ring buffer
+ @param data pointer to data to read from
+ @param length (max) number of bytes to write
+ @return the number of bytes actually written into the ring buffer */
+uint16_t RingBufferWriteBuffer(const RingBufferStatic* rb, const uint8_t* data, uint16_t length);
+
+/** searches the readable data for a given byte value without consuming anything.
+ @param rb ring buffer
+ @param value byte value to look for
+ @return offset of the first occurrence from the read position, -1 if not found */
+int32_t RingBufferIndexOf(const RingBufferStatic* rb, uint8_t value);
+
+/** zero-copy read access: returns the largest contiguous block of readable data. Call
+ RingBufferCommitRead afterwards to free the bytes actually consumed. Data may be available
+ beyond the block if it wraps around the buffer end - peek again after committing.
+ @param rb ring buffer
+ @param data pointer to the first readable byte, returned by reference
+ @return number of contiguous bytes available at data */
+uint16_t RingBufferPeekRead(const RingBufferStatic* rb, const uint8_t** data);
+
+/** frees bytes that were consumed after RingBufferPeekRead.
+ @param rb ring buffer
+ @param length number of bytes to free. Must not exceed the size returned by the peek. */
+void RingBufferCommitRead(const RingBufferStatic* rb, uint16_t length);
+
+/** zero-copy write access: returns the largest contiguous block of free space. Call
+ RingBufferCommitWrite afterwards to publish the bytes actually filled in.
+ @param rb ring buffer
+ @param data pointer to the first writable byte, returned by reference
+ @return number of contiguous bytes that may be written at data */
+uint16_t RingBufferPeekWrite(const RingBufferStatic* rb, uint8_t** data);
+
+/** publishes bytes that were filled in after RingBufferPeekWrite.
+ @param rb ring buffer
+ @param length number of bytes to publish. Must not exceed the size returned by the peek. */
+void RingBufferCommitWrite(const RingBufferStatic* rb, uint16_t length);
+
+#endif	
@@ -1,6 +1,20 @@
 #include "ssp.h"
 #include "gpio.h"
 #include "memorymap.h"
+#include "nvic.h"
+
+/** block transfer state */
+typedef struct {
+	const uint8_t* tx;               //frames to send, NULL for dummy frames
+	uint8_t* rx;                     //buffer for received frames, NULL to discard
+	uint16_t len;                    //total number of frames
+	volatile uint16_t sent;          //number of frames pushed to the TX FIFO
+	volatile uint16_t received;      //number of frames taken from the RX FIFO
+	SSP_CompletionHandler handler;   //completion handler (interrupt mode)
+	volatile bool running;           //block transfer running
+} SSP_BlockState;
+
+static SSP_BlockState sspBlock = { NULL, NULL, 0, 0, 0, NULL, false };
 
 void SSP_Init(uint8_t clockDiv, uint8_t datasize, SSP_CR0_VALUES frameformat, bool idleClockHigh, bool dataOnSecond, bool master) {
 
@@ -32,8 +46,7 @@ void SSP_Init(uint8_t clockDiv, uint8_t datasize, SSP_CR0_VALUES frameformat, bo
 		frameformat	|
 		(idleClockHigh ? SSP_CR0_CPOL_HIGH : SSP_CR0_CPOL_LOW) | 
 		(dataOnSecond ? SSP_CR0_CPHA_SECOND : SSP_CR0_CPHA_FIRST) | 
-//		(SSP_CR0_SCR_BASE * (clockDiv - 1));	
-		(SSP_CR0_SCR_BASE * 64);		//***************
+		(SSP_CR0_SCR_BASE * 0);		//clock is fully divided by CPSR
 
 	//SSP prescaler clock is divided by this-1 to get baud rate
 	//SSP clock is main clock / SSP0CLKDIV / CPSR / (SCR+1)
@@ -51,10 +64,82 @@ void SSP_Init(uint8_t clockDiv, uint8_t datasize, SSP_CR0_VALUES frameformat, bo
 }
 
 uint16_t SSP_Transfer(uint16_t value) {
-	while ((SSP0->SR & (SSP_SR_TNF | SSP_SR_BSY)) != SSP_SR_TNF) {};	//wait until transfer fifo is not full
+	while (!(SSP0->SR & SSP_SR_TNF)) {};	//wait until transfer fifo is not full
 	SSP0->DR = value;
-	while ((SSP0->SR & (SSP_SR_RNE | SSP_SR_BSY)) != SSP_SR_RNE) {};	//wait until receive fifo is not empty
+	while (!(SSP0->SR & SSP_SR_RNE)) {};	//wait until receive fifo is not empty
 	uint32_t read = SSP0->DR;
 	return read;
 }
 
+/** moves frames between the block buffers and the FIFOs as far as currently possible: drains RX, then
+ * tops up TX to SSP_FIFO_SIZE frames in flight. The three cases are split to keep the inner loops short.
+ * @return true if the block transfer is complete */
+static bool SSP_PumpBlock() {
+	uint16_t len = sspBlock.len;
+	uint16_t sent = sspBlock.sent;
+	uint16_t received = sspBlock.received;
+	uint16_t maxSent;
+	if (sspBlock.rx) {
+		uint8_t* rx = sspBlock.rx;
+		while ((SSP0->SR & SSP_SR_RNE) && (received < sent)) rx[received++] = SSP0->DR;
+	} else {	//TX only: discard
+		while ((SSP0->SR & SSP_SR_RNE) && (received < sent)) {
+			SSP0->DR;
+			received++;
+		}
+	}
+	maxSent = received + SSP_FIFO_SIZE;
+	if (maxSent > len) maxSent = len;
+	if (sspBlock.tx) {
+		const uint8_t* tx = sspBlock.tx;
+		while ((sent < maxSent) && (SSP0->SR & SSP_SR_TNF)) SSP0->DR = tx[sent++];
+	} else {	//RX only: clock out dummies
+		while ((sent < maxSent) && (SSP0->SR & SSP_SR_TNF)) {
+			SSP0->DR = SSP_DUMMY_FRAME;
+			sent++;
+		}
+	}
+	sspBlock.sent = sent;
+	sspBlock.received = received;
+	return (received >= len);
+}
+
+bool SSP_TransferBlock(const uint8_t* tx, uint8_t* rx, uint16_t len, SSP_CompletionHandler handler) {
+	if (sspBlock.running) return false;
+	if (handler && (len == 0)) return false;	//would complete at once, not from the interrupt
+	sspBlock.tx = tx;
+	sspBlock.rx = rx;
+	sspBlock.len = len;
+	sspBlock.sent = 0;
+	sspBlock.received = 0;
+	sspBlock.handler = handler;
+	if (!handler) {		//polling mode
+		while (!SSP_PumpBlock()) {};
+		return true;
+	}
+	//interrupt mode: prime the FIFO, then continue on RX half full / RX timeout. Frames are only
+	//received after they were sent, so the first pump doesn't finish a block of len > 0.
+	sspBlock.running = true;
+	SSP_PumpBlock();
+	SSP0->ICR = SSP_INT_RORI | SSP_INT_RTI;
+	SSP0->IMSC = SSP_INT_RXI | SSP_INT_RTI;
+	NVIC_EnableInterrupt(NVIC_SSP0);
+	return true;
+}
+
+bool SSP_BlockTransferRunning() {
+	return sspBlock.running;
+}
+
+void ssp_handler(void) {
+	SSP0->ICR = SSP_INT_RORI | SSP_INT_RTI;
+	if (!sspBlock.running) {
+		SSP0->IMSC = 0;
+		return;
+	}
+	if (SSP_PumpBlock()) {
+		SSP0->IMSC = 0;
+		sspBlock.running = false;
+		if (sspBlock.handler) sspBlock.handler();
+	}
+}
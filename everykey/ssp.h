@@ -21,5 +21,31 @@ void SSP_Init(uint8_t clockDiv, uint8_t datasize, SSP_CR0_VALUES frameformat, bo
  * @return frame read at the same time */
 uint16_t SSP_Transfer(uint16_t value);
 
+/** frame sent by SSP_TransferBlock if no tx buffer is given */
+#define SSP_DUMMY_FRAME 0xff
+
+/** depth of the SSP TX and RX hardware FIFOs in frames */
+#define SSP_FIFO_SIZE 8
+
+/** User-supplied callback when a block transfer finished. Called from interrupt. */
+typedef void (*SSP_CompletionHandler)(void);
+
+/** transfers a block of frames (4..8 bits per frame), keeping the TX FIFO full so that there are
+ * no gaps between frames. At most SSP_FIFO_SIZE frames are in flight, so the RX FIFO can't overflow.
+ * Without completion handler, the call blocks until the transfer is done (polling mode). With a
+ * completion handler, it returns immediately and the transfer continues from the SSP interrupt
+ * (interrupt mode). Chip select handling is up to the caller.
+ * @param tx frames to send or NULL to send SSP_DUMMY_FRAME (RX only). Must be valid during transfer.
+ * @param rx buffer for received frames or NULL to discard them (TX only). Must be valid during transfer.
+ * @param len number of frames to transfer
+ * @param handler NULL for polling mode, otherwise callback for transfer completion (interrupt mode)
+ * @return true if the transfer was done (polling) or started (interrupt), false if another block
+ * transfer is still running or if len is 0 in interrupt mode (the handler is not called then) */
+bool SSP_TransferBlock(const uint8_t* tx, uint8_t* rx, uint16_t len, SSP_CompletionHandler handler);
+
+/** returns whether a block transfer is running
+ * @return true if an interrupt mode block transfer has not finished yet */
+bool SSP_BlockTransferRunning();
+
 
 #endif
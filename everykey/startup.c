@@ -28,12 +28,13 @@ void ct16b1_handler(void) DEFAULTS_TO(deadend);
 void ct32b0_handler(void) DEFAULTS_TO(deadend);
 void ct32b1_handler(void) DEFAULTS_TO(deadend);
 void i2c_handler(void) DEFAULTS_TO(deadend);
-void gpio0_handler(void) DEFAULTS_TO(deadend);
-void gpio1_handler(void) DEFAULTS_TO(deadend);
-void gpio2_handler(void) DEFAULTS_TO(deadend);
-void gpio3_handler(void) DEFAULTS_TO(deadend);
+void gpio0_handler(void);	//default implementations dispatch to attached callbacks, see gpio.c
+void gpio1_handler(void);
+void gpio2_handler(void);
+void gpio3_handler(void);
 void ssp_handler(void) DEFAULTS_TO(deadend);
 void uart_handler(void) DEFAULTS_TO(deadend);
+void adc_handler(void) DEFAULTS_TO(deadend);
 /* The vector table - contains the initial stack pointer and
  pointers to boot code as well as interrupt and fault handler pointers.
  The processor will expect this to be located at address 0x0, so
@@ -108,7 +109,7 @@ const VECTOR_TABLE vtable = {
 	uart_handler,            //UART
 	usb_irq_handler,         //USB IRQ
 	usb_fiq_handler,         //USB FIQ
-	deadend,                 //ADC
+	adc_handler,             //ADC
 	deadend,                 //WDT
 	deadend,                 //BOD
 	deadend,                 //Flash
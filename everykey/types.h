@@ -1,6 +1,14 @@
 #ifndef _TYPES_
 #define _TYPES_
 
+#ifdef EVERYKEY_HOST_TEST
+
+/* built on a PC by tests/: long is 64 bits there, use the host's fixed size types */
+#include <stdint.h>
+#include <stddef.h>
+
+#else
+
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned long uint32_t;
@@ -12,6 +20,8 @@ typedef short int16_t;
 typedef long int32_t;
 typedef long long int64_t;
 
+#endif
+
 #ifndef __cplusplus
 
 #undef bool
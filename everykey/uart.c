@@ -8,8 +8,11 @@
  buffer reserve (16 bytes total). Allowed values: 1,4,8,14 */
 #define RX_TLVL UART_FCR_RXTLVL8
 
+/* Size of the hardware TX and RX FIFOs */
+#define UART_HW_FIFO_SIZE 16
 
-UART_StatusHandler uartStatusHandler = NULL;
+
+UART_State uartState = { NULL, NULL, NULL, 0 };
 
 
 void UART_Init( uint32_t baud,
@@ -27,9 +30,13 @@ void UART_Init_Ext( uint32_t baud,
                     uint8_t stopBits,
                     bool useHWFlow,
                     UART_StatusHandler statusHandler,
-                    UART_FCR threshold) {
+                    uint8_t threshold) {
 
-	uartStatusHandler = statusHandler;
+	NVIC_DisableInterrupt(NVIC_UART);
+	uartState.statusHandler = statusHandler;
+	uartState.txBuffer = NULL;
+	uartState.rxBuffer = NULL;
+	uartState.overrunCount = 0;
 
 	/* Find best divider, fraction add and mul by trying all add/mul pairs (~100 tries)
 	deriving the best divider and minimizing the difference between hypothetical and real pclk.
@@ -129,6 +136,115 @@ uint8_t UART_Read(uint8_t* buffer, uint8_t maxLength) {
 			UART_HW->RBR_THR_DLL;
 		}
 	}
+	return read;
+}
+
+void UART_SetBuffers(const RingBufferStatic* txBuffer, const RingBufferStatic* rxBuffer) {
+	NVIC_DisableInterrupt(NVIC_UART);
+	uartState.txBuffer = txBuffer;
+	uartState.rxBuffer = rxBuffer;
+	NVIC_EnableInterrupt(NVIC_UART);
+}
+
+/** counts hardware overruns and reports line errors. Reading LSR clears the error bits, so this must be
+called for every LSR value read while receiving.
+@param lineStatus LSR value */
+static void UART_CheckLineStatus(uint8_t lineStatus) {
+	if (lineStatus & UART_LS_OE) uartState.overrunCount++;
+	if (uartState.statusHandler && (lineStatus & (UART_LS_OE | UART_LS_PE | UART_LS_FE | UART_LS_BI))) {
+		if (lineStatus & UART_LS_OE) uartState.statusHandler(UART_STATUS_OVERRUN);
+		if (lineStatus & UART_LS_PE) uartState.statusHandler(UART_STATUS_PARITY_ERROR);
+		if (lineStatus & UART_LS_FE) uartState.statusHandler(UART_STATUS_FRAMING_ERROR);
+		if (lineStatus & UART_LS_BI) uartState.statusHandler(UART_STATUS_BREAK);
+	}
+}
+
+/** moves as many bytes as possible from the software TX fifo to the hardware TX FIFO. Must only be
+called if the hardware FIFO is empty (THRE) and with the UART interrupt blocked or from within it. */
+static void UART_FillTxFifo() {
+	const RingBufferStatic* rb = uartState.txBuffer;
+	uint16_t space = UART_HW_FIFO_SIZE;
+	while (space > 0) {
+		const uint8_t* data;
+		uint16_t avail = RingBufferPeekRead(rb, &data);
+		if (avail == 0) break;
+		if (avail > space) avail = space;
+		uint16_t i;
+		for (i = 0; i < avail; i++) UART_HW->RBR_THR_DLL = data[i];
+		RingBufferCommitRead(rb, avail);
+		space -= avail;
+	}
+}
+
+/** moves all bytes from the hardware RX FIFO to the software RX fifo. If the software fifo is full,
+the RX interrupt is masked, leaving the rest in hardware (UART_ReadBuffered unmasks it again). */
+static void UART_DrainRxFifo() {
+	const RingBufferStatic* rb = uartState.rxBuffer;
+	uint8_t* data;
+	uint16_t space = RingBufferPeekWrite(rb, &data);
+	uint16_t count = 0;
+	while (true) {
+		uint8_t lineStatus = UART_HW->LSR;
+		UART_CheckLineStatus(lineStatus);
+		if (!(lineStatus & UART_LS_RDR)) break;
+		if (count >= space) {	//segment full: commit and try the wrapped part
+			RingBufferCommitWrite(rb, count);
+			count = 0;
+			space = RingBufferPeekWrite(rb, &data);
+			if (space == 0) {
+				UART_HW->DLM_IER &= ~UART_IE_RDR;
+				break;
+			}
+		}
+		data[count++] = UART_HW->RBR_THR_DLL;
+	}
+	if (count > 0) RingBufferCommitWrite(rb, count);
+}
+
+uint16_t UART_WriteBuffered(const uint8_t* buffer, uint16_t length) {
+	if (!uartState.txBuffer) return 0;
+	uint16_t written = RingBufferWriteBuffer(uartState.txBuffer, buffer, length);
+	UART_KickBufferedTx();
+	return written;
+}
+
+uint16_t UART_ReadBuffered(uint8_t* buffer, uint16_t maxLength) {
+	if (!uartState.rxBuffer) return 0;
+	uint16_t read = RingBufferReadBuffer(uartState.rxBuffer, buffer, maxLength);
+	if (read > 0) UART_ResumeBufferedRx();
+	return read;
+}
+
+void UART_KickBufferedTx() {
+	if (!uartState.txBuffer) return;
+	//If the transmitter is idle, no THRE interrupt will come - fill it manually
+	NVIC_DisableInterrupt(NVIC_UART);
+	if (UART_HW->LSR & UART_LS_THRE) UART_FillTxFifo();
+	NVIC_EnableInterrupt(NVIC_UART);
+}
+
+void UART_ResumeBufferedRx() {
+	//The interrupt may have paused reception because the fifo was full. If it is still full, it will pause again.
+	if (uartState.rxBuffer && !(UART_HW->DLM_IER & UART_IE_RDR)) UART_HW->DLM_IER |= UART_IE_RDR;
+}
+
+uint16_t UART_WriteBufferedAvailable() {
+	return uartState.txBuffer ? RingBufferWriteBytesAvailable(uartState.txBuffer) : 0;
+}
+
+uint16_t UART_ReadBufferedAvailable() {
+	return uartState.rxBuffer ? RingBufferReadBytesAvailable(uartState.rxBuffer) : 0;
+}
+
+uint32_t UART_GetOverrunCount() {
+	return uartState.overrunCount;
+}
+
+void UART_SetRTS(bool active) {
+	if (UART_HW->MCR & UART_MCR_RTSEN) return;
+	EVERY_GPIO_SET_FUNCTION(UART_RTS_PORT, UART_RTS_PIN, RTS, IOCON_IO_ADMODE_DIGITAL);
+	if (active) UART_HW->MCR |= UART_MCR_RTSCTRL;
+	else UART_HW->MCR &= ~UART_MCR_RTSCTRL;
 }
 
 /** starts transmitting a break condition (tx low) */
@@ -152,24 +268,22 @@ void uart_handler() {
 			//Do nothing
 			break;
 		case 0x02:		//THRE (Transmitter holding register empty), prio 3, can write TX again
-			if (uartStatusHandler) uartStatusHandler(UART_STATUS_CAN_SEND_MORE);
-			break;
-		case 0x06:		//Receive Line Status (Prio 1)
-			{
-				uint8_t lineStatus = UART_HW->LSR;
-				if (uartStatusHandler) {
-					if (lineStatus & UART_LS_OE) uartStatusHandler(UART_STATUS_OVERRUN);
-					if (lineStatus & UART_LS_PE) uartStatusHandler(UART_STATUS_PARITY_ERROR);
-					if (lineStatus & UART_LS_FE) uartStatusHandler(UART_STATUS_FRAMING_ERROR);
-					if (lineStatus & UART_LS_BI) uartStatusHandler(UART_STATUS_BREAK);
+			if (uartState.txBuffer) {
+				UART_FillTxFifo();
+				if (RingBufferReadBytesAvailable(uartState.txBuffer) > 0) {
+					if (uartState.statusHandler) uartState.statusHandler(UART_STATUS_TX_PROGRESS);
+					break;
 				}
 			}
+			if (uartState.statusHandler) uartState.statusHandler(UART_STATUS_CAN_SEND_MORE);
 			break;
-		case 0x04:		//Receive Data Available (Prio 2) - RX threshold reached
-			if (uartStatusHandler) uartStatusHandler(UART_STATUS_DATA_AVAILABLE);
+		case 0x06:		//Receive Line Status (Prio 1)
+			UART_CheckLineStatus(UART_HW->LSR);
 			break;
+		case 0x04:		//Receive Data Available (Prio 2) - RX threshold reached
 		case 0x0c:		//Character Timeout (Prio 2) - RX data and no new data for some time
-			if (uartStatusHandler) uartStatusHandler(UART_STATUS_DATA_AVAILABLE);
+			if (uartState.rxBuffer) UART_DrainRxFifo();
+			if (uartState.statusHandler) uartState.statusHandler(UART_STATUS_DATA_AVAILABLE);
 			break;
 		default:	//All other values are reserved
 			break;
@@ -4,6 +4,7 @@
 #define _UART_
 
 #include "types.h"
+#include "ringbuffer.h"
 
 #define UART_RXD_PORT 1
 #define UART_RXD_PIN 6
@@ -33,7 +34,8 @@ typedef enum {
     UART_STATUS_OVERRUN,            //Receive buffer overrun
     UART_STATUS_PARITY_ERROR,       //Parity error encountered
     UART_STATUS_FRAMING_ERROR,      //0 stop bit received
-    UART_STATUS_BREAK               //Break condition detected
+    UART_STATUS_BREAK,              //Break condition detected
+    UART_STATUS_TX_PROGRESS         //Software TX fifo partly drained, more data left to send
 } UART_Status;
 
 /** User-supplied handler for errors or other status events
@@ -43,6 +45,9 @@ typedef void (*UART_StatusHandler)(UART_Status status);
 /** Internal UART software driver state */
 typedef struct {
     UART_StatusHandler statusHandler;
+    const RingBufferStatic* txBuffer;   //software TX fifo, NULL if unbuffered
+    const RingBufferStatic* rxBuffer;   //software RX fifo, NULL if unbuffered
+    volatile uint32_t overrunCount;     //number of hardware RX FIFO overruns (data lost)
 } UART_State;
 
 /** Initializes the UART peripheral to a specific mode. This call currently assumes 72 MHz main clock.
@@ -93,6 +98,55 @@ uint8_t UART_Read(uint8_t* buffer, uint8_t maxLength);
 @return true if data could be read */
 bool UART_Read1(uint8_t* buffer);
 
+/** Attaches software fifos to the UART, turning the interrupt handler into a data pump: It drains
+the hardware RX FIFO into rxBuffer on RX threshold and character timeout interrupts and refills the
+hardware TX FIFO (16 bytes at a time) from txBuffer whenever it runs empty. Call this after UART_Init. The fifos
+must be initialized (RingBufferInit) - they are not cleared here, so they may be shared with other
+drivers (e.g. the CDC class ring buffers).
+If rxBuffer is full, the RX interrupt is masked and data stays in the hardware FIFO until
+UART_ReadBuffered makes room - with hardware flow control, auto-RTS then stops the sender, so no data
+is lost. Without flow control, the hardware FIFO may overflow, which is counted by UART_GetOverrunCount.
+The status handler is still called: DATA_AVAILABLE after data was moved to rxBuffer, CAN_SEND_MORE
+when txBuffer ran empty and TX_PROGRESS after each hardware FIFO refill that left data in txBuffer.
+@param txBuffer fifo for outgoing data or NULL to keep using UART_Write. Ring buffers are single-producer,
+single-consumer: Only one context (main code or one interrupt level) should call UART_WriteBuffered.
+@param rxBuffer fifo for incoming data or NULL to keep using UART_Read */
+void UART_SetBuffers(const RingBufferStatic* txBuffer, const RingBufferStatic* rxBuffer);
+
+/** queues bytes for sending via the software TX fifo and starts transmission if the UART is idle.
+@param buffer bytes to send
+@param length number of bytes to send
+@return number of bytes that were queued (may be less than length if the fifo is full) */
+uint16_t UART_WriteBuffered(const uint8_t* buffer, uint16_t length);
+
+/** reads received bytes from the software RX fifo
+@param buffer buffer to hold received data
+@param maxLength maximum number of bytes to read
+@return number of bytes read */
+uint16_t UART_ReadBuffered(uint8_t* buffer, uint16_t maxLength);
+
+/** @return number of bytes that may be passed to UART_WriteBuffered without being truncated */
+uint16_t UART_WriteBufferedAvailable();
+
+/** @return number of received bytes waiting in the software RX fifo */
+uint16_t UART_ReadBufferedAvailable();
+
+/** starts transmission after data was added to the software TX fifo by other means than
+UART_WriteBuffered (e.g. by another driver writing to a shared ring buffer). Does nothing if the
+transmitter is already busy. */
+void UART_KickBufferedTx();
+
+/** resumes reception into the software RX fifo if it was paused because the fifo was full. Call
+this after data was removed from the RX fifo by other means than UART_ReadBuffered. */
+void UART_ResumeBufferedRx();
+
+/** @return number of hardware RX FIFO overruns since UART_Init */
+uint32_t UART_GetOverrunCount();
+
+/** sets the RTS output. Has no effect if hardware flow control is enabled (Auto-RTS drives the pin then).
+@param active true to assert RTS (pin low), false to deassert it (pin high) */
+void UART_SetRTS(bool active);
+
 /** starts transmitting a break condition (tx low) */
 void UART_StartBreak();
 
@@ -144,9 +198,11 @@ typedef enum {
 
 /** bits for the MCS register */
 typedef enum {
-    UART_MCR_LMS = 0x01,            //Loopback mode select (usually diagnostics only)
-    UART_MCR_RTSEN = 0x02,          //Enable Auto-RTS
-    UART_MCR_CTSEN = 0x04           //Enable Auto-CTS
+    UART_MCR_DTRCTRL = 0x01,        //DTR output control (1 = DTR active/low)
+    UART_MCR_RTSCTRL = 0x02,        //RTS output control if Auto-RTS is off (1 = RTS active/low)
+    UART_MCR_LMS = 0x10,            //Loopback mode select (usually diagnostics only)
+    UART_MCR_RTSEN = 0x40,          //Enable Auto-RTS
+    UART_MCR_CTSEN = 0x80           //Enable Auto-CTS
 } UART_MCS;
 
 /** values for the FIFO control register */
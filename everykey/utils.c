@@ -1,5 +1,6 @@
 #include "utils.h"
 
+#ifndef EVERYKEY_HOST_TEST	//tests/ only builds the memory functions on the host
 
 void waitForInterrupt() {
 	__asm ( "WFI\n" );
@@ -25,34 +26,212 @@ void enableInterrupts() {
 	);
 }
 
+uint32_t saveAndDisableInterrupts() {
+	uint32_t previous;
+	__asm volatile (
+		 "MRS %0, PRIMASK\n"
+		 "CPSID I\n"
+		 : "=r" (previous)
+		 :
+		 : "memory"
+	);
+	return previous;
+}
+
+void restoreInterrupts(uint32_t previous) {
+	__asm volatile (
+		 "MSR PRIMASK, %0\n"
+		 :
+		 : "r" (previous)
+		 : "memory"
+	);
+}
+
+uint32_t maskInterrupts(uint8_t priority) {
+	uint32_t previous;
+	__asm volatile (
+		 "MRS %0, BASEPRI\n"
+		 "MSR BASEPRI_MAX, %1\n"
+		 : "=&r" (previous)
+		 : "r" ((uint32_t)priority)
+		 : "memory"
+	);
+	return previous;
+}
+
+void unmaskInterrupts(uint32_t previous) {
+	__asm volatile (
+		 "MSR BASEPRI, %0\n"
+		 :
+		 : "r" (previous)
+		 : "memory"
+	);
+}
+
+#endif
+
+
+/* The memory functions below work on aligned 32 bit words where possible and fall back to bytes
+for unaligned heads and tails. Bulk parts are unrolled to 4 words per iteration so that the compiler
+can use LDM/STM. If source and destination differ in alignment, words can't be used and we copy
+byte-wise (still unrolled). */
+
+#define WORD_MASK 3
+#define BLOCK_SIZE 16
 
 void* memset(void* b, int c, uint32_t len) {
-        uint8_t* buf = b;
-        uint32_t i;
-        for (i=0; i<len; i++) {
-                buf[i] = c;
+    uint8_t* buf = b;
+    uint8_t val = c;
+    while ((len > 0) && (((size_t)buf) & WORD_MASK)) {
+        *buf++ = val;
+        len--;
+    }
+    if (len >= 4) {
+        uint32_t word = (uint32_t)val * 0x01010101u;
+        uint32_t* wbuf = (uint32_t*)buf;
+        while (len >= BLOCK_SIZE) {
+            wbuf[0] = word;
+            wbuf[1] = word;
+            wbuf[2] = word;
+            wbuf[3] = word;
+            wbuf += 4;
+            len -= BLOCK_SIZE;
         }
-        return b;
+        while (len >= 4) {
+            *wbuf++ = word;
+            len -= 4;
+        }
+        buf = (uint8_t*)wbuf;
+    }
+    while (len > 0) {
+        *buf++ = val;
+        len--;
+    }
+    return b;
 }
 
 void* memcpy(void* to, const void* from, uint32_t len) {
-        uint8_t* dst = to;
-        const uint8_t* src = from;
-        uint32_t i;
-        for (i=0; i<len; i++) {
-                dst[i] = src[i];
+    uint8_t* dst = to;
+    const uint8_t* src = from;
+    if ((((size_t)dst ^ (size_t)src) & WORD_MASK) == 0) {
+        //same alignment: copy head bytes, then words
+        while ((len > 0) && (((size_t)dst) & WORD_MASK)) {
+            *dst++ = *src++;
+            len--;
+        }
+        uint32_t* wdst = (uint32_t*)dst;
+        const uint32_t* wsrc = (const uint32_t*)src;
+        while (len >= BLOCK_SIZE) {
+            uint32_t w0 = wsrc[0];
+            uint32_t w1 = wsrc[1];
+            uint32_t w2 = wsrc[2];
+            uint32_t w3 = wsrc[3];
+            wdst[0] = w0;
+            wdst[1] = w1;
+            wdst[2] = w2;
+            wdst[3] = w3;
+            wsrc += 4;
+            wdst += 4;
+            len -= BLOCK_SIZE;
+        }
+        while (len >= 4) {
+            *wdst++ = *wsrc++;
+            len -= 4;
         }
-        return to;
+        dst = (uint8_t*)wdst;
+        src = (const uint8_t*)wsrc;
+    } else {
+        while (len >= 4) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = src[3];
+            dst += 4;
+            src += 4;
+            len -= 4;
+        }
+    }
+    while (len > 0) {
+        *dst++ = *src++;
+        len--;
+    }
+    return to;
+}
+
+void* memmove(void* to, const void* from, uint32_t len) {
+    uint8_t* dst = to;
+    const uint8_t* src = from;
+    if ((dst <= src) || (dst >= src + len)) {
+        //no harmful overlap - a forward copy is fine
+        return memcpy(to, from, len);
+    }
+    //destination overlaps source end: copy backwards
+    dst += len;
+    src += len;
+    if ((((size_t)dst ^ (size_t)src) & WORD_MASK) == 0) {
+        while ((len > 0) && (((size_t)dst) & WORD_MASK)) {
+            *--dst = *--src;
+            len--;
+        }
+        uint32_t* wdst = (uint32_t*)dst;
+        const uint32_t* wsrc = (const uint32_t*)src;
+        while (len >= BLOCK_SIZE) {
+            uint32_t w3 = wsrc[-1];
+            uint32_t w2 = wsrc[-2];
+            uint32_t w1 = wsrc[-3];
+            uint32_t w0 = wsrc[-4];
+            wdst[-1] = w3;
+            wdst[-2] = w2;
+            wdst[-3] = w1;
+            wdst[-4] = w0;
+            wsrc -= 4;
+            wdst -= 4;
+            len -= BLOCK_SIZE;
+        }
+        while (len >= 4) {
+            *--wdst = *--wsrc;
+            len -= 4;
+        }
+        dst = (uint8_t*)wdst;
+        src = (const uint8_t*)wsrc;
+    }
+    while (len > 0) {
+        *--dst = *--src;
+        len--;
+    }
+    return to;
 }
 
 int memcmp(const void *s1, const void *s2, uint32_t n) {
-    uint32_t i;
     const uint8_t* buf1 = s1;
     const uint8_t* buf2 = s2;
-    for (i=0; i<n; i++) {
-        if (buf1[i] != buf2[i]) {
-            return buf2[i] - buf1[i];
+    if ((((size_t)buf1 ^ (size_t)buf2) & WORD_MASK) == 0) {
+        while ((n > 0) && (((size_t)buf1) & WORD_MASK)) {
+            if (*buf1 != *buf2) {
+                return *buf2 - *buf1;
+            }
+            buf1++;
+            buf2++;
+            n--;
+        }
+        //skip equal words, leave the first differing word to the byte loop below
+        const uint32_t* wbuf1 = (const uint32_t*)buf1;
+        const uint32_t* wbuf2 = (const uint32_t*)buf2;
+        while ((n >= 4) && (*wbuf1 == *wbuf2)) {
+            wbuf1++;
+            wbuf2++;
+            n -= 4;
+        }
+        buf1 = (const uint8_t*)wbuf1;
+        buf2 = (const uint8_t*)wbuf2;
+    }
+    while (n > 0) {
+        if (*buf1 != *buf2) {
+            return *buf2 - *buf1;
         }
+        buf1++;
+        buf2++;
+        n--;
     }
     return 0;
 }
@@ -67,6 +246,7 @@ uint32_t strlen(const char* s) {
 
 char* strcpy(char *dst, const char *src) {
     memcpy(dst, src, strlen(src) + 1); //copy including termination
+    return dst;
 }
 
 /** compare strings */
@@ -14,12 +14,34 @@ void disableInterrupts();
 /** re-enable interrupts */
 void enableInterrupts();
 
+/** disables interrupts like disableInterrupts(), but can be nested and used where interrupts
+	might already be off: restoreInterrupts() only re-enables them if they were on before
+	@return the previous PRIMASK, to be passed to restoreInterrupts() */
+uint32_t saveAndDisableInterrupts();
+
+/** restores the interrupt state from before saveAndDisableInterrupts()
+	@param previous the return value of the matching saveAndDisableInterrupts() call */
+void restoreInterrupts(uint32_t previous);
+
+/** masks interrupts with a priority value of priority or above (i.e. the same or lower urgency),
+	more urgent ones keep running. Never lowers an existing mask.
+	@param priority priority value (0-255, only the upper 3 bits count), must not be 0
+	@return the previous mask, to be passed to unmaskInterrupts() */
+uint32_t maskInterrupts(uint8_t priority);
+
+/** restores the interrupt mask from before maskInterrupts()
+	@param previous the return value of the matching maskInterrupts() call */
+void unmaskInterrupts(uint32_t previous);
+
 /** set memory */
 void* memset(void* b, int c, uint32_t len);
 
-/** copy memory */
+/** copy memory. Source and destination must not overlap. */
 void* memcpy(void* to, const void* from, uint32_t len);
 
+/** copy memory. Source and destination may overlap. */
+void* memmove(void* to, const void* from, uint32_t len);
+
 /** compare memory */
 int memcmp(const void *s1, const void *s2, uint32_t n);
 
@@ -148,6 +148,17 @@ bool USBCDC_ExtendedControlSetupHandler(USB_Device_Struct* device, const USB_Beh
 	return handled;
 }
 
+/** the transfer engine has sent a block of the device-to-host ring: free it and look for more */
+static void USBCDC_DataInComplete(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t length) {
+	const USB_Behaviour_Struct* behaviour = USB_EP_GetBehaviour(device, epIdx);
+	if (!behaviour) return;
+	USBCDC_Behaviour_Struct* cdc = (USBCDC_Behaviour_Struct*)behaviour;
+	RingBufferCommitRead(&(cdc->deviceToHostBuffer), length);
+	//continue from a new endpoint event: it reaches the behaviour's callback, so wrappers like
+	//cdcuart see the progress too, and finds the packet buffers as the hardware has them by then
+	USB_EP_TriggerInterrupt(device, epIdx);
+}
+
 bool USBCDC_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
 	USBCDC_Behaviour_Struct* cdc = (USBCDC_Behaviour_Struct*)behaviour;
 	bool handled = false;
@@ -157,37 +168,69 @@ bool USBCDC_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_S
 		//Interrupt buffer might be free again: accept, don't care
 		handled = true;
 	} else if (epIdx == cdc->dataInEndpoint) {
-		//Device-To-Host endpoint might be free again: check rebuffering
-		bool canWrite = (!USB_EP_GetFull(device, cdc->dataInEndpoint)) && (!USB_EP_GetStall(device, cdc->dataInEndpoint));
-		if (canWrite) {
-			uint16_t transfer = RingBufferReadBuffer(&(cdc->deviceToHostBuffer), tmpBuffer, USB_MAX_BULK_DATA_SIZE);
-			transfer = USB_EP_Write(device, cdc->dataInEndpoint, tmpBuffer, transfer);
+		//Device-To-Host endpoint might be free again (no transfer is running, the engine would get
+		//the event otherwise). Contiguous ring data is queued straight from ring storage and freed
+		//on completion. Only the packet across the ring end is assembled and written here.
+		const RingBufferStatic* ring = &(cdc->deviceToHostBuffer);
+		uint16_t available = USB_EP_GetStall(device, cdc->dataInEndpoint) ? 0 : RingBufferReadBytesAvailable(ring);
+		const uint8_t* block;
+		uint16_t blockLen = RingBufferPeekRead(ring, &block);
+		if (blockLen > available) blockLen = available;
+		if ((blockLen < USB_MAX_BULK_DATA_SIZE) && (blockLen < available)) {
+			//data wraps around the ring end: assemble a full packet instead of sending a short one
+			blockLen = 0;
+			if (USB_EP_GetFreeBuffers(device, cdc->dataInEndpoint) > 0) {
+				uint16_t transfer = RingBufferReadBuffer(ring, tmpBuffer, USB_MAX_BULK_DATA_SIZE);
+				USB_EP_Write(device, cdc->dataInEndpoint, tmpBuffer, transfer);
+				available -= transfer;
+				blockLen = RingBufferPeekRead(ring, &block);
+				if (blockLen > available) blockLen = available;
+			}
+		}
+		//whole packets only if more data follows behind the ring end
+		if (blockLen < available) blockLen &= ~(USB_MAX_BULK_DATA_SIZE - 1);
+		if (blockLen > 0) {
+			//a block that drains the ring ends with a zero length packet if needed, so the host doesn't wait for more
+			USB_EP_SubmitTransfer(device, cdc->dataInEndpoint, (uint8_t*)block, blockLen, blockLen == available, USBCDC_DataInComplete);
 		}
 		handled = true;
 	} else if (epIdx == cdc->dataOutEndpoint) {
-		//HostToDevice endpoint might have data: check rebuffering
-		bool canRead = USB_EP_GetFull(device, cdc->dataOutEndpoint) && (!USB_EP_GetStall(device, cdc->dataOutEndpoint));
-		if (canRead) {
-			uint16_t available = RingBufferWriteBytesAvailable(&(cdc->deviceToHostBuffer));
-/* TODO: Right now, we only accept data from the host if the ring buffer can accept a full bulk block
-Instead, we should query how many bytes are actually available in the endpoint buffer and check if
-the ring buffer can hold that data. The current solution is overflow-safe,
-but might not yield best buffering performance. */
-			if (available >= USB_MAX_BULK_DATA_SIZE) {	
-				uint16_t transfer = USB_EP_Read(device, cdc->dataOutEndpoint, tmpBuffer, USB_MAX_BULK_DATA_SIZE);
-				transfer = RingBufferWriteBuffer(&(cdc->hostToDeviceBuffer), tmpBuffer, transfer);
-				if ((transfer>0) && (cdc->dataAvailableCallback)) cdc->dataAvailableCallback(device, cdc);
+		//HostToDevice endpoint might have data: take every packet that fits into the ring buffer.
+		//Packets that don't fit stay in the endpoint buffer (the host is NAKed meanwhile) until
+		//USBCDC_ReadBytes frees space and triggers us again.
+		bool received = false;
+		bool canRead = !USB_EP_GetStall(device, cdc->dataOutEndpoint);
+		while (canRead && USB_EP_GetFull(device, cdc->dataOutEndpoint)) {
+			uint16_t packetLen = USB_EP_GetReadLength(device, cdc->dataOutEndpoint);
+			if (packetLen > RingBufferWriteBytesAvailable(&(cdc->hostToDeviceBuffer))) break;
+			uint8_t* block;
+			uint16_t blockLen = RingBufferPeekWrite(&(cdc->hostToDeviceBuffer), &block);
+			if (blockLen >= ((packetLen + 3) & ~3)) {
+				//reads are done in words: only read in place if the rounded-up length fits
+				uint16_t transfer = USB_EP_Read(device, cdc->dataOutEndpoint, block, packetLen);
+				RingBufferCommitWrite(&(cdc->hostToDeviceBuffer), transfer);
+			} else {
+				uint16_t transfer = USB_EP_Read(device, cdc->dataOutEndpoint, tmpBuffer, packetLen);
+				RingBufferWriteBuffer(&(cdc->hostToDeviceBuffer), tmpBuffer, transfer);
 			}
+			received = received || (packetLen > 0);
 		}
+		if (received && (cdc->dataAvailableCallback)) cdc->dataAvailableCallback(device, cdc);
 		handled = true;
 	}
 	return handled;
 }
 
+bool USBCDC_InterfaceOwnerHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface) {
+	const USBCDC_Behaviour_Struct* cdc = (const USBCDC_Behaviour_Struct*)behaviour;
+	return (interface == cdc->controlInterface) || (interface == cdc->dataInterface);
+}
 
 void USBCDC_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
-	//we use a config change to reset
-	USBCDC_ResetBehaviour((USBCDC_Behaviour_Struct*)behaviour);
+	//we use a config change to reset. A running transfer points into the ring, drop it first
+	const USBCDC_Behaviour_Struct* cdc = (const USBCDC_Behaviour_Struct*)behaviour;
+	USB_EP_CancelTransfer(device, cdc->dataInEndpoint);
+	USBCDC_ResetBehaviour(cdc);
 }
 
 // Client-initiated activities
@@ -11,7 +11,7 @@
 #include "../everykey/types.h"
 #include "cdcspec.h"
 #include "usb.h"
-#include "ringbuffer.h"
+#include "../everykey/ringbuffer.h"
 
 #pragma mark CDC-specific callbacks
 
@@ -132,13 +132,17 @@ bool USBCDC_EndpointDataHandler(USB_Device_Struct* device,
 void USBCDC_ConfigChangeHandler(USB_Device_Struct* device,
 								const USB_Behaviour_Struct* behaviour);
 
+bool USBCDC_InterfaceOwnerHandler(USB_Device_Struct* device,
+								  const USB_Behaviour_Struct* behaviour, uint8_t interface);
+
 
 #define MAKE_USBCDC_BASE_BEHAVIOUR {\
 	USBCDC_ExtendedControlSetupHandler,\
 	USBCDC_EndpointDataHandler,\
 	NULL,\
 	NULL,\
-	USBCDC_ConfigChangeHandler\
+	USBCDC_ConfigChangeHandler,\
+	USBCDC_InterfaceOwnerHandler\
 }
 
 
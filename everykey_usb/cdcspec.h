@@ -124,6 +124,12 @@ typedef enum USB_CDC_SERIALSTATE_BITS {
 	USB_CDC_SERIALSTATE_RX_CARRIER						= 1 << 0,
 } USB_CDC_SERIALSTATE_BITS;
 
+/** bits of the wValue field of SetControlLineState requests */
+typedef enum USB_CDC_CONTROL_LINE_BITS {
+	USB_CDC_CONTROL_LINE_DTR							= 1 << 0,
+	USB_CDC_CONTROL_LINE_RTS							= 1 << 1
+} USB_CDC_CONTROL_LINE_BITS;
+
 /** data sent to the host via interrupt pipe */
 typedef struct _USB_Setup_Packet USBCDC_Nodata_Notification_Struct;
 
@@ -0,0 +1,108 @@
+#include "cdcuart.h"
+#include "../everykey/nvic.h"
+
+/* UART RX interrupt threshold. A lower value forwards data to USB with less
+ latency, a higher one leaves more hardware FIFO reserve for high baud rates. */
+#define CDCUART_RX_TLVL UART_FCR_RXTLVL8
+
+/* Bytes moved from hostToDeviceBuffer to the UART per TX interrupt at most (hardware FIFO size) */
+#define CDCUART_TX_REFILL 16
+
+/* There's only one UART, so there's only one bridge */
+USB_Device_Struct* cdcuartDevice = NULL;
+const USBCDC_Behaviour_Struct* cdcuartBehaviour = NULL;
+bool cdcuartUseHWFlow = false;
+
+
+/** called from the UART interrupt: forwards progress on the UART side to the USB endpoints */
+static void CDCUART_UARTStatusHandler(UART_Status status) {
+	switch (status) {
+		case UART_STATUS_DATA_AVAILABLE:	//new data in deviceToHostBuffer: send it
+			USB_EP_TriggerInterrupt(cdcuartDevice, cdcuartBehaviour->dataInEndpoint);
+			break;
+		case UART_STATUS_TX_PROGRESS:		//hostToDeviceBuffer has room for a packet again: fetch NAKed ones
+			//a refill frees at most one hardware FIFO's worth, so only the refill crossing the
+			//threshold triggers. Packets arriving later raise their own endpoint interrupt.
+			{
+				uint16_t space = RingBufferWriteBytesAvailable(&(cdcuartBehaviour->hostToDeviceBuffer));
+				if ((space >= USB_MAX_BULK_DATA_SIZE) && (space < USB_MAX_BULK_DATA_SIZE + CDCUART_TX_REFILL)) {
+					USB_EP_TriggerInterrupt(cdcuartDevice, cdcuartBehaviour->dataOutEndpoint);
+				}
+			}
+			break;
+		case UART_STATUS_CAN_SEND_MORE:		//hostToDeviceBuffer drained: fetch NAKed packets
+			USB_EP_TriggerInterrupt(cdcuartDevice, cdcuartBehaviour->dataOutEndpoint);
+			break;
+		default:
+			break;
+	}
+}
+
+/** (re-)initializes the UART with a given line coding and attaches the CDC ring buffers
+ @param lineCoding line coding to apply
+ @return true if the line coding could be applied, false if it is not supported */
+static bool CDCUART_ApplyLineCoding(const USB_CDC_Linecoding_Struct* lineCoding) {
+	UART_Parity parity;
+	switch (lineCoding->bParityType) {
+		case USB_CDC_PARITY_NONE: parity = UART_PARITY_NONE; break;
+		case USB_CDC_PARITY_ODD: parity = UART_PARITY_ODD; break;
+		case USB_CDC_PARITY_EVEN: parity = UART_PARITY_EVEN; break;
+		case USB_CDC_PARITY_MARK: parity = UART_PARITY_ONE; break;
+		case USB_CDC_PARITY_SPACE: parity = UART_PARITY_ZERO; break;
+		default: return false;
+	}
+	if ((lineCoding->bDataBits < 5) || (lineCoding->bDataBits > 8)) return false;
+	if (lineCoding->bCharFormat > USB_CDC_LINECODING_STOP_2) return false;
+	if (lineCoding->dwDTERRate == 0) return false;
+	uint8_t stopBits = (lineCoding->bCharFormat == USB_CDC_LINECODING_STOP_1) ? 1 : 2;
+
+	UART_Init_Ext(lineCoding->dwDTERRate, lineCoding->bDataBits, parity, stopBits,
+				  cdcuartUseHWFlow, CDCUART_UARTStatusHandler, CDCUART_RX_TLVL);
+	UART_SetBuffers(&(cdcuartBehaviour->hostToDeviceBuffer), &(cdcuartBehaviour->deviceToHostBuffer));
+	if (!cdcuartUseHWFlow) UART_SetRTS(*(cdcuartBehaviour->controlLineState) & USB_CDC_CONTROL_LINE_RTS);
+	UART_KickBufferedTx();
+	return true;
+}
+
+void CDCUART_Init(USB_Device_Struct* device, const USBCDC_Behaviour_Struct* cdc, bool useHWFlow) {
+	cdcuartDevice = device;
+	cdcuartBehaviour = cdc;
+	cdcuartUseHWFlow = useHWFlow;
+	CDCUART_ApplyLineCoding(cdc->currentLineCoding);
+}
+
+bool CDCUART_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
+	USBCDC_Behaviour_Struct* cdc = (USBCDC_Behaviour_Struct*)behaviour;
+	bool handled = USBCDC_EndpointDataHandler(device, behaviour, epIdx);
+	//sending to host freed space in deviceToHostBuffer: UART reception may continue
+	if (epIdx == cdc->dataInEndpoint) UART_ResumeBufferedRx();
+	return handled;
+}
+
+void CDCUART_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	//the CDC reset clears the ring buffers - keep the UART interrupt off them meanwhile
+	NVIC_DisableInterrupt(NVIC_UART);
+	USBCDC_ConfigChangeHandler(device, behaviour);
+	//the line coding was reset to default as well: follow with the UART (re-enables its interrupt).
+	//If it's rejected the UART keeps its settings, but it must not stay without its interrupt
+	bool applied = cdcuartBehaviour && CDCUART_ApplyLineCoding(cdcuartBehaviour->currentLineCoding);
+	if (!applied) NVIC_EnableInterrupt(NVIC_UART);
+}
+
+bool CDCUART_LineCodingChangeCallback(USB_Device_Struct* device,
+									  const USBCDC_Behaviour_Struct* behaviour,
+									  const USB_CDC_Linecoding_Struct* newLineCoding) {
+	return CDCUART_ApplyLineCoding(newLineCoding);
+}
+
+bool CDCUART_ControlLineChangeCallback(USB_Device_Struct* device,
+									   const USBCDC_Behaviour_Struct* behaviour) {
+	if (!cdcuartUseHWFlow) UART_SetRTS(*(behaviour->controlLineState) & USB_CDC_CONTROL_LINE_RTS);
+	return true;
+}
+
+bool CDCUART_DataAvailableCallback(USB_Device_Struct* device,
+								   USBCDC_Behaviour_Struct* behaviour) {
+	UART_KickBufferedTx();
+	return true;
+}
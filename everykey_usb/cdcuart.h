@@ -0,0 +1,63 @@
+/** USB CDC to UART bridge. Turns a CDC behaviour into a USB serial adapter for the
+ on-chip UART: Data is moved directly between the CDC ring buffers and the UART
+ hardware FIFOs, without intermediate copies in user code.
+
+ The UART interrupt reads host-to-device data straight from the CDC
+ hostToDeviceBuffer and stores received data straight into the CDC
+ deviceToHostBuffer. Both directions are flow controlled: If the UART cannot
+ keep up, the CDC OUT endpoint NAKs the host. If the host does not fetch data,
+ UART reception is paused and (with hardware flow control) Auto-RTS tells the
+ other side to stop. Line coding changes from the host are applied to the UART
+ immediately, the host's RTS control line is mirrored to the RTS pin if hardware
+ flow control is off.
+
+ To use it, assemble the CDC behaviour with MAKE_CDCUART_BASE_BEHAVIOUR instead of
+ MAKE_USBCDC_BASE_BEHAVIOUR, set the line coding, control line and data available
+ callbacks to the CDCUART_ functions below and call CDCUART_Init after
+ USBCDC_ResetBehaviour and USB_Init. The bridge owns the UART - don't use the UART_ functions
+ besides it. */
+
+#ifndef _CDCUART_
+#define _CDCUART_
+
+#include "../everykey/types.h"
+#include "../everykey/uart.h"
+#include "cdc.h"
+
+/** connects a CDC behaviour to the UART and initializes the UART with the behaviour's current line coding.
+ @param device the USB device
+ @param cdc the CDC behaviour to bridge. Its ring buffers must be initialized (USBCDC_ResetBehaviour).
+ @param useHWFlow true to use hardware flow control (RTS/CTS) on the UART side */
+void CDCUART_Init(USB_Device_Struct* device, const USBCDC_Behaviour_Struct* cdc, bool useHWFlow);
+
+#pragma mark CDC behaviour callbacks for the bridge
+
+bool CDCUART_EndpointDataHandler(USB_Device_Struct* device,
+								 const USB_Behaviour_Struct* behaviour, uint8_t epIdx);
+
+void CDCUART_ConfigChangeHandler(USB_Device_Struct* device,
+								 const USB_Behaviour_Struct* behaviour);
+
+/** lineCodingChangeCallback: reconfigures the UART. Rejects line codings the UART can't do. */
+bool CDCUART_LineCodingChangeCallback(USB_Device_Struct* device,
+									  const USBCDC_Behaviour_Struct* behaviour,
+									  const USB_CDC_Linecoding_Struct* newLineCoding);
+
+/** controlLineChangeCallback: mirrors the host's RTS to the RTS pin */
+bool CDCUART_ControlLineChangeCallback(USB_Device_Struct* device,
+									   const USBCDC_Behaviour_Struct* behaviour);
+
+/** dataAvailableCallback: starts UART transmission of new host data */
+bool CDCUART_DataAvailableCallback(USB_Device_Struct* device,
+								   USBCDC_Behaviour_Struct* behaviour);
+
+#define MAKE_CDCUART_BASE_BEHAVIOUR {\
+	USBCDC_ExtendedControlSetupHandler,\
+	CDCUART_EndpointDataHandler,\
+	NULL,\
+	NULL,\
+	CDCUART_ConfigChangeHandler,\
+	USBCDC_InterfaceOwnerHandler\
+}
+
+#endif
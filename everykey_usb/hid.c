@@ -118,6 +118,12 @@ bool USBHID_ExtendedControlSetupHandler(USB_Device_Struct* device, const USB_Beh
 bool USBHID_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
 	//TODO: Check against our endpoint ************
 	//Right now, we do nothing, just accept and ignore everything
+	return true;
+}
+
+bool USBHID_InterfaceOwnerHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface) {
+	const USBHID_Behaviour_Struct* hid = (const USBHID_Behaviour_Struct*)behaviour;
+	return interface == hid->interfaceNumber;
 }
 
 /** we use this callback to reset our protocol and idle values */
@@ -131,9 +137,10 @@ void USBHID_PushReport(USB_Device_Struct* device,
 					   const USBHID_Behaviour_Struct* hid,
 					   USB_HID_REPORTTYPE reportType,
 					   uint8_t reportId) {
-	if ((hid->inReportHandler) && (hid->inBuffer)) {
-		uint16_t len = (hid->inReportHandler)(device, hid, reportType, reportId);
-		USB_EP_Write(device, 3, hid->inBuffer, len);
-	}
+	if (!((hid->inReportHandler) && (hid->inBuffer))) return;
+	if (USB_EP_TransferActive(device, USBHID_IN_ENDPOINT)) return;	//last report not sent yet, don't touch inBuffer
+	uint16_t len = (hid->inReportHandler)(device, hid, reportType, reportId);
+	//reports have a fixed size known to the host, so no zero length packet after a 64 byte one
+	USB_EP_SubmitTransfer(device, USBHID_IN_ENDPOINT, hid->inBuffer, len, false, NULL);
 }
 
@@ -53,9 +53,12 @@ struct _USBHID_Behaviour_Struct {
 	uint8_t* currentProtocol;
 };
 
-/** may be called to push an IN report when inputs have changed. Will
- *  trigger the in report handler in the near
- *  future.
+/** physical endpoint of the interrupt IN pipe (logical endpoint 1, address 0x81) */
+#define USBHID_IN_ENDPOINT 3
+
+/** may be called to push an IN report when inputs have changed. Calls
+ *  the in report handler and queues the report, the USB interrupt sends
+ *  it. Does nothing while the previous report is still queued.
  *  @param device USB device to use @param behaviour behaviour to use
  *  @param reportType @param reportId report ID */
 
@@ -76,12 +79,15 @@ bool USBHID_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_S
 
 void USBHID_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour);
 
+bool USBHID_InterfaceOwnerHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface);
+
 #define MAKE_USBHID_BASE_BEHAVIOUR {\
 	USBHID_ExtendedControlSetupHandler,\
 	USBHID_EndpointDataHandler,\
 	NULL,\
 	NULL,\
-	USBHID_ConfigChangeHandler\
+	USBHID_ConfigChangeHandler,\
+	USBHID_InterfaceOwnerHandler\
 }
 
 
@@ -12,6 +12,7 @@ bool USBMIDI_EnqueueBlock(USB_Device_Struct* device, const USBMIDI_Behaviour_Str
 	behaviour->cmdFifo[wrIdx+2] = block[2];
 	behaviour->cmdFifo[wrIdx+3] = block[3];
 	*(behaviour->cmdFifoWrIdx) = nextWrIdx;
+	USB_RequestFrameTicks(device, &(behaviour->baseBehaviour));	//send it with the next frame
 	return true;
 }
 
@@ -163,6 +164,7 @@ void USBMIDI_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_
 	const USBMIDI_Behaviour_Struct* midi = (const USBMIDI_Behaviour_Struct*)behaviour;
 	*(midi->cmdFifoRdIdx) = 0;
 	*(midi->cmdFifoWrIdx) = 0;
+	USB_ReleaseFrameTicks(device, behaviour);
 }
 
 void USBMIDI_FrameHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
@@ -171,22 +173,25 @@ void USBMIDI_FrameHandler(USB_Device_Struct* device, const USB_Behaviour_Struct*
 
 void USBMIDI_Send(USB_Device_Struct* device, const USBMIDI_Behaviour_Struct* midi) {
 	if (!(device->currentConfiguration)) return;	//Don't send anything in zero config
-	if (USB_EP_GetFull(device, midi->inDataEndpoint)) return;
-	uint16_t written = 0;
-
-	while ((written < USB_MAX_BULK_DATA_SIZE) && (*(midi->cmdFifoRdIdx) != *(midi->cmdFifoWrIdx))) {
-		uint16_t rdIdx = *(midi->cmdFifoRdIdx);
-		midi->inBuffer[written] = midi->cmdFifo[rdIdx];
-		midi->inBuffer[written+1] = midi->cmdFifo[rdIdx+1];
-		midi->inBuffer[written+2] = midi->cmdFifo[rdIdx+2];
-		midi->inBuffer[written+3] = midi->cmdFifo[rdIdx+3];
-		written += 4;
-		*(midi->cmdFifoRdIdx) = (rdIdx + 4) % midi->cmdFifoSize;
-	}
-	if (written > 0) {
+	uint8_t freeBuffers = USB_EP_GetFreeBuffers(device, midi->inDataEndpoint);
+
+	while ((freeBuffers > 0) && (*(midi->cmdFifoRdIdx) != *(midi->cmdFifoWrIdx))) {
+		uint16_t written = 0;
+		while ((written < USB_MAX_BULK_DATA_SIZE) && (*(midi->cmdFifoRdIdx) != *(midi->cmdFifoWrIdx))) {
+			uint16_t rdIdx = *(midi->cmdFifoRdIdx);
+			midi->inBuffer[written] = midi->cmdFifo[rdIdx];
+			midi->inBuffer[written+1] = midi->cmdFifo[rdIdx+1];
+			midi->inBuffer[written+2] = midi->cmdFifo[rdIdx+2];
+			midi->inBuffer[written+3] = midi->cmdFifo[rdIdx+3];
+			written += 4;
+			*(midi->cmdFifoRdIdx) = (rdIdx + 4) % midi->cmdFifoSize;
+		}
 		USB_EP_Write(device, midi->inDataEndpoint, midi->inBuffer, written);
 		//TODO: What to do if not all data could be written? Right now, we assume everything works fine ********************
+		freeBuffers--;
 	}
+	//nothing left to send: we don't need frame ticks until the next block is queued
+	if (*(midi->cmdFifoRdIdx) == *(midi->cmdFifoWrIdx)) USB_ReleaseFrameTicks(device, &(midi->baseBehaviour));
 
 
 }
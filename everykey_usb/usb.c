@@ -106,6 +106,15 @@ void USB_SIE_ValidateBuffer(USB_Device_Struct* device, uint8_t epIdx) {
 
 #pragma mark Endpoint functions
 
+/** derives the number of empty packet buffers from a SelectEndpoint status byte */
+static uint8_t USB_EP_FreeBuffersFromStatus(uint8_t epIdx, uint8_t epStat) {
+	if (USB_EP_GetBufferCount(epIdx) == 2) {
+		return 2 - ((epStat & USB_SELEP_B1FULL) ? 1 : 0) - ((epStat & USB_SELEP_B2FULL) ? 1 : 0);
+	} else {
+		return (epStat & USB_SELEP_B1FULL) ? 0 : 1;
+	}
+}
+
 uint32_t USB_EP_Read(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t maxLen) {
 	if (!USB_EP_GetFull(device,epIdx)) return 0;				//cannot read - all buffers empty
 	uint8_t logEpIdx = epIdx >> 1;
@@ -129,9 +138,22 @@ uint32_t USB_EP_Read(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer,
 	return readBytes;
 }
 
+uint32_t USB_EP_GetReadLength(USB_Device_Struct* device, uint8_t epIdx) {
+	if (!USB_EP_GetFull(device,epIdx)) return 0;				//no packet
+	uint8_t logEpIdx = epIdx >> 1;
+	USB->CTRL = USB_CTRL_LOG_EP * logEpIdx + USB_CTRL_RD_EN;	//we want to read the number of bytes available
+	NOP;					//wait a bit to get len
+	NOP;
+	NOP;
+	uint32_t readBytes = USB->RXPLEN;
+	USB->CTRL = 0;												//disable read again, buffer stays full
+	return (readBytes & USB_RXPLEN_DV) ? (readBytes & USB_RXPLEN_LENGTH_MASK) : 0;
+}
+
 uint32_t USB_EP_Write(USB_Device_Struct* device, uint8_t epIdx, const uint8_t* buffer, uint32_t length) {
-	if (USB_EP_GetFull(device, epIdx)) return 0;					//cannot write - all buffers full
-	if (USB_EP_GetStall(device, epIdx)) return length;					//EP is stalled: Do not write but flush output
+	uint8_t epStat = USB_SIE_SelectEndpoint(device, epIdx);		//one SIE read for both stall and buffer state
+	if (epStat & USB_SELEP_ST) return length;					//EP is stalled: Do not write but flush output
+	if (USB_EP_FreeBuffersFromStatus(epIdx, epStat) == 0) return 0;	//cannot write - all buffers full
 	uint8_t logEpIdx = epIdx >> 1;
 	USB->CTRL = USB_CTRL_LOG_EP * logEpIdx + USB_CTRL_WR_EN;	//enable writing for this ep
 	NOP;					//wait a bit, just to be safe
@@ -168,14 +190,83 @@ bool USB_EP_GetFull(USB_Device_Struct* device, uint8_t epIdx) {
 	return (epStat & USB_SELEP_FE) ? true : false;
 }
 
+uint8_t USB_EP_GetBufferCount(uint8_t epIdx) {
+	return ((epIdx >> 1) == USB_DOUBLE_BUFFERED_LOGICAL_EP) ? 2 : 1;
+}
+
+uint8_t USB_EP_GetFreeBuffers(USB_Device_Struct* device, uint8_t epIdx) {
+	uint8_t epStat = USB_SIE_SelectEndpoint(device, epIdx);
+	return USB_EP_FreeBuffersFromStatus(epIdx, epStat);
+}
+
 void USB_EP_TriggerInterrupt(USB_Device_Struct* device, uint8_t epIdx) {
 	USB->DEVINTSET = 2 << epIdx;
 	NVIC_SetInterruptPending(NVIC_USBIRQ);
 }
 
+bool USB_EP_SubmitTransfer(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t length, bool terminate, USBTransferCompletionCallback callback) {
+	if ((epIdx < 2) || (epIdx >= USB_MAX_TRANSFER_ENDPOINTS)) return false;	//control and isochronous endpoints are not supported
+	USB_Transfer_Struct* transfer = &(device->transfers[epIdx]);
+	if (transfer->active) return false;
+	transfer->buffer = buffer;
+	transfer->length = length;
+	transfer->done = 0;
+	transfer->callback = callback;
+	transfer->zlpPending = terminate && (epIdx & 1) && ((length % USB_MAX_BULK_DATA_SIZE) == 0);
+	transfer->used = true;
+	transfer->active = true;
+	USB_EP_TriggerInterrupt(device, epIdx);		//kick it off from interrupt context
+	return true;
+}
+
+bool USB_EP_TransferActive(USB_Device_Struct* device, uint8_t epIdx) {
+	if (epIdx >= USB_MAX_TRANSFER_ENDPOINTS) return false;
+	return device->transfers[epIdx].active;
+}
+
+void USB_EP_CancelTransfer(USB_Device_Struct* device, uint8_t epIdx) {
+	if (epIdx >= USB_MAX_TRANSFER_ENDPOINTS) return;
+	device->transfers[epIdx].active = false;
+}
+
+const USB_Behaviour_Struct* USB_EP_GetBehaviour(USB_Device_Struct* device, uint8_t epIdx) {
+	if (epIdx >= USB_MAX_TRANSFER_ENDPOINTS) return NULL;
+	uint8_t owner = device->endpointBehaviours[epIdx];
+	if (owner >= device->deviceDefinition->behaviourCount) return NULL;
+	return device->deviceDefinition->behaviours[owner];
+}
+
+/** returns the bit of a behaviour in frameTickRequests, 0 if the behaviour is not attached */
+static uint8_t USB_BehaviourMask(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	uint8_t i;
+	for (i=0; i<device->deviceDefinition->behaviourCount; i++) {
+		if (device->deviceDefinition->behaviours[i] == behaviour) return 1 << i;
+	}
+	return 0;
+}
+
+static void USB_SetFrameTickRequest(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, bool request) {
+	uint8_t mask = USB_BehaviourMask(device, behaviour);
+	bool requested = (device->frameTickRequests & mask) ? true : false;
+	if ((mask == 0) || (requested == request)) return;	//nothing to do - avoids touching interrupts in the common case
+	uint32_t primask = saveAndDisableInterrupts();		//may be called with interrupts off, e.g. from a critical section
+	if (request) device->frameTickRequests |= mask;
+	else device->frameTickRequests &= ~mask;
+	if (device->frameTickRequests) USB->DEVINTEN |= USB_DEVINT_FRAME;
+	else USB->DEVINTEN &= ~USB_DEVINT_FRAME;
+	restoreInterrupts(primask);
+}
+
+void USB_RequestFrameTicks(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	USB_SetFrameTickRequest(device, behaviour, true);
+}
+
+void USB_ReleaseFrameTicks(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	USB_SetFrameTickRequest(device, behaviour, false);
+}
 
 uint8_t USB_EP_LogicalToPhysicalIndex(uint8_t index) {
-	return ((index & 0x0f) < 1) | (index & 0x80 >> 7);
+	return ((index & 0x0f) << 1) | ((index & 0x80) >> 7);
 }
 
 
@@ -196,6 +287,12 @@ void USB_Reset(USB_Device_Struct* device) {
 	device->newAddress = 0;
 	int i;
 	for (i=0; i<USB_MAX_INTERFACES_PER_DEVICE; i++) device->interfaceAltSetting[i] = 0;
+	for (i=0; i<USB_MAX_TRANSFER_ENDPOINTS; i++) {
+		device->transfers[i].active = false;
+		device->transfers[i].used = false;
+		device->endpointBehaviours[i] = USB_EP_BEHAVIOUR_INVALID;
+	}
+	device->frameTickRequests = 0;
 	USB_SIE_SetAddress(device, 0, true);
 
 	//start up interrupts again
@@ -208,8 +305,7 @@ void USB_Reset(USB_Device_Struct* device) {
 		USB_DEVINT_EP5 |
 		USB_DEVINT_EP6 |
 		USB_DEVINT_EP7 |
-		USB_DEVINT_FRAME | 
-		USB_DEVINT_DEV_STAT;				//enable EP interrupts + status change + frame
+		USB_DEVINT_DEV_STAT;				//enable EP interrupts + status change. Frame is enabled on demand.
 }
 
 void USB_Suspend(USB_Device_Struct* device) {
@@ -351,6 +447,49 @@ bool USB_HandleGetConfiguration(USB_Device_Struct* device) {
 	return true;
 }
 
+/** returns the index of the behaviour that claims an interface, USB_EP_BEHAVIOUR_UNKNOWN if none does */
+static uint8_t USB_InterfaceOwner(USB_Device_Struct* device, uint8_t interface) {
+	uint8_t i;
+	for (i=0; i<device->deviceDefinition->behaviourCount; i++) {
+		const USB_Behaviour_Struct* behaviour = device->deviceDefinition->behaviours[i];
+		USBInterfaceOwnerCallback cb = behaviour->interfaceOwnerCallback;
+		if (cb && cb(device, behaviour, interface)) return i;
+	}
+	return USB_EP_BEHAVIOUR_UNKNOWN;
+}
+
+/** rebuilds the endpoint-to-behaviour dispatch table for a configuration value: endpoints
+ inherit the owner of the interface they are declared in, endpoints of unclaimed interfaces are
+ marked as unknown (their owner is looked up on first use), all others as invalid. */
+void USB_BuildEndpointTable(USB_Device_Struct* device, uint8_t configuration) {
+	uint8_t i;
+	for (i=0; i<USB_MAX_TRANSFER_ENDPOINTS; i++) device->endpointBehaviours[i] = USB_EP_BEHAVIOUR_INVALID;
+	if (configuration == 0) return;
+	const uint8_t* config = NULL;
+	for (i=0; i<device->deviceDefinition->configurationCount; i++) {
+		const uint8_t* desc = device->deviceDefinition->configurationDescriptors[i];
+		if (desc[5] == configuration) {	//bConfigurationValue
+			config = desc;
+			break;
+		}
+	}
+	if (!config) return;
+	uint16_t totalLen = (config[3] << 8) | config[2];
+	uint16_t offset = 0;
+	uint8_t owner = USB_EP_BEHAVIOUR_UNKNOWN;
+	while (offset + 2 <= totalLen) {
+		const uint8_t* desc = config + offset;
+		if (desc[0] == 0) break;		//malformed, avoid looping forever
+		if ((desc[1] == USB_DESC_INTERFACE) && (desc[0] >= 9)) {
+			owner = USB_InterfaceOwner(device, desc[2]);	//bInterfaceNumber
+		} else if ((desc[1] == USB_DESC_ENDPOINT) && (desc[0] >= 7)) {
+			uint8_t epIdx = USB_EP_LogicalToPhysicalIndex(desc[2]);
+			if (epIdx < USB_MAX_TRANSFER_ENDPOINTS) device->endpointBehaviours[epIdx] = owner;
+		}
+		offset += desc[0];
+	}
+}
+
 bool USB_HandleSetConfiguration(USB_Device_Struct* device) {
 	if (device->currentCommand.wIndexL != 0) return false;
 	if (device->currentCommand.wIndexH != 0) return false;
@@ -359,6 +498,7 @@ bool USB_HandleSetConfiguration(USB_Device_Struct* device) {
 	if ((device->currentCommand.bmRequestType & USB_RT_RECIPIENT_MASK) != USB_RT_RECIPIENT_DEVICE) return false;
 	device->currentConfiguration = device->currentCommand.wValueL;
 	USB_SIE_ConfigureDevice(device, device->currentConfiguration != 0);
+	USB_BuildEndpointTable(device, device->currentConfiguration);
 
 	uint8_t i;
 	for (i=0; i<device->deviceDefinition->behaviourCount; i++) {
@@ -474,6 +614,11 @@ void USB_Control_HandleSetup(USB_Device_Struct* device) {
 		if (cb) handled = (*cb)(device, behaviour);
 		if (handled) break;	
 	}
+	if (handled && (device->currentCommand.bRequest == USB_REQ_SET_CONFIGURATION) &&
+		((device->currentCommand.bmRequestType & USB_RT_TYPE_MASK) == USB_RT_TYPE_STANDARD)) {
+		//a behaviour took over SET_CONFIGURATION - endpoints still have to be dispatched for the new one
+		USB_BuildEndpointTable(device, device->currentCommand.wValueL);
+	}
 	if (!handled) {
 		switch (device->currentCommand.bRequest) {
 			case USB_REQ_GET_STATUS:
@@ -547,18 +692,64 @@ void USB_Control_HandleIn(USB_Device_Struct* device) {
 }
 
 
+/** Advance a queued multi-packet transfer: fill free IN buffers or drain full OUT buffers.
+ Calls the completion callback when done. */
+void USB_HandleTransfer(USB_Device_Struct* device, uint8_t epIdx) {
+	USB_Transfer_Struct* transfer = &(device->transfers[epIdx]);
+	bool complete = false;
+	if (epIdx & 1) {		//IN: device to host
+		uint8_t freeBuffers = USB_EP_GetFreeBuffers(device, epIdx);
+		while ((freeBuffers > 0) && !complete) {
+			uint32_t remaining = transfer->length - transfer->done;
+			if (remaining > 0) {
+				transfer->done += USB_EP_Write(device, epIdx, transfer->buffer + transfer->done, remaining);
+			} else if (transfer->zlpPending) {
+				USB_EP_Write(device, epIdx, NULL, 0);
+				transfer->zlpPending = false;
+			}
+			complete = (transfer->done >= transfer->length) && (!transfer->zlpPending);
+			freeBuffers--;
+		}
+	} else {				//OUT: host to device
+		while ((!complete) && USB_EP_GetFull(device, epIdx)) {
+			uint32_t read = USB_EP_Read(device, epIdx, transfer->buffer + transfer->done, transfer->length - transfer->done);
+			transfer->done += read;
+			complete = (read < USB_MAX_BULK_DATA_SIZE) || (transfer->done >= transfer->length);
+		}
+	}
+	if (complete) {
+		transfer->active = false;	//clear first so the callback may submit the next transfer
+		if (transfer->callback) transfer->callback(device, epIdx, transfer->buffer, transfer->done);
+	}
+}
+
 /** Handle data on a non-control endpoint (in data available or out data sent) */
 void USB_HandleData(USB_Device_Struct* device, int epIdx) {
+	if (device->transfers[epIdx].active) {
+		USB_HandleTransfer(device, epIdx);
+		return;
+	}
+	uint8_t owner = device->endpointBehaviours[epIdx];
+	if (owner < device->deviceDefinition->behaviourCount) {
+		//fast path: one indexed call to the behaviour owning this endpoint
+		const USB_Behaviour_Struct* behaviour = device->deviceDefinition->behaviours[owner];
+		USBEndpointDataCallback cb = behaviour->endpointDataCallback;
+		if (cb && cb(device, behaviour, epIdx)) return;
+	}
+	//owner unknown or refused, or endpoint not in the configuration: offer to all (other) behaviours
 	uint8_t i;
 	for (i=0; i<device->deviceDefinition->behaviourCount; i++) {
+		if (i == owner) continue;
 		const USB_Behaviour_Struct* behaviour = device->deviceDefinition->behaviours[i];
 		USBEndpointDataCallback cb = behaviour->endpointDataCallback;
-		if (cb && cb(device, behaviour, epIdx)) break;
-	}
-	if (i >= device->deviceDefinition->behaviourCount) {
-		//No behaviour handled this data message - stall endpoint
-		USB_EP_SetStall(device, epIdx, true);
+		if (cb && cb(device, behaviour, epIdx)) {
+			if (owner != USB_EP_BEHAVIOUR_INVALID) device->endpointBehaviours[epIdx] = i;	//remember who takes it
+			return;
+		}
 	}
+	//No behaviour handled this data message - stall endpoint unless the transfer engine owns it
+	if (device->transfers[epIdx].used) return;
+	USB_EP_SetStall(device, epIdx, true);
 }
 
 /** this function is added to the interrupt vector table - see startup.c */
@@ -578,34 +769,35 @@ void usb_irq_handler(void) {
 		}
 	}
 
-	//Check frame interrupt
+	//Check frame interrupt, only call behaviours that requested frame ticks
 	if (interruptMask & USB_DEVINT_FRAME) {
-		uint8_t i;
-		for (i=0; i<device->deviceDefinition->behaviourCount; i++) {
+		uint8_t requests = device->frameTickRequests;
+		while (requests) {
+			uint8_t i = __builtin_ctz(requests);
+			requests &= requests - 1;
 			const USB_Behaviour_Struct* behaviour = device->deviceDefinition->behaviours[i];
 			USBFrameCallback cb = behaviour->frameCallback;
 			if (cb) cb(device, behaviour);
 		}
 	}
 
-	//Check endpoint interrupts
-	int epIdx;
-	for (epIdx = 0; epIdx < 8; epIdx++) {
-		uint32_t epIntMask = 2 << epIdx;
-		if (interruptMask & epIntMask) {
-			uint8_t epStat = USB_SIE_SelectEndpointClearInterrupt(device, epIdx);	//Clear interrupt in SIE
-			switch (epIdx) {
-				case 0:
-					if (epStat & USB_SELEP_STP) USB_Control_HandleSetup(device);
-					else USB_Control_HandleOut(device);
-					break;
-				case 1:
-					USB_Control_HandleIn(device);
-					break;
-				default:
-					USB_HandleData(device, epIdx);
-					break;
-			}
+	//Check endpoint interrupts: only visit pending ones, lowest endpoint first (CTZ compiles to RBIT + CLZ)
+	uint32_t epPending = (interruptMask >> 1) & 0xff;
+	while (epPending) {
+		int epIdx = __builtin_ctz(epPending);
+		epPending &= epPending - 1;
+		uint8_t epStat = USB_SIE_SelectEndpointClearInterrupt(device, epIdx);	//Clear interrupt in SIE
+		switch (epIdx) {
+			case 0:
+				if (epStat & USB_SELEP_STP) USB_Control_HandleSetup(device);
+				else USB_Control_HandleOut(device);
+				break;
+			case 1:
+				USB_Control_HandleIn(device);
+				break;
+			default:
+				USB_HandleData(device, epIdx);
+				break;
 		}
 	}
 
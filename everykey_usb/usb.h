@@ -26,6 +26,18 @@
 #define USB_MAX_COMMAND_DATA_SIZE 64
 
 #define USB_MAX_BULK_DATA_SIZE 64
+
+/** the LPC1343 has two packet buffers on logical endpoint 3 (physical 6 and 7), all other
+ * non-isochronous endpoints have one. Put high-throughput bulk pipes there so that the host
+ * can transfer one packet while the other one is being processed. */
+#define USB_DOUBLE_BUFFERED_LOGICAL_EP 3
+
+/** number of physical non-isochronous endpoints (transfer engine slots are indexed by them) */
+#define USB_MAX_TRANSFER_ENDPOINTS 8
+
+/** special values of the endpoint-to-behaviour dispatch table */
+#define USB_EP_BEHAVIOUR_UNKNOWN 0xfe	//endpoint is configured, owner not known yet
+#define USB_EP_BEHAVIOUR_INVALID 0xff	//endpoint is not part of the current configuration
 #define USB_MAX_ISOCH_DATA_SIZE 512
 
 #pragma mark Function prototypes
@@ -70,7 +82,9 @@ typedef	bool (*USBEndpointDataCallback)(USB_Device_Struct* device, const USB_Beh
 /** Set `frameCallback` to be notified on every USB frame. This callback
  *  is mainly useful for isochronous endpoints - data flow on isochronous
  *  pipes is not notified by `endpointDataCallback`.  Instead, they must be
- *  read and written each frame. */
+ *  read and written each frame. The frame interrupt is only armed while
+ *  behaviours need it: call `USB_RequestFrameTicks()` to start and
+ *  `USB_ReleaseFrameTicks()` to stop receiving frame callbacks. */
 
 typedef void (*USBFrameCallback)(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour);
 
@@ -92,6 +106,28 @@ typedef bool (*USBInterfaceAltCallback)(USB_Device_Struct* device, const USB_Beh
 typedef void (*USBConfigChangeCallback)(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour);
 
 
+/** Set `interfaceOwnerCallback` to tell the stack which interfaces a
+ *  behaviour implements. It is asked for every interface descriptor of a
+ *  new configuration, the endpoints of claimed interfaces are then routed
+ *  straight to the behaviour. Return true if `interface` belongs to the
+ *  behaviour. */
+
+typedef bool (*USBInterfaceOwnerCallback)(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface);
+
+
+/** Completion callback for transfers queued with `USB_EP_SubmitTransfer()`.
+ *  Called from the USB interrupt once the whole buffer was handed to the
+ *  hardware (IN) or filled / terminated by a short packet (OUT). The
+ *  buffer may be reused or a new transfer may be submitted from within
+ *  the callback.
+ *  @param device the usb device
+ *  @param epIdx physical endpoint index
+ *  @param buffer the transfer buffer
+ *  @param length number of bytes actually transferred */
+
+typedef void (*USBTransferCompletionCallback)(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t length);
+
+
 /** temporary callback for setup packet handlers - used in order to be called
  *  back after the data stage of an OUT CONTROL transfer */
 
@@ -133,13 +169,16 @@ struct _USB_Behaviour_Struct {
 	 *  method, trigger other activities if necessary and return `true`.
 	 *  Setting to NULL will act as always returning `false`. The message
 	 *  is passed to all registered behaviours until one of them returns
-	 *  `true`.  If none of them handles this message, the endpoint will
-	 *  stall. */
+	 *  `true`. That behaviour is remembered as the endpoint's owner and
+	 *  receives later messages for it directly (see also
+	 *  `interfaceOwnerCallback`).  If none of them handles this message,
+	 *  the endpoint will stall. */
 
 	USBEndpointDataCallback endpointDataCallback;
 
 
-	/** callback invoked each USB frame - set to NULL if not used */
+	/** callback invoked each USB frame while requested via
+	 *  `USB_RequestFrameTicks()` - set to NULL if not used */
 
 	USBFrameCallback frameCallback;
 
@@ -154,10 +193,48 @@ struct _USB_Behaviour_Struct {
 	 *  used */
 
 	USBConfigChangeCallback configChangeCallback;
+
+
+	/** callback asked which interfaces belong to this behaviour - may
+	 *  be NULL (or left out of initializers), the owner of its endpoints
+	 *  is then found on first use */
+
+	USBInterfaceOwnerCallback interfaceOwnerCallback;
 	
 };
 
 
+/** Runtime state of a multi-packet transfer on one endpoint. Part of the
+ *  device struct, managed by `USB_EP_SubmitTransfer()` and the interrupt
+ *  handler - there's no need to touch it directly. */
+
+typedef struct _USB_Transfer_Struct {
+
+	/** transfer buffer */
+	uint8_t* buffer;
+
+	/** total number of bytes to transfer */
+	uint32_t length;
+
+	/** number of bytes transferred so far */
+	uint32_t done;
+
+	/** called once when the transfer has completed, may be NULL */
+	USBTransferCompletionCallback callback;
+
+	/** true while the transfer is queued. Set last on submit, so the interrupt never sees partial state */
+	volatile bool active;
+
+	/** IN transfers only: a zero length packet still needs to be sent to terminate the transfer */
+	bool zlpPending;
+
+	/** endpoint was used by the transfer engine since the last bus reset. Data events without
+	 *  an active transfer and without a handling behaviour are ignored instead of stalling. */
+	bool used;
+
+} USB_Transfer_Struct;
+
+
 /** A structure describing the static properties of a USB device. May be
  * in RAM or Flash, if initialized at compile-time.  Must be initialized
  * before passing it to `USB_Init`. */
@@ -240,6 +317,18 @@ struct _USB_Device_Struct {
 
 	/** address set by host */
 	uint8_t newAddress;
+
+	/** multi-packet transfer state, indexed by physical endpoint */
+	USB_Transfer_Struct transfers[USB_MAX_TRANSFER_ENDPOINTS];
+
+	/** endpoint-to-behaviour dispatch table, indexed by physical endpoint. Contains the index of
+	 *  the behaviour handling an endpoint or one of the USB_EP_BEHAVIOUR_* values. Rebuilt from the
+	 *  configuration descriptor on every SET_CONFIGURATION: endpoints of interfaces claimed via
+	 *  `interfaceOwnerCallback` get their owner right away, the others on first use. */
+	uint8_t endpointBehaviours[USB_MAX_TRANSFER_ENDPOINTS];
+
+	/** bitmask of behaviours (by index) that currently want frame callbacks */
+	volatile uint8_t frameTickRequests;
 		
 };
 
@@ -254,11 +343,18 @@ struct _USB_Device_Struct {
  * @return number of bytes actually read */
 uint32_t USB_EP_Read(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t length);
 
+/** returns the length of the next packet waiting in an endpoint without consuming it
+ * @param device device to check
+ * @param epIdx physical endpoint index (must be OUT)
+ * @return number of bytes in the next packet, 0 if there's none (or it is empty) */
+uint32_t USB_EP_GetReadLength(USB_Device_Struct* device, uint8_t epIdx);
+
 /** writes to an endpoint
  * @param device device to check 
  * @param epIdx physical endpoint index (must be IN)
  * @param buffer write buffer (must not be null if length > 0)
- * @param length max length to write
+ * @param length max length to write. At most one packet is written per call - call
+ *        again while `USB_EP_GetFreeBuffers()` is nonzero to fill double buffers.
  * @return number of bytes actually written */
 uint32_t USB_EP_Write(USB_Device_Struct* device, uint8_t epIdx, const uint8_t* buffer, uint32_t length);
 
@@ -280,11 +376,68 @@ bool USB_EP_GetStall(USB_Device_Struct* device, uint8_t epIdx);
  * @return for IN endpoints, false if at least least one buffer is empty, for OUT endpoints, true if at least one buffer is full */
 bool USB_EP_GetFull(USB_Device_Struct* device, uint8_t epIdx);
 
+/** returns the number of packet buffers of an endpoint
+ * @param epIdx physical endpoint index (0..7)
+ * @return 2 for double-buffered endpoints, 1 otherwise */
+uint8_t USB_EP_GetBufferCount(uint8_t epIdx);
+
+/** returns the number of empty packet buffers of an endpoint. For IN endpoints, this is the
+ * number of packets that may be written via `USB_EP_Write()` right now.
+ * @param device device to check
+ * @param epIdx physical endpoint index (0..7)
+ * @return number of empty buffers (0..USB_EP_GetBufferCount(epIdx)) */
+uint8_t USB_EP_GetFreeBuffers(USB_Device_Struct* device, uint8_t epIdx);
+
 /** triggers an interrupt for a given Endpoint. Useful for triggering reads/writes from main code
  * @param device device to use
  * @param epIdx physical endpoint index */
 void USB_EP_TriggerInterrupt(USB_Device_Struct* device, uint8_t epIdx);
 
+/** queues a buffer of any length on a bulk or interrupt endpoint. The interrupt handler splits
+ * it into max-packet chunks and calls back once at completion. While a transfer is active on an
+ * endpoint, its data events are not passed to the behaviours' `endpointDataCallback`.
+ * @param device device to use
+ * @param epIdx physical endpoint index (2..7)
+ * @param buffer data to send (IN) or space to receive (OUT). Must stay valid until completion.
+ *        OUT reads are done in words - leave room for the length rounded up to a multiple of 4.
+ * @param length number of bytes to send or max number of bytes to receive. OUT transfers also end
+ *        on a short packet. An OUT packet that doesn't fit into the remaining space is truncated.
+ * @param terminate IN only: end the transfer with a zero length packet if length is a multiple
+ *        of the packet size, so that the host sees where it ends. Pass false for reports of a
+ *        fixed size and for streams that go on with the next transfer.
+ * @param callback completion callback, may be NULL
+ * @return true if the transfer was queued, false if the endpoint is invalid or already busy */
+bool USB_EP_SubmitTransfer(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t length, bool terminate, USBTransferCompletionCallback callback);
+
+/** returns whether a transfer queued with `USB_EP_SubmitTransfer()` is still running
+ * @param device device to check
+ * @param epIdx physical endpoint index
+ * @return true if a transfer is active, false otherwise */
+bool USB_EP_TransferActive(USB_Device_Struct* device, uint8_t epIdx);
+
+/** aborts a transfer queued with `USB_EP_SubmitTransfer()` without calling its completion callback.
+ * Packets already handed to the hardware are not recalled.
+ * @param device device to use
+ * @param epIdx physical endpoint index */
+void USB_EP_CancelTransfer(USB_Device_Struct* device, uint8_t epIdx);
+
+/** returns the behaviour owning an endpoint, e.g. to find it from a transfer completion callback
+ * @param device device to check
+ * @param epIdx physical endpoint index
+ * @return the behaviour handling the endpoint's data events or NULL if not known (yet) */
+const USB_Behaviour_Struct* USB_EP_GetBehaviour(USB_Device_Struct* device, uint8_t epIdx);
+
+/** requests frame callbacks (every 1ms) for a behaviour. The frame interrupt is enabled while at
+ * least one behaviour requested it. Requesting multiple times is ok, there's no counting.
+ * @param device device to use
+ * @param behaviour behaviour that wants its `frameCallback` to be called */
+void USB_RequestFrameTicks(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour);
+
+/** stops frame callbacks for a behaviour. The frame interrupt is disabled once no behaviour needs it.
+ * @param device device to use
+ * @param behaviour behaviour that doesn't need frame callbacks any more */
+void USB_ReleaseFrameTicks(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour);
+
 /** converts usb endpoint indexes (dir at bit 7) to native indexes (dir at bit 0)
  @param index usb endpoint index
  @return physical endpoint index (0..7) - DON'T USE FOR ISOCH ENDPOINTS! */
@@ -105,21 +105,36 @@ void USBAudio_FrameHandler(USB_Device_Struct* device, const USB_Behaviour_Struct
 	if (audio->frameCallback) (audio->frameCallback)(device,audio);
 }
 
+/** returns the current alt setting of an interface, 0 for unknown interfaces */
+static uint8_t USBAudio_CurrentAlt(USB_Device_Struct* device, uint8_t interface) {
+	return (interface < USB_MAX_INTERFACES_PER_DEVICE) ? device->interfaceAltSetting[interface] : 0;
+}
+
 bool USBAudio_InterfaceAltHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface, uint8_t newAlt) {
 	const USBAudio_Behaviour_Struct* audio = (const USBAudio_Behaviour_Struct*)behaviour;
 	if ((interface != audio->inStreamInterface) &&
 		(interface != audio->outStreamInterface) && 
 		(interface != audio->controlInterface))return false;
+	bool ok = true;
 	if (((USBAudio_Behaviour_Struct*)behaviour)->altChangeCallback) {
-		return (((USBAudio_Behaviour_Struct*)behaviour)->altChangeCallback)(device,
-																			(USBAudio_Behaviour_Struct*)behaviour,
-																			interface,
-																			newAlt);
-	} else return true;
+		ok = (((USBAudio_Behaviour_Struct*)behaviour)->altChangeCallback)(device,
+																		  (USBAudio_Behaviour_Struct*)behaviour,
+																		  interface,
+																		  newAlt);
+	}
+	if (ok) {
+		//streams are only active in non-zero alt settings. We only need frame ticks while one of them runs.
+		uint8_t inAlt = (interface == audio->inStreamInterface) ? newAlt : USBAudio_CurrentAlt(device, audio->inStreamInterface);
+		uint8_t outAlt = (interface == audio->outStreamInterface) ? newAlt : USBAudio_CurrentAlt(device, audio->outStreamInterface);
+		if (inAlt || outAlt) USB_RequestFrameTicks(device, behaviour);
+		else USB_ReleaseFrameTicks(device, behaviour);
+	}
+	return ok;
 }
 
 void USBAudio_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
 	const USBAudio_Behaviour_Struct* audio = (const USBAudio_Behaviour_Struct*)behaviour;
+	USB_ReleaseFrameTicks(device, behaviour);	//a config change stops streaming
 	if (audio->configChangeCallback) (audio->configChangeCallback)(device,audio);
 }
 
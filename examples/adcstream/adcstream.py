@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Host side of the adcstream example: receives the ADC sample stream,
+verifies that it is gapless and optionally writes the samples to a file.
+
+Requires pyusb (pip install pyusb). See main.c for the packet format.
+
+usage: adcstream.py [-s SECONDS] [-o FILE]
+"""
+
+import argparse
+import sys
+import time
+
+import usb.core
+
+VENDOR_ID = 0x1234
+PRODUCT_ID = 0x5679
+DATA_IN_ENDPOINT = 0x83
+PACKET_SIZE = 64
+HEADER_SIZE = 4
+SAMPLE_GROUPS = (PACKET_SIZE - HEADER_SIZE) // 5
+READ_SIZE = PACKET_SIZE * 64
+
+
+def decode_packet(packet):
+    """returns (sequence number, lost sample counter, channel, samples)"""
+    seq = packet[0] | (packet[1] << 8)
+    samples = []
+    for group in range(SAMPLE_GROUPS):
+        g = packet[HEADER_SIZE + 5 * group:HEADER_SIZE + 5 * group + 5]
+        hi = g[4]
+        for i in range(4):
+            samples.append(g[i] | (((hi >> (2 * i)) & 0x03) << 8))
+    return seq, packet[2], packet[3], samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-s", "--seconds", type=float, default=10.0, help="capture duration")
+    parser.add_argument("-o", "--output", help="write samples to this file, one per line")
+    args = parser.parse_args()
+
+    dev = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+    if dev is None:
+        sys.exit("device not found")
+    dev.set_configuration()     # (re)starts streaming with sequence number 0
+
+    out = open(args.output, "w") if args.output else None
+    expected_seq = 0
+    lost_counter = None
+    packets = samples = seq_gaps = lost_samples = short_packets = 0
+    start = time.monotonic()
+    while time.monotonic() - start < args.seconds:
+        data = dev.read(DATA_IN_ENDPOINT, READ_SIZE, timeout=1000)
+        for offset in range(0, len(data), PACKET_SIZE):
+            packet = data[offset:offset + PACKET_SIZE]
+            if len(packet) != PACKET_SIZE:
+                short_packets += 1
+                continue
+            seq, lost, channel, values = decode_packet(packet)
+            if seq != expected_seq:
+                seq_gaps += 1
+                print("sequence gap: expected %d, got %d" % (expected_seq, seq))
+            if lost_counter is not None and lost != lost_counter:
+                lost_samples += (lost - lost_counter) & 0xff
+                print("device lost %d samples before packet %d" % ((lost - lost_counter) & 0xff, seq))
+            lost_counter = lost
+            expected_seq = (seq + 1) & 0xffff
+            packets += 1
+            samples += len(values)
+            if out:
+                out.write("\n".join(str(v) for v in values))
+                out.write("\n")
+    elapsed = time.monotonic() - start
+    if out:
+        out.close()
+
+    print("%d packets, %d samples in %.2f s: %.0f samples/s" % (packets, samples, elapsed, samples / elapsed))
+    print("sequence gaps: %d, samples lost on device: %d, short packets: %d" % (seq_gaps, lost_samples, short_packets))
+    return 0 if (seq_gaps == 0 and lost_samples == 0 and short_packets == 0) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
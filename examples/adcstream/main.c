@@ -0,0 +1,206 @@
+#include "everykey/everykey.h"
+#include "everykey_usb/usb.h"
+
+/* Streams one ADC channel to the host over a vendor-specific bulk IN endpoint.
+ The sample clock is generated by a timer (see ADC_StartTimed), the ADC interrupt
+ collects samples into a ring buffer and the USB interrupt packs them into packets.
+ Streaming starts when the host selects the configuration. Use adcstream.py to
+ receive and verify the stream.
+
+ Packet format (always USB_MAX_BULK_DATA_SIZE = 64 bytes):
+   byte 0..1: packet sequence number (little endian, wraps around)
+   byte 2:    lower 8 bits of the device's lost sample counter
+   byte 3:    ADC channel
+   byte 4..:  SAMPLE_GROUPS groups of 4 samples in 5 bytes: bytes 0..3 hold the lower
+              8 bits of the samples, byte 4 holds the upper 2 bits (sample 0 in bits
+              0..1, sample 1 in bits 2..3 etc.)
+
+ The host detects gaps by jumps in the sequence number (packets lost or not fetched in
+ time) or by a change of the lost sample counter (samples dropped on the device because
+ USB didn't keep up). */
+
+#define ADC_CHANNEL 5
+#define ADC_PORT 1
+#define ADC_PIN 4
+
+/* 250 ksps are 312.5 KB/s on the wire, ~5 packets per USB frame */
+#define SAMPLE_RATE 250000
+#define OVERSAMPLE_BITS 0
+
+/* The packing below has room for 10 bit samples only */
+#if OVERSAMPLE_BITS != 0
+#error "adcstream packs 10 bit samples, oversampled values don't fit"
+#endif
+
+#define HEADER_SIZE 4
+#define SAMPLE_GROUPS ((USB_MAX_BULK_DATA_SIZE - HEADER_SIZE) / 5)
+#define SAMPLES_PER_PACKET (4 * SAMPLE_GROUPS)
+
+/* 2 bytes per sample: 2048 samples, ~8ms at 250 ksps to bridge USB hiccups */
+#define SAMPLE_RING_SIZE 4096
+
+#define DATA_IN_ENDPOINT_LOGICAL 0x83
+#define DATA_IN_ENDPOINT_PHYSICAL 7
+
+const uint8_t deviceDescriptor[] = {
+	18,                             //bLength: length of this structure in bytes (18)
+	USB_DESC_DEVICE,                //bDescriptorType: usb device descriptor
+	I16_TO_LE_BA(0x0200),           //bcdUSB: 0200 - USB 2.0 compliant
+	0x00,                           //bDeviceClass: Device class (0 = interfaces specify class)
+	0x00,                           //bDeviceSubClass: Device subclass (must be 0 if bDeviceClass is 0)
+	0x00,                           //bDeviceProtocol: 0 for no specific device-level protocols
+	USB_MAX_COMMAND_PACKET_SIZE,    //bMaxPacketSize0: Max packet size for control endpoint
+	I16_TO_LE_BA(0x1234),           //idVendor: 16 bit vendor id
+	I16_TO_LE_BA(0x5679),           //idProduct: 16 bit product id
+	I16_TO_LE_BA(0x0100),           //bcdDevice: Device release version
+	0x01,                           //iManufacturer: Manufacturer string index
+	0x02,                           //iProduct: Product string index
+	0x03,                           //iSerialNumber: Serial number string index
+	0x01                            //bNumConfigurations: Number of configurations
+};
+
+const uint8_t languages[] = {
+	0x04,                           //bLength: length of this descriptor in bytes (4)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	0x09,0x04                       //wLangID[]: An array of 16 bit language codes (LE). 0x0409: English (US)
+};
+
+const uint8_t manufacturerName[] = {
+	0x22,                           //bLength: length of this descriptor in bytes (34)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	'P',0,'r',0,'e',0,'s',0,'s',0,' ',0,'A',0,'n',0,'y',0,' ',0,'K',0,'e',0,'y',0,' ',0,'U',0,'G',0	//bString[]: String (UTF16LE, not terminated)
+};
+
+const uint8_t deviceName[] = {
+	0x1a,                           //bLength: length of this descriptor in bytes (26)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	'E',0,'v',0,'e',0,'r',0,'y',0,'K',0,'e',0,'y',0,' ',0,'A',0,'D',0,'C',0
+};
+
+const uint8_t serialName[] = {
+	0x0a,                           //bLength: length of this descriptor in bytes (10)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	'V',0,'1',0,'.',0,'0',0         //bString[]: String (UTF16LE, not terminated)
+};
+
+const uint8_t configDescriptor[] = {
+	0x09,                           //bLength: length of this descriptor in bytes (9)
+	USB_DESC_CONFIGURATION,         //bDescriptorType: configuration descriptor
+	I16_TO_LE_BA(0x19),             //wTotalLen: Total length, including attached interface and endpoint descriptors
+	0x01,                           //bNumInterfaces: Number of interfaces (1)
+	0x01,                           //bConfigurationValue: Number to set to activate this config
+	0x00,                           //iConfiguration: configuration string index (0 = not available)
+	0x80,                           //bmAttributes: Not self-powered, no remote wakeup
+	0x32,                           //bMaxPower: Max power in 2mA steps (0x32 = 50 = 100mA)
+
+	//interface 0
+	0x09,                           //bLength: length of this descriptor in bytes (9)
+	USB_DESC_INTERFACE,             //bDescriptor type: constant indicating that this is an interface descriptor
+	0x00,                           //bInterfaceNumber: Interface index, 0-based
+	0x00,                           //bAlternateSetting
+	0x01,                           //bNumEndpoints: Number of endpoints excluding control endpoint
+	0xff,                           //bInterfaceClass: interface class (0xff = vendor specific)
+	0x00,                           //bInterfaceSubClass
+	0xff,                           //bInterfaceProtocol (0xff = vendor specific)
+	0x00,                           //iInterface: String index (0x00 = not available)
+
+	//endpoint 3: sample data in (physical index: 7, double-buffered)
+	7,                              //bLength
+	USB_DESC_ENDPOINT,              //bDescriptorType
+	DATA_IN_ENDPOINT_LOGICAL,       //bEndpointAddress
+	USB_EPTYPE_BULK,                //bmAttributes
+	I16_TO_LE_BA(USB_MAX_BULK_DATA_SIZE),   //wMaxPacketSize
+	0                               //bInterval
+};
+
+uint8_t sampleMem[sizeof(RingBufferDynamic) + SAMPLE_RING_SIZE];
+const RingBufferStatic sampleBuffer = { SAMPLE_RING_SIZE, (RingBufferDynamic*)sampleMem };
+
+uint16_t sequenceNumber;
+volatile bool streaming = false;
+volatile bool endpointIdle = false;	//set when the endpoint had free buffers but not enough samples
+
+/** packs the next SAMPLES_PER_PACKET samples into a stream packet
+ @param packet buffer to fill (USB_MAX_BULK_DATA_SIZE bytes) */
+static void FillPacket(uint8_t* packet) {
+	uint16_t samples[SAMPLES_PER_PACKET];
+	ADC_ReadBlock(ADC_CHANNEL, samples, SAMPLES_PER_PACKET);
+	packet[0] = sequenceNumber & 0xff;
+	packet[1] = sequenceNumber >> 8;
+	packet[2] = ADC_GetOverrunCount() & 0xff;
+	packet[3] = ADC_CHANNEL;
+	sequenceNumber++;
+
+	uint8_t* out = packet + HEADER_SIZE;
+	const uint16_t* in = samples;
+	uint8_t group;
+	for (group = 0; group < SAMPLE_GROUPS; group++) {
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+		out[3] = in[3];
+		out[4] = ((in[0] >> 8) & 3) | (((in[1] >> 8) & 3) << 2) | (((in[2] >> 8) & 3) << 4) | (((in[3] >> 8) & 3) << 6);
+		out += 5;
+		in += 4;
+	}
+}
+
+bool StreamEndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
+	if (epIdx != DATA_IN_ENDPOINT_PHYSICAL) return false;
+	uint8_t freeBuffers = USB_EP_GetFreeBuffers(device, epIdx);
+	while (streaming && (freeBuffers > 0) && (ADC_SamplesAvailable(ADC_CHANNEL) >= SAMPLES_PER_PACKET)) {
+		uint8_t packet[USB_MAX_BULK_DATA_SIZE];
+		FillPacket(packet);
+		USB_EP_Write(device, epIdx, packet, USB_MAX_BULK_DATA_SIZE);
+		freeBuffers--;
+	}
+	endpointIdle = (freeBuffers > 0);
+	return true;
+}
+
+void StreamConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	streaming = false;
+	ADC_StopSampling();
+	if (device->currentConfiguration == 0) return;
+	sequenceNumber = 0;
+	ADC_StartTimed(ADC_CHANNEL, SAMPLE_RATE, OVERSAMPLE_BITS, &sampleBuffer);
+	streaming = true;
+	endpointIdle = true;
+}
+
+const USB_Behaviour_Struct streamBehaviour = {
+	NULL,
+	StreamEndpointDataHandler,
+	NULL,
+	NULL,
+	StreamConfigChangeHandler
+};
+
+const USB_Device_Definition usbDefinition = {
+	deviceDescriptor,
+	1,
+	{ configDescriptor },
+	4,
+	{ languages, manufacturerName, deviceName, serialName },
+	1,
+	{ (USB_Behaviour_Struct*)(&streamBehaviour) }
+};
+
+USB_Device_Struct usbDevice;
+
+void main(void) {
+	ADC_Init();
+	EVERY_GPIO_SET_FUNCTION(ADC_PORT, ADC_PIN, ADC, IOCON_IO_ADMODE_ANALOG);
+
+	USB_Init(&usbDefinition, &usbDevice);
+	USB_SoftConnect(&usbDevice);
+
+	//the ADC interrupt wakes us up for each sample: restart the endpoint once a packet is ready
+	while (1) {
+		if (streaming && endpointIdle && (ADC_SamplesAvailable(ADC_CHANNEL) >= SAMPLES_PER_PACKET)) {
+			endpointIdle = false;
+			USB_EP_TriggerInterrupt(&usbDevice, DATA_IN_ENDPOINT_PHYSICAL);
+		}
+		waitForInterrupt();
+	}
+}
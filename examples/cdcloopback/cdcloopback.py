@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Host side of the cdcloopback example: streams a file (or random data)
+through the CDC loopback, checks that it comes back unchanged and reports
+the throughput.
+
+Requires pyserial (pip install pyserial).
+
+usage: cdcloopback.py PORT [-f FILE | -n BYTES] [-c CHUNK]
+"""
+
+import argparse
+import os
+import sys
+import threading
+import time
+
+import serial
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the device, e.g. /dev/ttyACM0")
+    parser.add_argument("-f", "--file", help="send this file")
+    parser.add_argument("-n", "--bytes", type=int, default=4 * 1024 * 1024,
+                        help="send this many random bytes if no file is given")
+    parser.add_argument("-c", "--chunk", type=int, default=4096, help="size of each write")
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    else:
+        data = os.urandom(args.bytes)
+    if not data:
+        sys.exit("nothing to send")
+
+    port = serial.Serial(args.port, timeout=2)
+    port.reset_input_buffer()
+
+    def send():
+        for offset in range(0, len(data), args.chunk):
+            port.write(data[offset:offset + args.chunk])
+        port.flush()
+
+    # the device only echoes, so write and read at the same time or both directions stall
+    writer = threading.Thread(target=send, daemon=True)
+    received = bytearray()
+    start = time.monotonic()
+    writer.start()
+    while len(received) < len(data):
+        block = port.read(min(args.chunk, len(data) - len(received)))
+        if not block:
+            break           # timeout: data lost
+        received += block
+    elapsed = time.monotonic() - start
+    writer.join(1)
+    port.close()
+
+    print("%d of %d bytes back in %.2f s: %.1f KB/s each way"
+          % (len(received), len(data), elapsed, len(received) / elapsed / 1024))
+    if received != data[:len(received)]:
+        first = next(i for i in range(len(received)) if received[i] != data[i])
+        print("data mismatch at offset %d" % first)
+        return 1
+    if len(received) != len(data):
+        print("short read: %d bytes missing" % (len(data) - len(received)))
+        return 1
+    print("data ok")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -3,89 +3,170 @@
 #include "state.h"
 
 static CommandStruct queue[CQ_LENGTH];
+static PlanBlock plan[CQ_LENGTH];		//plan of queued path moves, same index
 //if both indexes are the same, the queue is assumed to be empty.
 //Must never be completely full
 static int readIdx;		//next index to be read
 static int writeIdx;	//next index to be written
 static uint32_t lastTransactionId;
 
+//end of the last queued move and its plan, for planning the next one
+static int32_t plannedEnd[NUM_AXES];
+static bool plannedEndValid;			//false: start from currentPosition
+static PlanBlock lastPlanned;
+static bool lastPlannedValid;			//false: the machine stops before the next move
 
-void* anothermemmove (void* s1, const void* s2, size_t n) {
-	size_t i;
-	if (s1 < s2) {
-		for (i=0; i<n; i++) {
-			((uint8_t*)s1)[i] = ((const uint8_t*)s2)[i];
-		}
-	} else {
-		i = n;
-		while (i > 0) {
-			i--;
-			((uint8_t*)s1)[i] = ((const uint8_t*)s2)[i];
+/** backward pass over the queue: lowers entry speeds so that every move can slow down to the
+ entry speed of its successor. The newest move has to stop. Stops at the first block whose
+ entry speed doesn't change, the ones before it don't change either. */
+static void Replan() {
+	uint64_t exitSpeedSqr = 0;
+	int idx = writeIdx;
+	bool newest = true;
+	while (idx != readIdx) {
+		idx = (idx + CQ_LENGTH - 1) % CQ_LENGTH;
+		if (!IS_PATH_MOVE(queue[idx].command)) {
+			exitSpeedSqr = 0;
+			newest = false;
+			continue;
 		}
+		uint64_t entry = Planner_EntrySpeedSqr(&(plan[idx]), exitSpeedSqr);
+		if (!newest && (entry == plan[idx].entrySpeedSqr)) break;
+		plan[idx].entrySpeedSqr = entry;
+		exitSpeedSqr = entry;
+		newest = false;
 	}
-	return s1;
+}
+
+
+/** the queue was emptied: the next move starts where currentCommand leaves the machine. MOVE_DIR
+ doesn't end, the queue only runs again after an immediate command replaced it. */
+static void PlanAfterCurrentCommand() {
+	switch (currentCommand.command) {
+		case CMD_MOVE_TO:
+		case CMD_ARC_CW:
+		case CMD_ARC_CCW:
+			memmove(plannedEnd, currentCommand.args.MOVE_TO.target, sizeof(plannedEnd));
+			break;
+		case CMD_MOVE_TO_IMM:
+			memmove(plannedEnd, currentCommand.args.MOVE_TO_IMM.target, sizeof(plannedEnd));
+			break;
+		case CMD_SET_HOME:
+			memset(plannedEnd, 0, sizeof(plannedEnd));
+			break;
+		default:
+			memmove(plannedEnd, currentPosition, sizeof(plannedEnd));
+			break;
+	}
+	plannedEndValid = true;
+	lastPlannedValid = false;
 }
 
 void CQ_Init() {
 	readIdx = 0;
 	writeIdx = 0;
 	lastTransactionId = 0;
+	plannedEndValid = false;
+	lastPlannedValid = false;
 }
 
 bool CQ_GetCommand() {
-	disableInterrupts();
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
 	bool ok = (readIdx != writeIdx);
 	if (ok) {
-		anothermemmove(&currentCommand, &(queue[readIdx]), sizeof(CommandStruct));
+		memmove(&currentCommand, &(queue[readIdx]), sizeof(CommandStruct));
+		memmove(&currentBlock, &(plan[readIdx]), sizeof(PlanBlock));
 		currentCommandTicks = 0;
 		readIdx = (readIdx+1) % CQ_LENGTH;
 	}
-	enableInterrupts();
+	unmaskInterrupts(mask);
 	return ok;
 }
 
+bool CQ_GetMove() {
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
+	bool ok = (readIdx != writeIdx) && IS_PATH_MOVE(queue[readIdx].command);
+	unmaskInterrupts(mask);
+	return ok && CQ_GetCommand();
+}
+
+uint64_t CQ_NextEntrySpeedSqr() {
+	uint64_t speedSqr = 0;
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
+	if ((readIdx != writeIdx) && IS_PATH_MOVE(queue[readIdx].command)) {
+		speedSqr = plan[readIdx].entrySpeedSqr;
+	}
+	unmaskInterrupts(mask);
+	return speedSqr;
+}
+
 bool CQ_AddCommand(CommandStruct* cmd) {
 	bool ok = true;
-	disableInterrupts();
+	bool isMove = IS_PATH_MOVE(cmd->command);
+	PlanBlock block;
+	if (isMove) {
+		//plan outside the critical section, it divides. Commands are only added from the USB
+		//interrupt or with it disabled (G-code), so the planned end doesn't change meanwhile.
+		//Not in the step tick either: a move planned from the wrong position is skipped there.
+		Planner_InitBlock(&block, plannedEndValid ? plannedEnd : currentPosition, cmd);
+		Planner_SetJunction(&block, lastPlannedValid ? &lastPlanned : NULL);
+	}
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
 	if (cmd->command > IMMEDIATE_SEPARATOR) {	//Queued command
 		int filled = writeIdx - readIdx;
 		if (filled < 0) filled += CQ_LENGTH;
 		int avail = CQ_LENGTH - filled - 1;
 		if (avail > 0) {
-			anothermemmove(&(queue[writeIdx]), cmd, sizeof(CommandStruct));
+			memmove(&(queue[writeIdx]), cmd, sizeof(CommandStruct));
+			if (isMove) {
+				memmove(&(plan[writeIdx]), &block, sizeof(PlanBlock));
+				memmove(plannedEnd, cmd->args.MOVE_TO.target, sizeof(plannedEnd));
+				memmove(&lastPlanned, &block, sizeof(PlanBlock));
+				plannedEndValid = true;
+			}
+			lastPlannedValid = isMove;
 			writeIdx = (writeIdx+1) % CQ_LENGTH;
+			if (isMove) Replan();
 		} else ok = false;
 	} else {									//immediate command
-		anothermemmove(&currentCommand, cmd, sizeof(CommandStruct));
+		memmove(&currentCommand, cmd, sizeof(CommandStruct));
 		currentCommandTicks = 0;
 		readIdx = 0;
 		writeIdx = 0;
+		PlanAfterCurrentCommand();
 	}
-	lastTransactionId = cmd->transactionId;
-	enableInterrupts();
+	if (ok) lastTransactionId = cmd->transactionId;
+	unmaskInterrupts(mask);
 	return ok;
 }			
 
 bool CQ_ReadAvail() {
-	 disableInterrupts();
+	 uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
 	 bool avail = (readIdx != writeIdx);
-	 enableInterrupts();
+	 unmaskInterrupts(mask);
 	 return avail;
 }
 
 int CQ_EmptySlots(uint32_t* outLastTransactionId) {
-	disableInterrupts();
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
 	int filled = writeIdx - readIdx;
 	if (filled < 0) filled += CQ_LENGTH;
 	int avail = CQ_LENGTH - filled - 1;
 	if (outLastTransactionId) *outLastTransactionId = lastTransactionId;
-	enableInterrupts();
+	unmaskInterrupts(mask);
 	return avail;
 }
 
+void CQ_PlannedEnd(int32_t* outEnd) {
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
+	memmove(outEnd, plannedEndValid ? plannedEnd : currentPosition, sizeof(plannedEnd));
+	unmaskInterrupts(mask);
+}
+
 void CQ_Clear() {
-	disableInterrupts();
+	uint32_t mask = maskInterrupts(MOTION_IRQ_PRIORITY);
 	readIdx = 0;
 	writeIdx = 0;
-	enableInterrupts();
+	PlanAfterCurrentCommand();
+	unmaskInterrupts(mask);
 }
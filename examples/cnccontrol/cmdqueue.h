@@ -4,17 +4,34 @@
 #include "everykey/everykey.h"
 #include "cnctypes.h"
 #include "config.h"
+#include "planner.h"
+
+/** number of queue entries. One entry is always kept free. */
+#define CQ_LENGTH ((int)(CQ_MEMORY / (sizeof(CommandStruct) + sizeof(PlanBlock))))
 
 /** initialize queue state */
 void CQ_Init();
 
 
-/** Copies the next command to currentCommand, if available. Leaves currentCommand as is otherwise.
+/** Copies the next command to currentCommand (and its plan to currentBlock), if available.
+ Leaves currentCommand as is otherwise.
  @return success */
 bool CQ_GetCommand();
 
+/** Like CQ_GetCommand, but only takes the next command if it is a path move (MOVE_TO or ARC). Used to chain moves
+ without stopping.
+ @return success */
+bool CQ_GetMove();
+
+/** returns the planned entry speed (squared, see planner.h) of the next queued command, i.e. the
+ speed at which the current move may end. 0 if the next command is not a move. */
+uint64_t CQ_NextEntrySpeedSqr();
+
 /** adds a command that came in. If it's an immediate command, it is copied directly to 
- currentCommand and the queue is cleared. Otherwise, it's put onto the queue. */
+ currentCommand and the queue is cleared, moves queued after it are planned from where it
+ leaves the machine. Otherwise, it's put onto the queue and the queued moves are replanned.
+ @return false if the queue was full. The command is dropped and lastTransactionId is left
+ unchanged in this case. */
 bool CQ_AddCommand(CommandStruct* cmd);
 	
 /** returns whether there's a command to read or not */
@@ -23,7 +40,12 @@ bool CQ_ReadAvail();
 /** returns the number of empty slots */
 int CQ_EmptySlots(uint32_t* outLastTransactionID);
 
-/** clears the queue */
+/** returns where the last queued move ends, i.e. where the next move added will be planned
+ from. After an immediate command that's where it leaves the machine, even while it runs.
+ @param outEnd position, NUM_AXES entries */
+void CQ_PlannedEnd(int32_t* outEnd);
+
+/** clears the queue. Moves queued after this start where currentCommand ends. */
 void CQ_Clear();
 
 #endif
@@ -16,6 +16,14 @@ typedef struct Axis {
 	uint8_t dirPin;
 } Axis;
 
+/** pins of a quadrature encoder measuring an axis */
+typedef struct EncoderPins {
+	uint8_t portA;
+	uint8_t pinA;
+	uint8_t portB;
+	uint8_t pinB;
+} EncoderPins;
+
 typedef enum StateFlags {
 	State_SteppersOn	= 0x01,
 	State_ImmediateMode = 0x02,
@@ -31,9 +39,14 @@ typedef enum CommandId {
 	IMMEDIATE_SEPARATOR		= 999,	//No actual command, just a separator. Everything below is immediate mode
 	CMD_MOVE_TO				= 1000,
 	CMD_WAIT				= 1001,	
-	CMD_SPINDLE				= 1002
+	CMD_SPINDLE				= 1002,
+	CMD_ARC_CW				= 1003,
+	CMD_ARC_CCW				= 1004
 } CommandId;
 
+/** true for the commands that move along a planned path (see planner.h) */
+#define IS_PATH_MOVE(command) (((command) == CMD_MOVE_TO) || ((command) == CMD_ARC_CW) || ((command) == CMD_ARC_CCW))
+
 typedef struct CommandStruct {
 	uint32_t transactionId;
 	uint32_t command;
@@ -51,8 +64,13 @@ typedef struct CommandStruct {
 		} MOVE_TO_IMM;
 		struct {
 			int32_t target[NUM_AXES];
-			uint32_t ticks;
+			uint32_t ticks;		//duration at full speed in heartbeats: sets the cruise speed, the planner adds acceleration
 		} MOVE_TO;
+		struct {
+			int32_t target[NUM_AXES];	//first, like MOVE_TO: args.MOVE_TO.target is the end of every path move
+			int32_t center[2];			//absolute X and Y of the center. Target = start in X and Y: full circle
+			uint32_t ticks;				//like MOVE_TO, along the arc (helix if Z changes)
+		} ARC;
 		struct {
 			uint32_t ticks;
 		} WAIT;
@@ -64,12 +82,39 @@ typedef struct CommandStruct {
 } __attribute__((packed)) CommandStruct;
 
 
+/* OUT report (BATCH_REPORT_SIZE bytes): a sequence of entries, each starting with a BatchOp
+ byte followed by its data. Processing stops at BATCH_END, at the end of the report or at the
+ first command that doesn't fit into the queue. */
+#define BATCH_REPORT_SIZE 64
+
+typedef enum BatchOp {
+	BATCH_END				= 0,	//rest of the report is unused
+	BATCH_COMMAND			= 1,	//followed by a CommandStruct
+	BATCH_MOVE_DELTA		= 2		//followed by a MoveDeltaStruct
+} BatchOp;
+
+/** compact CMD_MOVE_TO. The target is relative to the target of the previous MOVE_TO received
+ (full or compact), to the current position after power up, or to where an immediate command
+ leaves the machine after one (the MOVE_TO_IMM target, 0 after SET_HOME, else the position at
+ the time it came in), the queue plans the move from there as well. The transaction id is the
+ one of the previous command received + 1. */
+typedef struct MoveDeltaStruct {
+	int16_t delta[NUM_AXES];
+	uint16_t ticks;
+} __attribute__((packed)) MoveDeltaStruct;
+
+/* Credits: the host may send up to `credits` commands after the one with lastTransactionId
+ before it has to wait for the next report. Dropped commands (queue full) show up as a
+ lastTransactionId that doesn't advance, they have to be sent again. */
 typedef struct ResponseStruct {
 	uint32_t currentPos[NUM_AXES];
 	uint32_t stateFlags;
-	uint32_t freeSlots;
-	uint32_t lastTransactionId;
+	uint32_t credits;			//free queue slots
+	uint32_t lastTransactionId;	//last command accepted
 	uint16_t spindleSpeed;
+	int32_t measuredPos[NUM_AXES];	//encoder counts, 0 if HAS_ENCODERS is false
+	uint16_t queueLength;			//number of commands the queue can hold
+	uint16_t stepJitter;			//step edge jitter since power up, CPU cycles (72 per us)
 } ResponseStruct;
 
 #endif
@@ -6,5 +6,19 @@ const Axis axes[NUM_AXES] = {
 	{ 0,6,	1,7,	1,6 }
 };
 
+/* 200 steps per revolution, 5mm per revolution */
+const uint32_t unitsPerMm[NUM_AXES] = {
+	40 << SUBSTEP_BITS,
+	40 << SUBSTEP_BITS,
+	40 << SUBSTEP_BITS
+};
+
+/* encoder A/B channels per axis - adjust to your wiring */
+const EncoderPins encoderPins[NUM_AXES] = {
+	{ 2,4,	2,5 },
+	{ 2,6,	2,7 },
+	{ 2,8,	2,9 }
+};
+
 	
 
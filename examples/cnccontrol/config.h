@@ -50,17 +50,64 @@
 
 extern const Axis axes[NUM_AXES];
 
+/** position units per mm for each axis (steps per mm << SUBSTEP_BITS), used for G-code */
+extern const uint32_t unitsPerMm[NUM_AXES];
+
+/** G-code: feed rate of G0 moves in mm/min (the planner caps it to MAX_AXIS_SPEED) */
+#define GCODE_RAPID_FEED 6000
+/** G-code: spindle speed (S) that maps to full PWM */
+#define GCODE_SPINDLE_MAX_RPM 10000
+/** G-code: serial receive buffer in bytes (power of two). Senders using character counting must not have
+ more than this in flight. */
+#define GCODE_RX_SIZE 256
+/** G-code: serial send buffer in bytes (power of two) */
+#define GCODE_TX_SIZE 128
+
+/** set to true if the axes have quadrature encoders attached (see encoderPins) */
+#define HAS_ENCODERS false
+
+extern const EncoderPins encoderPins[NUM_AXES];
+
 #define SPINDLE_PORT 1
 #define SPINDLE_PIN 5
 
+/** command tick rate. Tick counts in commands (MOVE_TO, WAIT, SPINDLE...) are in these units. */
 #define HEARTBEAT_HZ 10000
+
+/** step tick rate. Moves are interpolated and step pins updated at this rate, must be a
+ multiple of HEARTBEAT_HZ. */
+#define STEP_HZ 40000
+#define STEP_TICKS_PER_HEARTBEAT (STEP_HZ / HEARTBEAT_HZ)
+
+/** interrupt priorities (0 = most urgent, steps of 32). The step interrupt only puts out
+ step pin values prepared one step tick ahead and must not be held up by anything, the
+ motion stage (interpolation, commands) runs below it and the encoders. USB plans
+ commands and comes last. Shared queue state is locked with
+ maskInterrupts(MOTION_IRQ_PRIORITY). */
+#define STEP_IRQ_PRIORITY 0
+#define ENCODER_IRQ_PRIORITY 32
+#define MOTION_IRQ_PRIORITY 64
+#define USB_IRQ_PRIORITY 96
+
+/** planner limits per axis. Speeds in position units per step tick, accelerations in
+ position units per step tick squared, both Q16 (65536 = one position unit). Axis speed
+ must stay below (1 << SUBSTEP_BITS) units per step tick, otherwise step pin edges
+ get lost. */
+#define MAX_AXIS_SPEED (192 << 16)
+#define MAX_AXIS_ACCEL 1300
+/** maximum speed change of an axis at a junction between moves */
+#define MAX_JUNCTION_JERK (8 << 16)
+/** speed at which moves start from standstill */
+#define PLANNER_MIN_SPEED (1 << 16)
 #define SPINDLE_PWM_RESOLUTION 100
 
 #define ENABLE_IS_LOW_ACTIVE true
 #define SPINDLE_IS_LOW_ACTIVE true
 
-/** size of command queue */
-#define CQ_LENGTH 10
+/** RAM for the command queue, in bytes. The queue length follows from this (see cmdqueue.h).
+ The LPC1343 has 7.6K of usable RAM, this leaves about 4K for the other globals (including
+ the serial buffers) and the stack. */
+#define CQ_MEMORY 3584
 
 /** Number of bits in positions considered to be below one phyiscal step.
  Positions have a fixed point representation, with SUBSTEP_BITS fractional bits.
@@ -2,22 +2,57 @@
 #include "cnctypes.h"
 #include "state.h"
 #include "cmdqueue.h"
+#include "fixmath.h"
 
 int ledCounter;
 uint16_t spindlePhase;
 uint16_t spindleCompare;
 
-void SetEnablePin(uint8_t axis, bool on) {
-	if (ENABLE_IS_LOW_ACTIVE) on = !on;
-	every_gpio_write(axes[axis].enablePort, axes[axis].enablePin, on); 
-}
+/* axis pins, group index = axis. Each group is written at once so that all
+ axes change at the same time (one store per port). */
+every_gpio_pin_group enablePins;
+every_gpio_pin_group stepPins;
+every_gpio_pin_group dirPins;
 
-void SetDirPin(uint8_t axis, bool increasing) {
-	every_gpio_write(axes[axis].dirPort, axes[axis].dirPin, increasing); 
-}
+/* current dir pin state, bit per axis: set = increasing */
+uint32_t dirBits;
+
+/* step pin values are put out by the step interrupt at the start of each step tick. The
+ motion stage (Downstream_Tick) prepares them one tick ahead in the buffer the interrupt
+ doesn't use and flips stepOutputIdx when done, so the edges don't move with whatever the
+ motion stage has to do. Dir pins are written by the motion stage, a full tick before their
+ step edge. */
+#define STEP_TIMER CT32B0
+every_gpio_group_output stepOutputs[2];
+volatile uint8_t stepOutputIdx;
+
+/* step edge latency (timer counts after the match, CPU cycles) seen so far */
+volatile uint32_t stepLatencyMin;
+volatile uint32_t stepLatencyMax;
+
+#define ALL_AXES ((1 << NUM_AXES) - 1)
+
+/* step ticks since the last heartbeat (command) tick */
+uint8_t stepTick;
 
-void SetStepPin(uint8_t axis, bool value) {
-	every_gpio_write(axes[axis].stepPort, axes[axis].stepPin, value); 
+/* execution state of the current path move (see currentBlock). Each step tick adjusts the
+ path speed (accelerate, cruise or brake for the planned exit speed), advances the travelled
+ distance by it and moves every axis by distance * slope. Arcs place X and Y by rotating the
+ start radius by distance * angleRate (CORDIC) and growing it by distance * radiusRate, so
+ every tick lands on the arc within the rotation's accuracy (~2 units) and chords between
+ ticks are at most one tick of travel long.
+ The step tick path only adds, shifts, multiplies and compares, divisions happen in the
+ planner. */
+bool moveActive;
+bool moveDone;				//target reached, waiting for the heartbeat to fetch a command
+uint32_t moveSpeed;			//Q16 position units per step tick
+uint32_t moveFraction;		//travelled distance below one position unit, Q16
+uint32_t moveDistance;		//travelled distance in position units
+uint64_t moveAxis[NUM_AXES];	//travelled distance per axis, Q32
+
+void SetEnablePins(bool on) {
+	if (ENABLE_IS_LOW_ACTIVE) on = !on;
+	every_gpio_group_write(&enablePins, on ? ALL_AXES : 0);
 }
 
 void SetSpindlePin(bool on) {
@@ -35,18 +70,30 @@ void Downstream_Init() {
 	EVERY_GPIO_SET_FUNCTION(0, 10, PIO, IOCON_IO_ADMODE_DIGITAL);
 	EVERY_GPIO_SET_FUNCTION(0, 11, PIO, IOCON_IO_ADMODE_DIGITAL);
 	
+	every_gpio_group_init(&enablePins);
+	every_gpio_group_init(&stepPins);
+	every_gpio_group_init(&dirPins);
 	int i;
 	for (i=0;i<NUM_AXES;i++) {
-		
-		every_gpio_set_dir(axes[i].dirPort, axes[i].dirPin, OUTPUT);
-		SetDirPin(i, false);
+		every_gpio_group_add(&enablePins, axes[i].enablePort, axes[i].enablePin);
+		every_gpio_group_add(&stepPins, axes[i].stepPort, axes[i].stepPin);
+		every_gpio_group_add(&dirPins, axes[i].dirPort, axes[i].dirPin);
+	}
 
-		every_gpio_set_dir(axes[i].stepPort, axes[i].stepPin, OUTPUT);
-		SetStepPin(i, false);
+	every_gpio_group_set_dir(&dirPins, OUTPUT);
+	dirBits = 0;
+	every_gpio_group_write(&dirPins, dirBits);
 
-		every_gpio_set_dir(axes[i].enablePort, axes[i].enablePin, OUTPUT);
-		SetEnablePin(i, true);	//Right now, we enable all drivers - should be made dynamic later
-	}
+	every_gpio_group_set_dir(&stepPins, OUTPUT);
+	every_gpio_group_write(&stepPins, 0);
+	every_gpio_group_prepare(&stepPins, 0, &(stepOutputs[0]));
+	every_gpio_group_prepare(&stepPins, 0, &(stepOutputs[1]));
+	stepOutputIdx = 0;
+	stepLatencyMin = 0xffffffff;
+	stepLatencyMax = 0;
+
+	every_gpio_group_set_dir(&enablePins, OUTPUT);
+	SetEnablePins(true);	//Right now, we enable all drivers - should be made dynamic later
 
 	every_gpio_set_dir(SPINDLE_PORT, SPINDLE_PIN, OUTPUT);
 	SetSpindlePin(false);
@@ -55,26 +102,153 @@ void Downstream_Init() {
 	every_gpio_write(LED_PORT, LED_PIN, false);
 
 	ledCounter = 0;
+	stepTick = 0;
+	moveActive = false;
+	moveDone = false;
+	moveSpeed = 0;
 	spindlePhase = 0;
 	SetSpindleSpeed(0);
 }
 
-void Downstream_Tick() {
+void Downstream_Start() {
+	//step tick: interrupt and restart every 1/STEP_HZ s
+	Timer_Enable(STEP_TIMER, true);
+	Timer_Stop(STEP_TIMER);
+	Timer_SetPrescale(STEP_TIMER, 0);
+	Timer_SetMatchValue(STEP_TIMER, 0, (72000000 / STEP_HZ) - 1);
+	Timer_SetMatchBehaviour(STEP_TIMER, 0, TIMER_MATCH_INTERRUPT | TIMER_MATCH_RESET);
+	NVIC_SetInterruptPriority(NVIC_CT16B0 + STEP_TIMER, STEP_IRQ_PRIORITY);
+	//the motion stage is triggered from the step interrupt, its timer isn't used
+	NVIC_SetInterruptPriority(NVIC_CT32B1, MOTION_IRQ_PRIORITY);
+	NVIC_EnableInterrupt(NVIC_CT32B1);
+	NVIC_EnableInterrupt(NVIC_CT16B0 + STEP_TIMER);
+	Timer_Start(STEP_TIMER);
+}
+
+uint32_t Downstream_StepJitter() {
+	uint32_t min = stepLatencyMin;
+	uint32_t max = stepLatencyMax;
+	return (max > min) ? max - min : 0;
+}
 
+/* step interrupt: pin stores first, everything else after the edge */
+void ct32b0_handler(void) {
+	every_gpio_group_apply(&(stepOutputs[stepOutputIdx]));
+	uint32_t latency = Timer_GetValue(STEP_TIMER);
+	TIMER[STEP_TIMER].IR = TIMER_MR0INT;
+	if (latency < stepLatencyMin) stepLatencyMin = latency;
+	if (latency > stepLatencyMax) stepLatencyMax = latency;
+	NVIC_SetInterruptPending(NVIC_CT32B1);
+}
+
+/** starts executing currentCommand (a path move) with currentBlock
+ @param chained true if the previous move ended at full speed into this one
+ @return false if the machine isn't where the move was planned from. The queue plans every
+ move from where the command before it leaves the machine (see CQ_AddCommand), so this
+ shouldn't happen. The move is skipped then: stepping it would jump to its start, and
+ replanning divides, which is too slow for the step tick. */
+bool StartMove(bool chained) {
 	int i;
-	bool wantNewCommand = false;	//if true after handling our command, we will try to find a new one
-	
-	//power steppers on
 	for (i=0; i<NUM_AXES; i++) {
-		SetEnablePin(i, true);
+		if (currentBlock.start[i] != currentPosition[i]) return false;
+	}
+	for (i=0; i<NUM_AXES; i++) moveAxis[i] = 0;
+	moveDistance = 0;
+	moveFraction = 0;
+	if (!chained) moveSpeed = PLANNER_MIN_SPEED;
+	moveActive = true;
+	moveDone = false;
+	return true;
+}
+
+/** advances the current move by one step tick
+ @return true if the target was reached */
+bool MoveStep() {
+	int i;
+	uint32_t remaining = currentBlock.length - moveDistance;
+	//brake if the distance left after this tick is too short to get down to the exit speed
+	uint32_t travel = (moveSpeed >> 16) + 1;
+	uint32_t braking = (remaining > travel) ? remaining - travel : 0;
+	uint64_t speedSqr = ((uint64_t)moveSpeed * moveSpeed) >> 16;
+	uint64_t brakeSqr = CQ_NextEntrySpeedSqr() + 2 * (uint64_t)currentBlock.accel * braking;
+	uint32_t faster = moveSpeed + currentBlock.accel;
+	if (faster > currentBlock.nominalSpeed) faster = currentBlock.nominalSpeed;
+	if (speedSqr >= brakeSqr) {								//slow down for the exit speed
+		moveSpeed = (moveSpeed > PLANNER_MIN_SPEED + currentBlock.accel) ? moveSpeed - currentBlock.accel : PLANNER_MIN_SPEED;
+	} else if ((((uint64_t)faster * faster) >> 16) < brakeSqr) {	//speed up or cruise
+		moveSpeed = faster;
+	}														//else hold, just below the braking curve
+
+	moveFraction += moveSpeed;
+	uint32_t units = moveFraction >> 16;
+	moveFraction &= 0xffff;
+	if (units >= remaining) {		//make sure we're exactly on target
+		for (i=0; i<NUM_AXES; i++) currentPosition[i] = currentCommand.args.MOVE_TO.target[i];
+		return true;
 	}
+	moveDistance += units;
+	int32_t lastX = currentPosition[0];
+	int32_t lastY = currentPosition[1];
+	for (i=0; i<NUM_AXES; i++) {
+		moveAxis[i] += units * currentBlock.slope[i];
+		currentPosition[i] = currentBlock.start[i] + currentBlock.direction[i] * (int32_t)(moveAxis[i] >> 32);
+	}
+	if (currentBlock.arcDirection) {	//Z stays linear, X and Y follow the arc
+		uint32_t angle = ((uint64_t)moveDistance * currentBlock.angleRate) >> 16;
+		int32_t x = currentBlock.radius[0];
+		int32_t y = currentBlock.radius[1];
+		Fix_Rotate(&x, &y, (currentBlock.arcDirection > 0) ? angle : -angle);
+		if (currentBlock.radiusRate) {	//end slightly off the circle: blend the radius
+			int64_t grow = ((int64_t)moveDistance * currentBlock.radiusRate) >> 32;
+			x += ((((int64_t)x * (int64_t)currentBlock.inverseRadius) >> 16) * grow) >> 32;
+			y += ((((int64_t)y * (int64_t)currentBlock.inverseRadius) >> 16) * grow) >> 32;
+		}
+		x += currentBlock.center[0];
+		y += currentBlock.center[1];
+		//between quadrant turns X and Y only move one way (x' = -turn * sin, y' = turn * cos).
+		//Hold an axis instead of letting the rotation's noise step it back and forth.
+		uint32_t phase = currentBlock.startAngle + ((currentBlock.arcDirection > 0) ? angle : -angle);
+		bool xDown = (phase < FIX_ANGLE_180) == (currentBlock.arcDirection > 0);
+		bool yUp = ((uint32_t)(phase + FIX_ANGLE_90) < FIX_ANGLE_180) == (currentBlock.arcDirection > 0);
+		if (xDown ? (x > lastX) : (x < lastX)) x = lastX;
+		if (yUp ? (y < lastY) : (y > lastY)) y = lastY;
+		currentPosition[0] = x;
+		currentPosition[1] = y;
+	}
+	return false;
+}
+
+void Downstream_Tick() {
+
+	int i;
+	bool wantNewCommand = false;	//if true after handling our command, we will try to find a new one
 	
 	//remember last position
-	uint32_t lastPosition[NUM_AXES];
+	int32_t lastPosition[NUM_AXES];
 	for (i=0; i<NUM_AXES; i++) lastPosition[i] = currentPosition[i];
+
+	//moves are interpolated on every step tick. Queued moves follow each other right away,
+	//keeping their speed across the junction.
+	if (IS_PATH_MOVE(currentCommand.command) && !moveDone) {
+		if (!moveActive && !StartMove(false)) moveDone = true;
+		else if (MoveStep()) {
+			if (!(CQ_GetMove() && StartMove(true))) moveDone = true;
+		}
+	} else if (!IS_PATH_MOVE(currentCommand.command)) {
+		moveActive = false;
+		moveDone = false;
+	}
+
+	//everything else runs at the heartbeat rate, after the last step tick of each heartbeat
+	stepTick++;
+	bool heartbeat = (stepTick >= STEP_TICKS_PER_HEARTBEAT);
+	if (heartbeat) stepTick = 0;
+
+	//power steppers on
+	if (heartbeat) SetEnablePins(true);
 	
 	//handle command
-	switch (currentCommand.command) {
+	if (heartbeat) switch (currentCommand.command) {
 		case CMD_STOP:
 			wantNewCommand = true;
 			break;
@@ -120,16 +294,11 @@ void Downstream_Tick() {
 		}
 			break;
 		case CMD_MOVE_TO:
-			if (currentCommandTicks < currentCommand.args.MOVE_TO.ticks) {	//Moving on path
-				int32_t remaining = currentCommand.args.MOVE_TO.ticks - currentCommandTicks;
-				for (i=0; i<NUM_AXES; i++) {	//make sure we're exactly on target
-					int32_t delta = currentCommand.args.MOVE_TO.target[i] - currentPosition[i];
-					currentPosition[i] += delta / (remaining+1);
-				}
-			} else {														//we're at the end
-				for (i=0; i<NUM_AXES; i++) {	//make sure we're exactly on target
-					currentPosition[i] = currentCommand.args.MOVE_TO.target[i];
-				}
+		case CMD_ARC_CW:
+		case CMD_ARC_CCW:
+			if (moveDone) {		//MoveStep() did the path, the next command isn't a move
+				moveActive = false;
+				moveDone = false;
 				wantNewCommand = true;
 			}
 			break;
@@ -154,40 +323,44 @@ void Downstream_Tick() {
 	//set dir bits
 	for (i=0; i<NUM_AXES; i++) {
 		if (currentPosition[i] > lastPosition[i]) {	//increasing movement
-			SetDirPin(i, true);
+			dirBits |= 1 << i;
 		} else if (currentPosition[i] < lastPosition[i]) { //decreasing movement
-			SetDirPin(i, false);
+			dirBits &= ~(1 << i);
 		}
 	}
+	every_gpio_group_write(&dirPins, dirBits);
 			
-	//put as much delay as possible between set dir and set step - do everything we can here
-	
-	//update current command ticks
-	currentCommandTicks++;
+	if (heartbeat) {
+		//update current command ticks
+		currentCommandTicks++;
 				
-	//poll new command if needed
-	if (wantNewCommand) {
-		if (!(CQ_GetCommand())) currentCommand.command = CMD_STOP;
-		currentCommandTicks = 0;
-	}
+		//poll new command if needed
+		if (wantNewCommand) {
+			if (!(CQ_GetCommand())) currentCommand.command = CMD_STOP;
+			currentCommandTicks = 0;
+		}
 
-	//update immediate mode flag
-	if (currentCommand.command > IMMEDIATE_SEPARATOR) stateFlags |= State_ImmediateMode;
-	else stateFlags &= ~State_ImmediateMode;
+		//update immediate mode flag
+		if (currentCommand.command > IMMEDIATE_SEPARATOR) stateFlags |= State_ImmediateMode;
+		else stateFlags &= ~State_ImmediateMode;
 	
-	//set spindle
-	spindlePhase = (spindlePhase + 1) % SPINDLE_PWM_RESOLUTION;
-	SetSpindlePin(spindlePhase < spindleCompare);
-//	every_gpio_write(LED_PORT, LED_PIN, spindlePhase < spindleCompare);
-
-	//Blink the LED to show we're alive
-	ledCounter++;
-	every_gpio_write(LED_PORT, LED_PIN, ledCounter & 0x800);
+		//set spindle
+		spindlePhase = (spindlePhase + 1) % SPINDLE_PWM_RESOLUTION;
+		SetSpindlePin(spindlePhase < spindleCompare);
+//		every_gpio_write(LED_PORT, LED_PIN, spindlePhase < spindleCompare);
+
+		//Blink the LED to show we're alive
+		ledCounter++;
+		every_gpio_write(LED_PORT, LED_PIN, ledCounter & 0x800);
+	}
 	
-	//set step bits
+	//prepare step bits for the next step interrupt - all axes at once
+	uint32_t stepBits = 0;
 	for (i=0; i<NUM_AXES; i++) {
-		SetStepPin(i, (currentPosition[i] >> SUBSTEP_BITS) & 1);
+		stepBits |= ((currentPosition[i] >> SUBSTEP_BITS) & 1) << i;
 	}
-	
+	uint8_t next = stepOutputIdx ^ 1;
+	every_gpio_group_prepare(&stepPins, stepBits, &(stepOutputs[next]));
+	stepOutputIdx = next;
 }
 
@@ -7,6 +7,16 @@
 
 void Downstream_Init();
 
+/** starts the step tick. Each tick puts out the step pins prepared by the previous
+ Downstream_Tick() and triggers the motion stage (the CT32B1 interrupt, see main.c). */
+void Downstream_Start();
+
+/** motion stage, called at STEP_HZ. Interpolates moves on every call, handles commands every
+ STEP_TICKS_PER_HEARTBEAT calls and prepares the step pins for the next step tick. */
 void Downstream_Tick();
 
+/** returns the spread of the step edge latency after the step timer match seen since
+ power up, in CPU cycles (72 per microsecond) */
+uint32_t Downstream_StepJitter();
+
 #endif
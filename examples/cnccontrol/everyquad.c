@@ -0,0 +1 @@
+../../libs/everyquad/everyquad.c
\ No newline at end of file
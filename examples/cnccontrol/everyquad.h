@@ -0,0 +1 @@
+../../libs/everyquad/everyquad.h
\ No newline at end of file
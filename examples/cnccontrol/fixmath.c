@@ -0,0 +1,127 @@
+#include "fixmath.h"
+
+#define CORDIC_STEPS 30
+
+/* atan(2^-i) as binary angles */
+static const uint32_t cordicAngles[CORDIC_STEPS] = {
+	0x20000000, 0x12e4051e, 0x09fb385b, 0x051111d4, 0x028b0d43, 0x0145d7e1,
+	0x00a2f61e, 0x00517c55, 0x0028be53, 0x00145f2f, 0x000a2f98, 0x000517cc,
+	0x00028be6, 0x000145f3, 0x0000a2fa, 0x0000517d, 0x000028be, 0x0000145f,
+	0x00000a30, 0x00000518, 0x0000028c, 0x00000146, 0x000000a3, 0x00000051,
+	0x00000029, 0x00000014, 0x0000000a, 0x00000005, 0x00000003, 0x00000001
+};
+
+/* 1 / CORDIC gain, Q31 */
+#define CORDIC_SCALE 1304065748
+
+/* coordinates are scaled up to this magnitude for the CORDIC iterations, which leaves
+ room for the gain (1.65) and the diagonal (1.41) */
+#define CORDIC_MAGNITUDE (1 << 28)
+
+/** returns by how many bits a vector can be scaled up to reach CORDIC_MAGNITUDE */
+static uint8_t CordicShift(int32_t x, int32_t y) {
+	uint32_t magnitude = ((x < 0) ? -x : x) | ((y < 0) ? -y : y);
+	uint8_t shift = 0;
+	if (!magnitude) return 0;
+	while (magnitude < CORDIC_MAGNITUDE) {
+		magnitude <<= 1;
+		shift++;
+	}
+	return shift;
+}
+
+uint32_t Fix_SquareRoot(uint64_t value) {
+	uint64_t root = 0;
+	uint64_t bit = 1ULL << 62;
+	while (bit > value) bit >>= 2;
+	while (bit) {
+		if (value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		} else root >>= 1;
+		bit >>= 2;
+	}
+	return root;
+}
+
+uint64_t Fix_Divide(uint64_t num, uint32_t den) {
+	uint64_t quotient = 0;
+	uint64_t remainder = 0;
+	int i;
+	for (i=0; i<64; i++) {
+		remainder = (remainder << 1) | (num >> 63);
+		num <<= 1;
+		quotient <<= 1;
+		if (remainder >= den) {
+			remainder -= den;
+			quotient |= 1;
+		}
+	}
+	return quotient;
+}
+
+uint32_t Fix_Atan2(int32_t y, int32_t x) {
+	uint32_t angle = 0;
+	if (x < 0) {	//CORDIC converges within +-90 degrees: start from the opposite vector
+		x = -x;
+		y = -y;
+		angle = FIX_ANGLE_180;
+	}
+	uint8_t shift = CordicShift(x, y);
+	x *= 1 << shift;
+	y *= 1 << shift;
+	int i;
+	for (i=0; i<CORDIC_STEPS; i++) {
+		int32_t dx = y >> i;
+		int32_t dy = x >> i;
+		if (y > 0) {
+			x += dx;
+			y -= dy;
+			angle += cordicAngles[i];
+		} else {
+			x -= dx;
+			y += dy;
+			angle -= cordicAngles[i];
+		}
+	}
+	return angle;
+}
+
+void Fix_Rotate(int32_t* x, int32_t* y, uint32_t angle) {
+	uint8_t shift = CordicShift(*x, *y);
+	int32_t vx = *x * (1 << shift);
+	int32_t vy = *y * (1 << shift);
+	int32_t remaining = angle;
+	if ((remaining > FIX_ANGLE_90) || (remaining < -FIX_ANGLE_90)) {	//rotate by 180 degrees first
+		vx = -vx;
+		vy = -vy;
+		remaining += FIX_ANGLE_180;
+	}
+	int i;
+	for (i=0; i<CORDIC_STEPS; i++) {
+		int32_t dx = vy >> i;
+		int32_t dy = vx >> i;
+		if (remaining >= 0) {
+			vx -= dx;
+			vy += dy;
+			remaining -= cordicAngles[i];
+		} else {
+			vx += dx;
+			vy -= dy;
+			remaining += cordicAngles[i];
+		}
+	}
+	//remove the CORDIC gain, then the scaling (rounded)
+	vx = ((int64_t)vx * CORDIC_SCALE) >> 31;
+	vy = ((int64_t)vy * CORDIC_SCALE) >> 31;
+	if (shift) {
+		vx = (vx + (1 << (shift - 1))) >> shift;
+		vy = (vy + (1 << (shift - 1))) >> shift;
+	}
+	*x = vx;
+	*y = vy;
+}
+
+uint32_t Fix_ArcLength(uint32_t radius, uint64_t sweep) {
+	return ((((uint64_t)radius * sweep) >> 16) * FIX_TWO_PI) >> 32;
+}
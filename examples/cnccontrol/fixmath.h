@@ -0,0 +1,42 @@
+/** fixed point helpers: square root, 64 bit division and CORDIC angles */
+
+#ifndef _FIXMATH_
+#define _FIXMATH_
+
+#include "everykey/everykey.h"
+
+/* Angles are binary angles: the full circle is 1 << 32, so they wrap around like the
+ circle does. 0x40000000 is 90 degrees counterclockwise. */
+#define FIX_ANGLE_90 0x40000000
+#define FIX_ANGLE_180 0x80000000
+
+/** 2 pi, Q16 */
+#define FIX_TWO_PI 411775
+
+/** integer square root, rounded down */
+uint32_t Fix_SquareRoot(uint64_t value);
+
+/** 64 by 32 bit division (shift and subtract, we don't link libgcc). Slow, keep it out of
+ the step tick path.
+ @param num numerator
+ @param den denominator, must not be 0
+ @return quotient, rounded down */
+uint64_t Fix_Divide(uint64_t num, uint32_t den);
+
+/** returns the binary angle of a vector, measured counterclockwise from the x axis.
+ Components must stay below 1 << 28. */
+uint32_t Fix_Atan2(int32_t y, int32_t x);
+
+/** rotates a vector counterclockwise. Components must stay below 1 << 28, the
+ result is accurate to about 2 units.
+ @param x in: x component, out: rotated x component
+ @param y in: y component, out: rotated y component
+ @param angle binary angle to rotate by */
+void Fix_Rotate(int32_t* x, int32_t* y, uint32_t angle);
+
+/** returns the length of an arc
+ @param radius radius, below 1 << 28
+ @param sweep binary angle of the arc, up to 1 << 32 (full circle) */
+uint32_t Fix_ArcLength(uint32_t radius, uint64_t sweep);
+
+#endif
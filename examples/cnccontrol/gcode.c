@@ -0,0 +1,442 @@
+#include "gcode.h"
+#include "cnctypes.h"
+#include "config.h"
+#include "state.h"
+#include "cmdqueue.h"
+#include "upstream.h"
+#include "fixmath.h"
+
+#define LINE_LENGTH 96
+#define INPUT_CHUNK 64
+#define MAX_PENDING 3
+
+/* GRBL error codes */
+#define ERROR_EXPECTED_LETTER	1
+#define ERROR_BAD_NUMBER		2
+#define ERROR_LINE_LENGTH		11
+#define ERROR_UNSUPPORTED		20
+#define ERROR_MODAL_CONFLICT	21
+#define ERROR_UNDEFINED_FEED	22
+#define ERROR_MISSING_VALUE		28
+#define ERROR_INVALID_TARGET	33
+
+#define X 0
+#define Y 1
+#define Z 2
+
+/* words of a line. Values are in thousandths (micrometers for coordinates in G21). Modal
+ changes are only collected here, the modal state takes them once the whole line is valid. */
+typedef struct Block {
+	uint32_t seen;					//bit per letter ('A' = bit 0)
+	int32_t value[26];				//value per letter
+	int8_t motion;					//new motion mode or -1
+	bool dwell;
+	int8_t spindle;					//1: M3/M4, 0: M5, -1: unchanged
+	int8_t inches;					//1: G20, 0: G21, -1: unchanged
+	int8_t absolute;				//1: G90, 0: G91, -1: unchanged
+} Block;
+
+#define SEEN(block, letter) ((block)->seen & (1 << ((letter) - 'A')))
+
+//line assembly
+static uint8_t input[INPUT_CHUNK];
+static uint8_t inputLength;
+static uint8_t inputPos;
+static char line[LINE_LENGTH];
+static uint8_t lineLength;
+static bool lineOverflow;
+static bool lastWasCR;
+static char commentEnd;				//')' within a comment, '\n' after ';', 0 outside
+
+//modal state
+static int32_t position[NUM_AXES];	//end of the last line, micrometers
+static bool absoluteMode;
+static bool inches;
+static int8_t motionMode;
+static uint32_t feed;				//micrometers per minute, 0 = not set yet
+static uint32_t spindleRpm;
+static bool spindleOn;
+static uint32_t transactionId;
+
+//commands of the current line that are not queued yet
+static bool busy;					//a line is being queued, answer when done
+static CommandStruct pending[MAX_PENDING];
+static uint8_t pendingCount;
+static uint8_t pendingNext;
+
+//answer waiting for room in the send buffer
+static char reply[16];
+static uint8_t replyLength;
+static uint8_t replyPos;
+
+static void SetReply(const char* text, int code) {
+	replyLength = 0;
+	while (*text) reply[replyLength++] = *text++;
+	if (code >= 0) {
+		if (code >= 10) reply[replyLength++] = '0' + (code / 10);
+		reply[replyLength++] = '0' + (code % 10);
+	}
+	reply[replyLength++] = '\r';
+	reply[replyLength++] = '\n';
+	replyPos = 0;
+}
+
+/** sends what's left of the reply. Returns true when it's gone */
+static bool FlushReply() {
+	if (replyPos < replyLength) {
+		replyPos += Upstream_SerialWrite((const uint8_t*)reply + replyPos, replyLength - replyPos);
+	}
+	return replyPos >= replyLength;
+}
+
+/** micrometers to position units, see FitsUnits */
+static int32_t ToUnits(uint8_t axis, int32_t um) {
+	return (um / 1000) * (int32_t)unitsPerMm[axis] + ((um % 1000) * (int32_t)unitsPerMm[axis]) / 1000;
+}
+
+/** position units to micrometers */
+static int32_t FromUnits(uint8_t axis, int32_t units) {
+	uint32_t magnitude = (units < 0) ? -units : units;
+	int32_t um = Fix_Divide((uint64_t)magnitude * 1000, unitsPerMm[axis]);
+	return (units < 0) ? -um : um;
+}
+
+/** returns true if a coordinate (micrometers) fits into int32 position units on an axis */
+static bool FitsUnits(uint8_t axis, int64_t um) {
+	uint64_t magnitude = (um < 0) ? -um : um;
+	return magnitude * unitsPerMm[axis] <= 0x7fffffffULL * 1000;
+}
+
+/** converts a coordinate word to micrometers. 64 bit: inches and relative moves may leave
+ the int32 range, check with FitsUnits.
+ @param inch true if the line is in inches */
+static int64_t ToMicrometers(int32_t value, bool inch) {
+	if (!inch) return value;
+	uint32_t magnitude = (value < 0) ? -value : value;
+	int64_t um = Fix_Divide((uint64_t)magnitude * 254, 10);
+	return (value < 0) ? -um : um;
+}
+
+/** heartbeats for a length (micrometers) at a feed rate (micrometers per minute). Very slow
+ feeds are capped instead of wrapping around to a short duration */
+static uint32_t Ticks(uint32_t length, uint32_t feedRate) {
+	uint64_t ticks = Fix_Divide((uint64_t)length * 60 * HEARTBEAT_HZ, feedRate);
+	return (ticks > 0xffffffff) ? 0xffffffff : ticks;
+}
+
+/** builds a MOVE_TO from the current end to a target (micrometers). Returns false for a
+ zero length move. The transaction ID is set when the line is accepted. */
+static bool MakeMove(CommandStruct* cmd, const int32_t* from, const int32_t* to, uint32_t feedRate) {
+	uint64_t lengthSqr = 0;
+	int i;
+	for (i=0; i<NUM_AXES; i++) {
+		int32_t delta = to[i] - from[i];
+		lengthSqr += (int64_t)delta * delta;
+	}
+	uint32_t length = Fix_SquareRoot(lengthSqr);
+	if (length == 0) return false;
+	cmd->command = CMD_MOVE_TO;
+	for (i=0; i<NUM_AXES; i++) cmd->args.MOVE_TO.target[i] = ToUnits(i, to[i]);
+	cmd->args.MOVE_TO.ticks = Ticks(length, feedRate);
+	return true;
+}
+
+static void AddPending(uint32_t command) {
+	pending[pendingCount++].command = command;
+}
+
+static void AddSpindle(bool on, uint32_t rpm) {
+	if (!on) rpm = 0;
+	if (rpm > GCODE_SPINDLE_MAX_RPM) rpm = GCODE_SPINDLE_MAX_RPM;
+	AddPending(CMD_SPINDLE);
+	pending[pendingCount-1].args.SPINDLE.speed = (rpm * 0xffff) / GCODE_SPINDLE_MAX_RPM;
+	pending[pendingCount-1].args.SPINDLE.ticks = 0;
+}
+
+/** builds an ARC command from position to target (micrometers). Returns 0 or an error code.
+ @param inch true if the line is in inches
+ @param feedRate micrometers per minute */
+static int MakeArc(CommandStruct* cmd, const Block* block, const int32_t* target, bool clockwise,
+				   bool inch, uint32_t feedRate) {
+	if (!(SEEN(block, 'I') || SEEN(block, 'J'))) return ERROR_INVALID_TARGET;
+	int64_t centerX = position[X] + (SEEN(block, 'I') ? ToMicrometers(block->value['I' - 'A'], inch) : 0);
+	int64_t centerY = position[Y] + (SEEN(block, 'J') ? ToMicrometers(block->value['J' - 'A'], inch) : 0);
+	if (!FitsUnits(X, centerX) || !FitsUnits(Y, centerY)) return ERROR_INVALID_TARGET;
+	int32_t center[2] = { centerX, centerY };
+	int32_t startX = position[X] - center[X];
+	int32_t startY = position[Y] - center[Y];
+	int32_t endX = target[X] - center[X];
+	int32_t endY = target[Y] - center[Y];
+	uint32_t radius = Fix_SquareRoot((int64_t)startX * startX + (int64_t)startY * startY);
+	uint32_t endRadius = Fix_SquareRoot((int64_t)endX * endX + (int64_t)endY * endY);
+	uint32_t radiusError = (radius > endRadius) ? radius - endRadius : endRadius - radius;
+	if ((radius == 0) || ((radiusError > 5) && (radiusError * 1000 > radius))) return ERROR_INVALID_TARGET;
+
+	//the duration follows from the length along the arc (helix), like for straight moves
+	uint64_t sweep = 1ULL << 32;		//full circle if it ends where it started
+	if ((endX != startX) || (endY != startY)) {
+		uint32_t startAngle = Fix_Atan2(startY, startX);
+		uint32_t endAngle = Fix_Atan2(endY, endX);
+		sweep = (uint32_t)(clockwise ? startAngle - endAngle : endAngle - startAngle);
+	}
+	uint32_t arcLength = Fix_ArcLength(radius, sweep);
+	int32_t deltaZ = target[Z] - position[Z];
+	uint32_t length = Fix_SquareRoot((uint64_t)arcLength * arcLength + (int64_t)deltaZ * deltaZ);
+
+	cmd->command = clockwise ? CMD_ARC_CW : CMD_ARC_CCW;
+	int i;
+	for (i=0; i<NUM_AXES; i++) cmd->args.ARC.target[i] = ToUnits(i, target[i]);
+	cmd->args.ARC.center[X] = ToUnits(X, center[X]);
+	cmd->args.ARC.center[Y] = ToUnits(Y, center[Y]);
+	cmd->args.ARC.ticks = Ticks(length, feedRate);
+	return 0;
+}
+
+/** queues what's left of the current line. Returns true when everything is queued. */
+static bool QueueLine() {
+	//the planner state is shared with HID commands: keep the USB interrupt out meanwhile
+	NVIC_DisableInterrupt(NVIC_USBIRQ);
+	while ((pendingNext < pendingCount) && CQ_AddCommand(&(pending[pendingNext]))) pendingNext++;
+	NVIC_EnableInterrupt(NVIC_USBIRQ);
+	return pendingNext >= pendingCount;
+}
+
+/** parses a number into thousandths, rounding the 4th decimal. Returns the number of
+ characters used, 0 if invalid. */
+static uint8_t ParseNumber(const char* text, int32_t* value) {
+	const char* start = text;
+	bool negative = false;
+	if ((*text == '-') || (*text == '+')) negative = (*text++ == '-');
+	uint32_t result = 0;
+	uint8_t digits = 0;
+	while ((*text >= '0') && (*text <= '9')) {
+		result = result * 10 + (*text++ - '0');
+		if (result > 2147482) return 0;		//doesn't fit in thousandths
+		digits++;
+	}
+	result *= 1000;
+	if (*text == '.') {
+		text++;
+		uint32_t scale = 100;
+		bool rounded = false;
+		while ((*text >= '0') && (*text <= '9')) {
+			uint8_t digit = *text++ - '0';
+			if (scale) {
+				result += digit * scale;
+				scale /= 10;
+			} else if (!rounded) {
+				if (digit >= 5) result++;
+				rounded = true;
+			}
+			digits++;
+		}
+	}
+	if (!digits) return 0;
+	*value = negative ? -(int32_t)result : (int32_t)result;
+	return text - start;
+}
+
+/** parses a line (uppercase, no spaces or comments). Returns 0 or an error code. */
+static int ParseBlock(const char* text, Block* block) {
+	block->seen = 0;
+	block->motion = -1;
+	block->dwell = false;
+	block->spindle = -1;
+	block->inches = -1;
+	block->absolute = -1;
+	while (*text) {
+		char letter = *text++;
+		if ((letter < 'A') || (letter > 'Z')) return ERROR_EXPECTED_LETTER;
+		int32_t value;
+		uint8_t used = ParseNumber(text, &value);
+		if (!used) return ERROR_BAD_NUMBER;
+		text += used;
+		if (letter == 'G') {
+			switch (value) {
+				case 0: case 1000: case 2000: case 3000:
+					if (block->motion >= 0) return ERROR_MODAL_CONFLICT;
+					block->motion = value / 1000;
+					break;
+				case 4000: block->dwell = true; break;
+				case 17000: break;
+				case 20000: block->inches = 1; break;
+				case 21000: block->inches = 0; break;
+				case 90000: block->absolute = 1; break;
+				case 91000: block->absolute = 0; break;
+				default: return ERROR_UNSUPPORTED;
+			}
+		} else if (letter == 'M') {
+			switch (value) {
+				case 3000: case 4000: block->spindle = 1; break;
+				case 2000: case 5000: case 30000: block->spindle = 0; break;
+				default: return ERROR_UNSUPPORTED;
+			}
+		} else if ((letter == 'X') || (letter == 'Y') || (letter == 'Z') || (letter == 'I') ||
+				   (letter == 'J') || (letter == 'F') || (letter == 'S') || (letter == 'P') || (letter == 'N')) {
+			block->seen |= 1 << (letter - 'A');
+			block->value[letter - 'A'] = value;
+		} else return ERROR_UNSUPPORTED;
+	}
+	return 0;
+}
+
+/** sets up the commands of a parsed line. Returns 0 or an error code. Nothing changes (modal
+ state, position, transaction IDs) unless the whole line is valid. */
+static int ExecuteBlock(const Block* block) {
+	int i;
+	const char axisLetters[NUM_AXES] = { 'X', 'Y', 'Z' };
+	bool inch = (block->inches >= 0) ? block->inches : inches;
+	bool absolute = (block->absolute >= 0) ? block->absolute : absoluteMode;
+	int8_t motion = (block->motion >= 0) ? block->motion : motionMode;
+	bool hasAxis = false;
+	int32_t target[NUM_AXES];
+	for (i=0; i<NUM_AXES; i++) {
+		target[i] = position[i];
+		if (SEEN(block, axisLetters[i])) {
+			int64_t value = ToMicrometers(block->value[axisLetters[i] - 'A'], inch);
+			if (!absolute) value += position[i];
+			if (!FitsUnits(i, value)) return ERROR_INVALID_TARGET;
+			target[i] = value;
+			hasAxis = true;
+		}
+	}
+	uint32_t feedRate = feed;
+	if (SEEN(block, 'F')) {
+		int64_t value = ToMicrometers(block->value['F' - 'A'], inch);
+		if (value <= 0) return ERROR_UNDEFINED_FEED;
+		feedRate = (value > 0xffffffff) ? 0xffffffff : value;
+	}
+	if (hasAxis && (motion >= 1) && (feedRate == 0)) return ERROR_UNDEFINED_FEED;
+	if (block->dwell && !SEEN(block, 'P')) return ERROR_MISSING_VALUE;
+	uint32_t rpm = spindleRpm;
+	if (SEEN(block, 'S')) rpm = (block->value['S' - 'A'] < 0) ? 0 : block->value['S' - 'A'] / 1000;
+	bool on = (block->spindle >= 0) ? block->spindle : spindleOn;
+
+	pendingCount = 0;
+	pendingNext = 0;
+	if (SEEN(block, 'S') || (block->spindle >= 0)) AddSpindle(on, rpm);
+	if (block->dwell) {
+		AddPending(CMD_WAIT);
+		int32_t ms = (block->value['P' - 'A'] < 0) ? 0 : block->value['P' - 'A'];
+		pending[pendingCount-1].args.WAIT.ticks = ms * (HEARTBEAT_HZ / 1000);
+	}
+	if (hasAxis) {
+		if ((motion == 2) || (motion == 3)) {
+			int error = MakeArc(&(pending[pendingCount]), block, target, motion == 2, inch, feedRate);
+			if (error) return error;
+			pendingCount++;
+		} else if (MakeMove(&(pending[pendingCount]), position, target, (motion == 0) ? GCODE_RAPID_FEED * 1000 : feedRate)) {
+			pendingCount++;
+		}
+	}
+
+	//the line is valid: take over its modal state and number its commands
+	inches = inch;
+	absoluteMode = absolute;
+	motionMode = motion;
+	feed = feedRate;
+	spindleRpm = rpm;
+	spindleOn = on;
+	for (i=0; i<NUM_AXES; i++) position[i] = target[i];
+	for (i=0; i<pendingCount; i++) pending[i].transactionId = ++transactionId;
+	return 0;
+}
+
+/** syncs our position if something else moved the machine while we were idle */
+static void SyncPosition() {
+	if (CQ_ReadAvail() || (currentCommand.command != CMD_STOP)) return;
+	int i;
+	for (i=0; i<NUM_AXES; i++) {
+		int32_t machine = currentPosition[i];
+		if (ToUnits(i, position[i]) != machine) position[i] = FromUnits(i, machine);
+	}
+}
+
+/** executes a complete line: sets up its commands and the reply */
+static void ExecuteLine() {
+	Block block;
+	int error = 0;
+	if (lineOverflow) error = ERROR_LINE_LENGTH;
+	else if (lineLength > 0) {
+		line[lineLength] = 0;
+		SyncPosition();
+		error = ParseBlock(line, &block);
+		if (!error) error = ExecuteBlock(&block);
+	}
+	lineLength = 0;
+	lineOverflow = false;
+	if (error) {
+		pendingCount = 0;
+		pendingNext = 0;
+		SetReply("error:", error);
+	} else {
+		SetReply("ok", -1);
+		busy = true;
+	}
+}
+
+void Gcode_Init() {
+	int i;
+	for (i=0; i<NUM_AXES; i++) position[i] = 0;
+	absoluteMode = true;
+	inches = false;
+	motionMode = 0;
+	feed = 0;
+	spindleRpm = 0;
+	spindleOn = false;
+	transactionId = 0;
+	busy = false;
+	pendingCount = 0;
+	pendingNext = 0;
+	inputLength = 0;
+	inputPos = 0;
+	lineLength = 0;
+	lineOverflow = false;
+	lastWasCR = false;
+	commentEnd = 0;
+	replyLength = 0;
+	replyPos = 0;
+}
+
+void Gcode_Poll() {
+	while (true) {
+		//finish the current line first: queue its commands, then answer
+		if (busy) {
+			if (!QueueLine()) return;
+			busy = false;
+		}
+		if (!FlushReply()) return;
+
+		if (inputPos >= inputLength) {
+			inputLength = Upstream_SerialRead(input, INPUT_CHUNK);
+			inputPos = 0;
+			if (!inputLength) return;
+		}
+		char c = input[inputPos++];
+		bool wasCR = lastWasCR;
+		lastWasCR = (c == '\r');
+		if ((c == '\n') && wasCR) continue;	//CR LF is one line end
+		if ((c == '\n') || (c == '\r')) {
+			commentEnd = 0;
+			ExecuteLine();
+			continue;
+		}
+		//drop spaces and comments, uppercase the rest
+		if (commentEnd) {
+			if (c == commentEnd) commentEnd = 0;
+			continue;
+		}
+		if (c <= ' ') continue;
+		if (c == '(') {
+			commentEnd = ')';
+			continue;
+		}
+		if (c == ';') {
+			commentEnd = '\n';		//the line end clears it
+			continue;
+		}
+		if ((c >= 'a') && (c <= 'z')) c -= 'a' - 'A';
+		if (lineLength < LINE_LENGTH - 1) line[lineLength++] = c;
+		else lineOverflow = true;
+	}
+}
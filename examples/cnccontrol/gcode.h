@@ -0,0 +1,23 @@
+/** G-code interpreter on the serial (CDC) interface.
+
+ Reads lines from the serial interface and queues the resulting commands. Each line is
+ answered GRBL style with "ok" once all of its commands are in the queue, or with
+ "error:<code>" (GRBL error codes). A sender may wait for each answer or keep up to
+ GCODE_RX_SIZE bytes in flight (GRBL's character counting).
+
+ Supported: G0, G1, G2, G3 (XY plane, I/J center offsets), G4 (P: seconds), G17, G20,
+ G21, G90, G91, M3, M4, M5, M2, M30, F, S, N. Numbers are parsed to thousandths, so
+ coordinates are micrometers in G21. */
+
+#ifndef _GCODE_
+#define _GCODE_
+
+#include "everykey/everykey.h"
+
+void Gcode_Init();
+
+/** reads and executes received lines as long as the queue takes their commands.
+ Call from the main loop. */
+void Gcode_Poll();
+
+#endif
@@ -4,8 +4,7 @@
 #include "state.h"
 #include "upstream.h"
 #include "downstream.h"
-
-#define SYSTICK_INTERVAL ((72000000/HEARTBEAT_HZ)-1)
+#include "gcode.h"
 
 uint32_t counter;
 
@@ -14,14 +13,21 @@ void main(void) {
 	CQ_Init();
 	Downstream_Init();
 	Upstream_Init();
+	Gcode_Init();
 
-	SYSCON_StartSystick(SYSTICK_INTERVAL);
+	Downstream_Start();
 
 	Upstream_Start();
+
+	while (true) {
+		Gcode_Poll();
+		waitForInterrupt();
+	}
 }
 
 
-void systick() {
+/* motion stage: pended by the step interrupt on every step tick */
+void ct32b1_handler() {
 	Downstream_Tick();
 	Upstream_Tick();
 }
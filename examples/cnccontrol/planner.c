@@ -0,0 +1,171 @@
+#include "planner.h"
+#include "fixmath.h"
+
+#define X 0
+#define Y 1
+#define Z 2
+
+static uint64_t Min(uint64_t a, uint64_t b) {
+	return (a < b) ? a : b;
+}
+
+/** returns a * b / c for signed a and positive b, c */
+static int32_t Scale(int32_t a, uint32_t b, uint32_t c) {
+	uint32_t magnitude = (a < 0) ? -a : a;
+	int32_t result = Fix_Divide((uint64_t)magnitude * b, c);
+	return (a < 0) ? -result : result;
+}
+
+/** sets length, slopes and directions of a straight move */
+static void InitLine(PlanBlock* block, const CommandStruct* cmd) {
+	int i;
+	uint32_t distance[NUM_AXES];
+	uint64_t sumSqr = 0;
+	for (i=0; i<NUM_AXES; i++) {
+		int32_t delta = cmd->args.MOVE_TO.target[i] - block->start[i];
+		block->direction[i] = (delta < 0) ? -1 : 1;
+		distance[i] = (delta < 0) ? -delta : delta;
+		sumSqr += (uint64_t)distance[i] * distance[i];
+	}
+	block->length = Fix_SquareRoot(sumSqr);
+	//length >= every distance, so slopes are <= 1 << 32
+	for (i=0; i<NUM_AXES; i++) {
+		block->slope[i] = block->length ? Fix_Divide(((uint64_t)distance[i]) << 32, block->length) : 0;
+	}
+}
+
+/** sets the arc geometry of an ARC command, slopes and directions are the ones at the start.
+ @return false if the start is on the center or the end is too far off the circle, the move
+ is a straight line then */
+static bool InitArc(PlanBlock* block, const CommandStruct* cmd) {
+	int32_t turn = (cmd->command == CMD_ARC_CCW) ? 1 : -1;
+	block->center[X] = cmd->args.ARC.center[X];
+	block->center[Y] = cmd->args.ARC.center[Y];
+	block->radius[X] = block->start[X] - block->center[X];
+	block->radius[Y] = block->start[Y] - block->center[Y];
+	uint32_t radius = Fix_SquareRoot((int64_t)block->radius[X] * block->radius[X] + (int64_t)block->radius[Y] * block->radius[Y]);
+	if (radius == 0) return false;
+
+	int32_t endX = cmd->args.ARC.target[X] - block->center[X];
+	int32_t endY = cmd->args.ARC.target[Y] - block->center[Y];
+	int32_t radiusChange = (int32_t)Fix_SquareRoot((int64_t)endX * endX + (int64_t)endY * endY) - (int32_t)radius;
+	uint32_t radiusError = (radiusChange < 0) ? -radiusChange : radiusChange;
+	if (radiusError > ARC_RADIUS_SLACK + radius / 1000) return false;
+	block->startAngle = Fix_Atan2(block->radius[Y], block->radius[X]);
+	uint64_t sweep = 1ULL << 32;		//full circle if it ends where it started
+	if ((endX != block->radius[X]) || (endY != block->radius[Y])) {
+		uint32_t endAngle = Fix_Atan2(endY, endX);
+		sweep = (uint32_t)((turn > 0) ? endAngle - block->startAngle : block->startAngle - endAngle);
+	}
+	uint32_t arcLength = Fix_ArcLength(radius, sweep);
+	int32_t deltaZ = cmd->args.ARC.target[Z] - block->start[Z];
+	uint32_t distanceZ = (deltaZ < 0) ? -deltaZ : deltaZ;
+	block->length = Fix_SquareRoot((uint64_t)arcLength * arcLength + (uint64_t)distanceZ * distanceZ);
+	block->arcDirection = turn;
+	if (block->length == 0) {
+		int i;
+		for (i=0; i<NUM_AXES; i++) block->slope[i] = 0;
+		return true;
+	}
+	block->angleRate = Fix_Divide(sweep << 16, block->length);
+	int64_t radiusRate = Fix_Divide(((uint64_t)radiusError) << 32, block->length);
+	block->radiusRate = (radiusChange < 0) ? -radiusRate : radiusRate;
+	block->inverseRadius = Fix_Divide(1ULL << 48, radius);
+
+	//the tangent at the start: the radius turned by 90 degrees, times the horizontal share
+	int32_t tangent[2];
+	tangent[X] = -turn * block->radius[Y];
+	tangent[Y] = turn * block->radius[X];
+	int i;
+	for (i=0; i<2; i++) {
+		uint32_t magnitude = (tangent[i] < 0) ? -tangent[i] : tangent[i];
+		block->direction[i] = (tangent[i] < 0) ? -1 : 1;
+		block->slope[i] = Fix_Divide(Fix_Divide(((uint64_t)magnitude) << 32, radius) * arcLength, block->length);
+	}
+	block->direction[Z] = (deltaZ < 0) ? -1 : 1;
+	block->slope[Z] = Fix_Divide(((uint64_t)distanceZ) << 32, block->length);
+	return true;
+}
+
+void Planner_InitBlock(PlanBlock* block, const int32_t* start, const CommandStruct* cmd) {
+	int i;
+	for (i=0; i<NUM_AXES; i++) block->start[i] = start[i];
+	block->maxEntrySpeedSqr = 0;
+	block->entrySpeedSqr = 0;
+	block->arcDirection = 0;
+	block->angleRate = 0;
+	block->radiusRate = 0;
+	bool arc = (cmd->command != CMD_MOVE_TO) && InitArc(block, cmd);
+	if (!arc) InitLine(block, cmd);
+	if (block->length == 0) {
+		block->nominalSpeed = PLANNER_MIN_SPEED;
+		block->accel = MAX_AXIS_ACCEL;
+		return;
+	}
+
+	//the host's speed: the old constant speed interpolation took ticks+1 heartbeats
+	uint32_t ticks = (cmd->command == CMD_MOVE_TO) ? cmd->args.MOVE_TO.ticks : cmd->args.ARC.ticks;
+	if (ticks > (0xffffffff / STEP_TICKS_PER_HEARTBEAT) - 1) ticks = (0xffffffff / STEP_TICKS_PER_HEARTBEAT) - 1;
+	uint64_t speed = Fix_Divide(((uint64_t)block->length) << 16, (ticks + 1) * STEP_TICKS_PER_HEARTBEAT);
+
+	if (arc) {
+		//along an arc every axis gets its turn at full speed. Half of MAX_AXIS_ACCEL goes to
+		//the path acceleration, half to the centripetal one (speed^2 / radius).
+		uint32_t radius = Fix_SquareRoot((int64_t)block->radius[X] * block->radius[X] + (int64_t)block->radius[Y] * block->radius[Y]);
+		speed = Min(speed, MAX_AXIS_SPEED);
+		speed = Min(speed, Fix_SquareRoot(((uint64_t)(MAX_AXIS_ACCEL / 2) * radius) << 16));
+		block->nominalSpeed = (speed > PLANNER_MIN_SPEED) ? speed : PLANNER_MIN_SPEED;
+		block->accel = MAX_AXIS_ACCEL / 2;
+		return;
+	}
+
+	//the fastest axis limits path speed and acceleration (slope as Q31 to fit 32 bits)
+	uint64_t maxSlope = 0;
+	for (i=0; i<NUM_AXES; i++) {
+		if (block->slope[i] > maxSlope) maxSlope = block->slope[i];
+	}
+	speed = Min(speed, Fix_Divide(((uint64_t)MAX_AXIS_SPEED) << 31, maxSlope >> 1));
+	block->nominalSpeed = (speed > PLANNER_MIN_SPEED) ? speed : PLANNER_MIN_SPEED;
+	block->accel = Fix_Divide(((uint64_t)MAX_AXIS_ACCEL) << 31, maxSlope >> 1);
+}
+
+/** returns the direction cosines (Q16) at the end of a block
+ @param end position the block ends at */
+static void ExitDirection(const PlanBlock* block, const int32_t* end, int32_t* cosine) {
+	int i;
+	for (i=0; i<NUM_AXES; i++) cosine[i] = block->direction[i] * (int32_t)(block->slope[i] >> 16);
+	if (!block->arcDirection) return;
+	//arcs: the end radius turned by 90 degrees, with the same horizontal share as at the start
+	int32_t x = end[X] - block->center[X];
+	int32_t y = end[Y] - block->center[Y];
+	uint32_t radius = Fix_SquareRoot((int64_t)x * x + (int64_t)y * y);
+	if (radius == 0) return;
+	uint32_t horizontal = Fix_SquareRoot((int64_t)cosine[X] * cosine[X] + (int64_t)cosine[Y] * cosine[Y]);
+	cosine[X] = Scale(-block->arcDirection * y, horizontal, radius);
+	cosine[Y] = Scale(block->arcDirection * x, horizontal, radius);
+}
+
+void Planner_SetJunction(PlanBlock* block, const PlanBlock* prev) {
+	if (!prev) {
+		block->maxEntrySpeedSqr = 0;
+		return;
+	}
+	//largest change of a direction cosine (Q16) across the junction
+	int32_t before[NUM_AXES];
+	ExitDirection(prev, block->start, before);
+	uint32_t maxChange = 0;
+	int i;
+	for (i=0; i<NUM_AXES; i++) {
+		int32_t after = block->direction[i] * (int32_t)(block->slope[i] >> 16);
+		uint32_t change = (before[i] > after) ? before[i] - after : after - before[i];
+		if (change > maxChange) maxChange = change;
+	}
+	uint64_t speed = Min(prev->nominalSpeed, block->nominalSpeed);
+	if (maxChange) speed = Min(speed, Fix_Divide(((uint64_t)MAX_JUNCTION_JERK) << 16, maxChange));
+	block->maxEntrySpeedSqr = (speed * speed) >> 16;
+}
+
+uint64_t Planner_EntrySpeedSqr(const PlanBlock* block, uint64_t exitSpeedSqr) {
+	uint64_t entry = exitSpeedSqr + 2 * (uint64_t)block->accel * block->length;
+	return (entry < block->maxEntrySpeedSqr) ? entry : block->maxEntrySpeedSqr;
+}
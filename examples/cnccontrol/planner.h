@@ -0,0 +1,63 @@
+/** motion planner: geometry and speed limits of queued moves */
+
+#ifndef _PLANNER_
+#define _PLANNER_
+
+#include "everykey/everykey.h"
+#include "cnctypes.h"
+#include "config.h"
+
+/* Speeds are given in position units per step tick, accelerations in position units per
+ step tick squared, both as Q16 fixed point (65536 = one position unit). Squared speeds are
+ kept as Q16 as well ((speed * speed) >> 16), so that 2 * accel * distance compares
+ directly against them. */
+
+/* Arcs (CMD_ARC_CW, CMD_ARC_CCW) turn around a center in the XY plane while Z moves
+ linearly (helix). The path position is found by rotating the start radius by
+ distance * angleRate, so rounding doesn't accumulate along the arc. An end point that is
+ slightly off the circle (rounding of the host's coordinates) is reached by growing or
+ shrinking the radius along the way, arcs that miss the circle by more than
+ ARC_RADIUS_SLACK units plus a thousandth of the radius are planned as straight lines. The rotation is only accurate to a few units, so X and Y are held
+ where they would step back against the direction the arc moves them in at that angle. */
+#define ARC_RADIUS_SLACK 64
+
+/** planned motion data of a path move (see IS_PATH_MOVE) */
+typedef struct PlanBlock {
+	int32_t start[NUM_AXES];		//position the block was planned from
+	uint32_t length;				//euclidean path length in position units (along the arc)
+	uint64_t slope[NUM_AXES];		//|delta| / length per axis, Q32 (1 << 32 = axis moves alone). Arcs: at the start
+	int32_t direction[NUM_AXES];	//+1 or -1 per axis. Arcs: at the start
+	uint32_t nominalSpeed;			//cruise speed: the host's speed, capped by MAX_AXIS_SPEED
+	uint32_t accel;					//path acceleration, keeps every axis within MAX_AXIS_ACCEL
+	uint64_t maxEntrySpeedSqr;		//junction limit to the previous block
+	uint64_t entrySpeedSqr;			//planned entry speed, set by the queue's backward pass
+	int32_t arcDirection;			//+1 counterclockwise, -1 clockwise, 0 straight line
+	int32_t center[2];				//arcs: X and Y of the center
+	int32_t radius[2];				//arcs: start relative to the center
+	uint32_t startAngle;			//arcs: binary angle of the start radius
+	uint64_t angleRate;				//arcs: binary angle per position unit of path, Q16
+	int64_t radiusRate;				//arcs: radius change per position unit of path, Q32
+	uint64_t inverseRadius;			//arcs: (1 << 48) / start radius
+} PlanBlock;
+
+/** computes the geometry and speed limits of a path move. Divides, so this is not meant
+ for the step tick path.
+ @param block block to fill
+ @param start position the move starts from
+ @param cmd MOVE_TO or ARC command. Its tick count sets the nominal speed. */
+void Planner_InitBlock(PlanBlock* block, const int32_t* start, const CommandStruct* cmd);
+
+/** sets the maximum entry speed of a block from the junction to the preceding move. The
+ speed is limited so that no axis changes its speed by more than MAX_JUNCTION_JERK.
+ @param block block to update
+ @param prev preceding block or NULL if the machine stops before this block */
+void Planner_SetJunction(PlanBlock* block, const PlanBlock* prev);
+
+/** returns the highest entry speed of a block that still allows to slow down to a given
+ exit speed within the block
+ @param block block to check
+ @param exitSpeedSqr speed at the end of the block (squared, Q16)
+ @return entry speed (squared, Q16) */
+uint64_t Planner_EntrySpeedSqr(const PlanBlock* block, uint64_t exitSpeedSqr);
+
+#endif
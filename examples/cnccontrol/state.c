@@ -3,9 +3,13 @@
 int32_t currentPosition[NUM_AXES];
 int32_t stateFlags;
 CommandStruct currentCommand;
+PlanBlock currentBlock;
 uint32_t currentCommandTicks; //number of ticks within the current command
 uint16_t spindleSpeed;
 
+everyquad encoders[NUM_AXES];
+everyquad *encoderList[NUM_AXES];
+
 void State_Init() {
 	int i;
 	for (i=0; i<NUM_AXES; i++) currentPosition[i] = 0;
@@ -13,4 +17,23 @@ void State_Init() {
 	stateFlags = State_SteppersOn | State_ImmediateMode;
 	currentCommand.command = CMD_STOP;
 	currentCommandTicks = 0;
+	if (HAS_ENCODERS) {
+		for (i=0; i<NUM_AXES; i++) {
+			everyquad_init(&(encoders[i]), encoderPins[i].portA, encoderPins[i].pinA,
+						   encoderPins[i].portB, encoderPins[i].pinB);
+			encoderList[i] = &(encoders[i]);
+			//counting edges may wait for a step pin update, but not for the motion stage
+			NVIC_SetInterruptPriority(NVIC_PIO_0 - encoderPins[i].portA, ENCODER_IRQ_PRIORITY);
+			NVIC_SetInterruptPriority(NVIC_PIO_0 - encoderPins[i].portB, ENCODER_IRQ_PRIORITY);
+		}
+	}
+}
+
+void State_GetMeasuredPosition(int32_t* positions) {
+	if (HAS_ENCODERS) {
+		everyquad_snapshot(encoderList, positions, NUM_AXES);
+	} else {
+		int i;
+		for (i=0; i<NUM_AXES; i++) positions[i] = 0;
+	}
 }
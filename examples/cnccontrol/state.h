@@ -5,6 +5,8 @@
 #include "everykey/everykey.h"
 #include "cnctypes.h"
 #include "config.h"
+#include "everyquad.h"
+#include "planner.h"
 
 
 /** current position of the machine */
@@ -16,13 +18,20 @@ extern int32_t stateFlags;
 /** the command we're currently working on */
 extern CommandStruct currentCommand;
 
+/** planned motion of currentCommand, valid if it is a MOVE_TO */
+extern PlanBlock currentBlock;
+
 /** number of ticks within the current command */
 extern uint32_t currentCommandTicks; 
 
 /** Spindle speed. 0 = no motion, 0xffff = max speed */
-uint16_t spindleSpeed;
+extern uint16_t spindleSpeed;
 
 void State_Init();
 
+/** reads the measured axis positions (encoder counts), all taken at the same time.
+ Returns zeros if HAS_ENCODERS is false. */
+void State_GetMeasuredPosition(int32_t* positions);
+
 
 #endif
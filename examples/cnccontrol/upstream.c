@@ -2,15 +2,27 @@
 #include "everykey/everykey.h"
 #include "everykey_usb/usb.h"
 #include "everykey_usb/hid.h"
+#include "everykey_usb/cdc.h"
 #include "cnctypes.h"
 #include "state.h"
 #include "cmdqueue.h"
+#include "downstream.h"
 
 #define IN_REPORT_SIZE sizeof(ResponseStruct)
-#define OUT_REPORT_SIZE sizeof(CommandStruct)
+#define OUT_REPORT_SIZE BATCH_REPORT_SIZE
 
 #define POLL_INTERVAL 3
 
+//serial interface for G-code (see gcode.h), next to the HID interface
+#define CDC_CONTROL_INTERFACE 1
+#define CDC_DATA_INTERFACE 2
+#define CDC_INTERRUPT_ENDPOINT_LOGICAL 0x82
+#define CDC_INTERRUPT_ENDPOINT_PHYSICAL 5
+#define CDC_DATA_OUT_ENDPOINT_LOGICAL 0x03
+#define CDC_DATA_OUT_ENDPOINT_PHYSICAL 6
+#define CDC_DATA_IN_ENDPOINT_LOGICAL 0x83
+#define CDC_DATA_IN_ENDPOINT_PHYSICAL 7
+
 	
 	
 	
@@ -31,9 +43,9 @@ const uint8_t deviceDescriptor[] = {
 	0x12,							//bLength: length of this structure in bytes (18)
 	USB_DESC_DEVICE,				//bDescriptorType: usb device descriptor
 	0x00, 0x02,						//bcdUSB: 0200 (Little Endian) - USB 2.0 compliant
-	USB_CLASS_DEVICE,				//bDeviceClass: Device class (0 = interfaces specify class)
-	0x00,							//bDeviceSubClass: Device subclass (must be 0 if bDeviceClass is 0)
-	0x00,							//bDeviceProtocol: 0 for no specific device-level protocols
+	0xef,							//bDeviceClass: Miscellaneous (uses interface association descriptors)
+	0x02,							//bDeviceSubClass: Common class
+	0x01,							//bDeviceProtocol: Interface association descriptor
 	USB_MAX_COMMAND_PACKET_SIZE,	//bMaxPacketSize0: Max packet size for control endpoint
 	0x34, 0x12,                     //idVendor: 16 bit vendor id
 	0x78, 0x56,                     //idProduct: 16 bit product id
@@ -63,8 +75,8 @@ const uint8_t reportDescriptor[] = {
 const uint8_t configDescriptor[] = {
 	0x09,								//bLength: length of this descriptor in bytes (9)
 	USB_DESC_CONFIGURATION,				//bDescriptorType: configuration descriptor
-	I16_TO_LE_BA(34),					//wTotalLen: Total length, including attached interface and endpoint descriptors
-	0x01,								//bNumInterfaces: Number of interfaces (1)
+	I16_TO_LE_BA(100),					//wTotalLen: Total length, including attached interface and endpoint descriptors
+	0x03,								//bNumInterfaces: Number of interfaces (3)
 	0x01,								//bConfigurationValue: Number to set to activate this config
 	0x00,								//iConfiguration: configuration string index (0 = not available)
 	0x80,								//bmAttributes: Not self-powered, no remote wakeup
@@ -96,7 +108,89 @@ const uint8_t configDescriptor[] = {
 	0x81,								//bEndpointAddress: Logical endpoint 1, direction IN
 	USB_EPTYPE_INTERRUPT,				//bmAttributesL: Interrput endpoint
 	I16_TO_LE_BA(IN_REPORT_SIZE),		//wMaxPacketSize
-	POLL_INTERVAL						//bInterval: Poll interval in ms
+	POLL_INTERVAL,						//bInterval: Poll interval in ms
+
+	// Interface association: interfaces 1 and 2 form the serial port
+	0x08,								//bLength: length of this descriptor in bytes (8)
+	USB_DESC_INTERFACE_ASSOCIATION,		//bDescriptorType: interface association descriptor
+	CDC_CONTROL_INTERFACE,				//bFirstInterface
+	0x02,								//bInterfaceCount
+	USB_CDC_INTERFACE_COMMUNICATION_INTERFACE,	//bFunctionClass: CDC comm
+	USB_CDC_SUBCLASS_ABSTRACT_CONTROL_MODEL,	//bFunctionSubClass
+	USB_CDC_CI_PROTOCOL_NONE,			//bFunctionProtocol
+	0x00,								//iFunction: String index (0x00 = not available)
+
+	// Interface 1: CDC control
+	0x09,								//bLength: length of this descriptor in bytes (9)
+	USB_DESC_INTERFACE,					//bDescriptorType: interface descriptor
+	CDC_CONTROL_INTERFACE,				//bInterfaceNumber: Interface index, 0-based
+	0x00,								//bAlternateSetting
+	0x01,								//bNumEndpoints: One interrupt endpoint
+	USB_CDC_INTERFACE_COMMUNICATION_INTERFACE,	//bInterfaceClass: CDC comm
+	USB_CDC_SUBCLASS_ABSTRACT_CONTROL_MODEL,	//bInterfaceSubClass
+	USB_CDC_CI_PROTOCOL_NONE,			//bInterfaceProtocol
+	0x00,								//iInterface: String index (0x00 = not available)
+
+	// Header functional descriptor
+	0x05,								//bLength
+	0x24,								//bDescriptorType: Class-specific (0x20) + interface (0x04)
+	USB_CDC_HEADER_FUNC_DESC,			//bDescriptorSubtype
+	I16_TO_LE_BA(0x0110),				//bcdCDC
+
+	// Call management functional descriptor
+	0x05,								//bLength
+	0x24,								//bDescriptorType: Class-specific (0x20) + interface (0x04)
+	USB_CDC_CALL_MGMT_FUNC_DESC,		//bDescriptorSubtype
+	0x01,								//bmCapabilities (call management is done by device)
+	CDC_DATA_INTERFACE,					//bDataInterface
+
+	// ACM functional descriptor
+	0x04,								//bLength
+	0x24,								//bDescriptorType: Class-specific (0x20) + interface (0x04)
+	USB_CDC_ABSTRACT_CONTROL_MODEL_FUNC_DESC,	//bDescriptorSubtype
+	0x02,								//bmCapabilities (set control line state, set/get line coding)
+
+	// Union functional descriptor
+	0x05,								//bLength
+	0x24,								//bDescriptorType: Class-specific (0x20) + interface (0x04)
+	USB_CDC_UNION_FUNC_DESC,			//bDescriptorSubtype
+	CDC_CONTROL_INTERFACE,				//bMasterInterface
+	CDC_DATA_INTERFACE,					//bSlaveInterface0
+
+	// Endpoint descriptor: notifications
+	0x07,								//bLength: Length of endpoint descriptor in bytes
+	USB_DESC_ENDPOINT,					//bDescriptorType: This is an endpoint descriptor
+	CDC_INTERRUPT_ENDPOINT_LOGICAL,		//bEndpointAddress
+	USB_EPTYPE_INTERRUPT,				//bmAttributes: Interrupt endpoint
+	I16_TO_LE_BA(0x0010),				//wMaxPacketSize
+	0x02,								//bInterval: 2ms
+
+	// Interface 2: CDC data
+	0x09,								//bLength: length of this descriptor in bytes (9)
+	USB_DESC_INTERFACE,					//bDescriptorType: interface descriptor
+	CDC_DATA_INTERFACE,					//bInterfaceNumber: Interface index, 0-based
+	0x00,								//bAlternateSetting
+	0x02,								//bNumEndpoints: data in and out
+	USB_CDC_INTERFACE_DATA_INTERFACE,	//bInterfaceClass: CDC data
+	0x00,								//bInterfaceSubClass
+	USB_CDC_DI_PROTOCOL_NONE,			//bInterfaceProtocol
+	0x00,								//iInterface: String index (0x00 = not available)
+
+	// Endpoint descriptor: data out
+	0x07,								//bLength: Length of endpoint descriptor in bytes
+	USB_DESC_ENDPOINT,					//bDescriptorType: This is an endpoint descriptor
+	CDC_DATA_OUT_ENDPOINT_LOGICAL,		//bEndpointAddress
+	USB_EPTYPE_BULK,					//bmAttributes: Bulk endpoint
+	I16_TO_LE_BA(USB_MAX_BULK_DATA_SIZE),	//wMaxPacketSize
+	0x00,								//bInterval
+
+	// Endpoint descriptor: data in
+	0x07,								//bLength: Length of endpoint descriptor in bytes
+	USB_DESC_ENDPOINT,					//bDescriptorType: This is an endpoint descriptor
+	CDC_DATA_IN_ENDPOINT_LOGICAL,		//bEndpointAddress
+	USB_EPTYPE_BULK,					//bmAttributes: Bulk endpoint
+	I16_TO_LE_BA(USB_MAX_BULK_DATA_SIZE),	//wMaxPacketSize
+	0x00								//bInterval
 };
 
 const uint8_t languages[] = {
@@ -144,21 +238,58 @@ const USBHID_Behaviour_Struct hidBehaviour = {
 	&currentProtocol
 };
 
+// USB CDC state
+USB_CDC_Linecoding_Struct currentLineCoding;
+uint8_t serialRxBuffer[sizeof(RingBufferDynamic) + GCODE_RX_SIZE];
+uint8_t serialTxBuffer[sizeof(RingBufferDynamic) + GCODE_TX_SIZE];
+bool serialIdle;
+uint8_t controlLineState;
+
+const USBCDC_Behaviour_Struct cdcBehaviour = {
+	MAKE_USBCDC_BASE_BEHAVIOUR,
+	NULL,	//break callback
+	NULL,	//line coding change callback
+	NULL,	//idle change callback
+	NULL,	//control line change callback
+	NULL,	//data available callback
+	{ 115200, USB_CDC_LINECODING_STOP_1, USB_CDC_PARITY_NONE, 8},	//defaultLineCoding
+	&currentLineCoding,
+	{ GCODE_RX_SIZE, (RingBufferDynamic*)serialRxBuffer },
+	{ GCODE_TX_SIZE, (RingBufferDynamic*)serialTxBuffer },
+	&serialIdle,
+	&controlLineState,
+	CDC_CONTROL_INTERFACE,
+	CDC_DATA_INTERFACE,
+	CDC_DATA_IN_ENDPOINT_PHYSICAL,
+	CDC_DATA_OUT_ENDPOINT_PHYSICAL,
+	CDC_INTERRUPT_ENDPOINT_PHYSICAL
+};
+
 const USB_Device_Definition usbDeviceDefinition = {
 	deviceDescriptor,
 	1,
 	{ configDescriptor },
 	4,
 	{ languages, manufacturerName, deviceName, serialName },
-	1,
-	{ (USB_Behaviour_Struct*)(&hidBehaviour) }
+	2,
+	{ (USB_Behaviour_Struct*)(&hidBehaviour), (USB_Behaviour_Struct*)(&cdcBehaviour) }
 };
 
 uint32_t tickCounter;
 
+//base of compact moves (see MoveDeltaStruct)
+uint32_t lastReceivedId;
+int32_t deltaBase[NUM_AXES];
+bool deltaBaseValid;
+
 void Upstream_Init() {
+	USBCDC_ResetBehaviour(&cdcBehaviour);
 	USB_Init(&usbDeviceDefinition, &usbDevice);
-	tickCounter;
+	//commands are planned in the USB interrupt, don't let that delay the motion stage
+	NVIC_SetInterruptPriority(NVIC_USBIRQ, USB_IRQ_PRIORITY);
+	lastReceivedId = 0;
+	deltaBaseValid = false;
+	tickCounter = 0;
 }
 
 void Upstream_Start() {
@@ -166,9 +297,17 @@ void Upstream_Start() {
 }
 
 
+uint16_t Upstream_SerialRead(uint8_t* buffer, uint16_t maxLen) {
+	return USBCDC_ReadBytes(&usbDevice, &cdcBehaviour, buffer, maxLen);
+}
+
+uint16_t Upstream_SerialWrite(const uint8_t* buffer, uint16_t len) {
+	return USBCDC_WriteBytes(&usbDevice, &cdcBehaviour, (uint8_t*)buffer, len);
+}
+
 void Upstream_Tick() {
 	tickCounter++;
-	if (tickCounter > ((HEARTBEAT_HZ * (POLL_INTERVAL+1)) / 1000 + 1)) {
+	if (tickCounter > ((STEP_HZ * (POLL_INTERVAL+1)) / 1000 + 1)) {
 		tickCounter = 0;
 		USBHID_PushReport (&usbDevice, &hidBehaviour, USB_HID_REPORTTYPE_INPUT, 0);
 	}
@@ -183,8 +322,11 @@ uint16_t returnStatus(USB_Device_Struct* device,
 		((ResponseStruct*)inBuffer)->currentPos[i] = currentPosition[i];
 	}
 	((ResponseStruct*)inBuffer)->stateFlags = stateFlags;
-	((ResponseStruct*)inBuffer)->freeSlots = CQ_EmptySlots(&(((ResponseStruct*)inBuffer)->lastTransactionId));
+	((ResponseStruct*)inBuffer)->credits = CQ_EmptySlots(&(((ResponseStruct*)inBuffer)->lastTransactionId));
 	((ResponseStruct*)inBuffer)->spindleSpeed = spindleSpeed;
+	State_GetMeasuredPosition(((ResponseStruct*)inBuffer)->measuredPos);
+	((ResponseStruct*)inBuffer)->queueLength = CQ_LENGTH - 1;
+	((ResponseStruct*)inBuffer)->stepJitter = Downstream_StepJitter();
 	return IN_REPORT_SIZE;
 }
 
@@ -195,8 +337,38 @@ void receiveCommand(USB_Device_Struct* device,
 					uint16_t len) {
 	if (reportId != 0) return;
 	if (reportType != USB_HID_REPORTTYPE_OUTPUT) return;
-	CQ_AddCommand((CommandStruct*)outBuffer);
-	
+	if (len > OUT_REPORT_SIZE) len = OUT_REPORT_SIZE;
+	uint16_t pos = 0;
+	while (pos < len) {
+		uint8_t op = outBuffer[pos++];
+		CommandStruct cmd;
+		if ((op == BATCH_COMMAND) && (pos + sizeof(CommandStruct) <= len)) {
+			memmove(&cmd, outBuffer + pos, sizeof(CommandStruct));
+			pos += sizeof(CommandStruct);
+		} else if ((op == BATCH_MOVE_DELTA) && (pos + sizeof(MoveDeltaStruct) <= len)) {
+			const MoveDeltaStruct* move = (const MoveDeltaStruct*)(outBuffer + pos);
+			int i;
+			cmd.transactionId = lastReceivedId + 1;
+			cmd.command = CMD_MOVE_TO;
+			for (i=0; i<NUM_AXES; i++) {
+				cmd.args.MOVE_TO.target[i] = (deltaBaseValid ? deltaBase[i] : currentPosition[i]) + move->delta[i];
+			}
+			cmd.args.MOVE_TO.ticks = move->ticks;
+			pos += sizeof(MoveDeltaStruct);
+		} else break;	//BATCH_END, unknown or truncated entry
+
+		if (!CQ_AddCommand(&cmd)) break;	//keep order: drop the rest, the host resends
+		lastReceivedId = cmd.transactionId;
+		if (IS_PATH_MOVE(cmd.command)) {
+			memmove(deltaBase, cmd.args.MOVE_TO.target, sizeof(deltaBase));
+			deltaBaseValid = true;
+		} else if (cmd.command < IMMEDIATE_SEPARATOR) {
+			//the machine may still be on its way (MOVE_TO_IMM) or not homed yet (SET_HOME):
+			//continue from where the queue plans the next move, not from currentPosition
+			CQ_PlannedEnd(deltaBase);
+			deltaBaseValid = true;
+		}
+	}
 }
 
 
@@ -1,13 +1,24 @@
-/** Upstream interface (HID to master) for CNC control */
+/** Upstream interface (HID to master) for CNC control, plus a serial (CDC) interface for
+ G-code */
 
 #ifndef _UPSTREAM_
 #define _UPSTREAM_
 
+#include "everykey/everykey.h"
+
 void Upstream_Init();
 void Upstream_Start();
 
 void Upstream_Tick();	
 
+/** reads received serial data. Don't call from the USB interrupt.
+ @return number of bytes read */
+uint16_t Upstream_SerialRead(uint8_t* buffer, uint16_t maxLen);
+
+/** queues serial data for sending. Don't call from the USB interrupt.
+ @return number of bytes actually queued, less than len if the send buffer is full */
+uint16_t Upstream_SerialWrite(const uint8_t* buffer, uint16_t len);
+
 
 
 
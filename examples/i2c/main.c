@@ -21,49 +21,35 @@ void sleep(uint32_t len) {
 //--- Blocking I2C ---
 //--------------------
 
-/** the following block implements blocking I2C transactions and retries. The API is asynchronous,
-calls a callback when a transaction finished (on success and failure). The blocking approach is
-not very elegant but simple to use. Note that we need to timeout to avoid blocking the processor -
-Adjust the defined values depending on your peripheral's speed and transfer length. */
+/** the following block implements blocking I2C transactions. The API is asynchronous: Transactions
+are queued and executed back-to-back from the I2C interrupt, each one reports its result in its status
+field and via an optional completion callback. Waiting for that is not very elegant but simple to use.
+Note that we need to timeout to avoid blocking the processor - Adjust the defined value depending on
+your peripheral's speed and transfer length. */
 
-#define I2C_START_MAX_RETRIES 1000
 #define I2C_FINISH_MAX_RETRIES 1000000
 
-/** variable to carry back the transaction result from callback interrupt to main thread */
-volatile int i2cSyncStatus = 0;
-
-/** callback when a I2C transaction succeeded */
-void I2C_SyncReadCompletionHandler(uint32_t refcon, I2C_STATUS status) {
-	i2cSyncStatus = status;
+/** waits for a submitted transaction to finish */
+I2C_STATUS I2C_WaitSync(I2C_Transaction* transaction) {
+	int retries;
+	for (retries = 0; retries < I2C_FINISH_MAX_RETRIES; retries++) {
+		if (transaction->status != I2C_STATUS_BUSY) return transaction->status;
+	}
+	I2C_CancelTransaction();
+	return I2C_STATUS_TIMEOUT;
 }
 
-/** Blocking I2C transaction with retries */
+/** Blocking I2C transaction */
 I2C_STATUS I2C_WriteReadSync( uint8_t addr,
 							uint16_t writeLen,
 							uint8_t* writeBuf,
 							uint16_t readLen,
 							uint8_t* readBuf) {
-	i2cSyncStatus = -1;
-	int retries;
-	I2C_STATUS status;
-
-	//Try to start transaction
-	for (retries = 0; retries < I2C_START_MAX_RETRIES; retries++) {
-		status = I2C_WriteRead(addr, writeLen, writeBuf, readLen, readBuf, I2C_SyncReadCompletionHandler, 0);
-		if (status == I2C_STATUS_OK) break;
-	}		
-
-	//If start succeeded, wait for finish
-	if (status == I2C_STATUS_OK) {
-		status = I2C_STATUS_TIMEOUT;	//return this if we didn't finish
-		for (retries = 0; retries < I2C_FINISH_MAX_RETRIES; retries++) {
-			if (i2cSyncStatus >= 0) {
-				status = (I2C_STATUS)i2cSyncStatus;
-				break;
-			}
-		}
-	}
-	return status;
+	I2C_Transaction transaction;
+	transaction.status = I2C_STATUS_OK;
+	I2C_STATUS status = I2C_SubmitWriteRead(&transaction, addr, writeLen, writeBuf, readLen, readBuf, 0, NULL, 0);
+	if (status != I2C_STATUS_OK) return status;
+	return I2C_WaitSync(&transaction);
 }
 
 //-----------------------------
@@ -154,30 +140,29 @@ uint8_t TCS3471_GetStatus() {
 	return TCS3471_ReadRegister(TCS3471_STATUS);
 }
 
-/** reads the sampled crgb (c=clear) brightness values */
+/** reads the sampled crgb (c=clear) brightness values. All four reads are queued at once and run
+back-to-back on the bus, we only wait for the last one. */
 bool TCS3471_GetColors(uint16_t* c, uint16_t* r, uint16_t* g, uint16_t* b) {
 	uint8_t status = TCS3471_GetStatus();
 	if (!(status & 1)) return false; //comm error or no valid sample
-	uint8_t val[2] = {0,0};
-	if (c) {
-		I2C_STATUS status = TCS3471_ReadRegisters(TCS3471_CDATA, 2, val);
-		if (status != I2C_STATUS_OK) return false;	//comm error
-		*c = val[1]<<8 | val[0];
-	}
-	if (r) {
-		I2C_STATUS status = TCS3471_ReadRegisters(TCS3471_RDATA, 2, val);
-		if (status != I2C_STATUS_OK) return false;	//comm error
-		*r = val[1]<<8 | val[0];
-	}
-	if (g) {
-		I2C_STATUS status = TCS3471_ReadRegisters(TCS3471_GDATA, 2, val);
-		if (status != I2C_STATUS_OK) return false;	//comm error
-		*g = val[1]<<8 | val[0];
+	static const uint8_t cmds[4] = {
+		0xa0 | TCS3471_CDATA, 0xa0 | TCS3471_RDATA, 0xa0 | TCS3471_GDATA, 0xa0 | TCS3471_BDATA
+	};
+	uint16_t* results[4] = { c, r, g, b };
+	uint8_t vals[4][2];
+	I2C_Transaction transactions[4];
+	int i;
+	for (i = 0; i < 4; i++) {
+		transactions[i].status = I2C_STATUS_OK;
+		if (I2C_SubmitWriteRead(&(transactions[i]), TCS3471_I2C_ID, 1, &(cmds[i]), 2, vals[i], 0, NULL, 0) != I2C_STATUS_OK) {
+			if (i > 0) I2C_WaitSync(&(transactions[i-1]));
+			return false;
+		}
 	}
-	if (b) {
-		I2C_STATUS status = TCS3471_ReadRegisters(TCS3471_BDATA, 2, val);
-		if (status != I2C_STATUS_OK) return false;	//comm error
-		*b = val[1]<<8 | val[0];
+	if (I2C_WaitSync(&(transactions[3])) != I2C_STATUS_OK) return false;	//comm error
+	for (i = 0; i < 4; i++) {
+		if (transactions[i].status != I2C_STATUS_OK) return false;	//comm error
+		if (results[i]) *(results[i]) = vals[i][1]<<8 | vals[i][0];
 	}
 	return true;
 }
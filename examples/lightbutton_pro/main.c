@@ -33,6 +33,8 @@
 // error such as division by 0 or trying to access an illegal portion of
 // memory.
 
+void button_pressed(uint8_t port, uint8_t pin);
+
 void main(void) {	
 	
 
@@ -90,39 +92,38 @@ void main(void) {
 	// a rising edge. This means that the interrupt is triggered when the
 	// button is released.
 
-	every_gpio_set_interrupt_mode(INT1_PORT, INT1_PIN, TRIGGER_FALLING_EDGE);	
-	every_gpio_set_interrupt_mode(INT2_PORT, INT2_PIN, TRIGGER_RISING_EDGE);	
-
-	// Only to more steps: we need to tell the processor to activate the
-	// interrupt ...
-	NVIC_EnableInterrupt(NVIC_PIO_0);
-	// This activates the interrupt for ALL of port 0, since both of
-	// our button pins are grouped in this port, we only have to write a
-	// single routine.
+	// Mechanical buttons don't switch cleanly: the contacts bounce for a
+	// few milliseconds, which looks like a quick series of edges. So we
+	// let the library take care of that: after each edge, the pin is
+	// ignored for 20ms. The library needs a timer for that, we give it
+	// CT16B0 (see the `ct16b0_handler` below).
+	every_gpio_debounce_init(CT16B0);
+
+	// Finally, we tell the library which function to call when an edge
+	// arrives on a pin. This also activates the interrupt for the pin's
+	// port in the processor.
+	every_gpio_attach_interrupt(INT1_PORT, INT1_PIN, TRIGGER_FALLING_EDGE, button_pressed, 20);
+	every_gpio_attach_interrupt(INT2_PORT, INT2_PIN, TRIGGER_RISING_EDGE, button_pressed, 20);
 }
 
-// When the IO interrupt is triggered, the processor looks for a
-// function called `gpio<PORT>_handler` and runs that. (Have a look at
+// When an IO interrupt is triggered, the processor looks for a function
+// called `gpio<PORT>_handler` and runs that. (Have a look at
 // `everykey/startup.c` to see where these function names are defined.)
+// The library's version of that function finds out which pin caused the
+// interrupt and calls the function we attached to that pin. You can
+// still write your own `gpio0_handler` if you want to do this yourself.
 
-void gpio0_handler(void) {
-	// because this handler function is called for ALL interrupts trigger
-	// by PORT 0, we need a way to find out which pin actually triggered
-	// it. 
-	uint32_t mask = every_gpio_get_interrupt_mask(INT1_PORT);
-
-	// the bits set in this mask correspond to the pin that triggered the
-	// interrupt. In this example, we won't actually use the value,
-	// so we'll go ahead and clear the mask:
-	every_gpio_clear_interrupt_mask(INT1_PORT, mask);
-
-	// Finally, we toggle the value of the LED.
+void button_pressed(uint8_t port, uint8_t pin) {
+	// we get the port and pin, so we could do different things for
+	// each button. Here, we just toggle the value of the LED.
 	bool val = every_gpio_read(LED_PORT, LED_PIN);
 	every_gpio_write(LED_PORT, LED_PIN, !val);
 
-	// In this example, we're not actually using the mask, but try
-	// this excercise: change the handler function to only toggle the LED
-	// after both buttons have been pressed. 
-	//
-	// HINT: don't reset the mask after each interrupt...
-} 
+	// Try this excercise: change the function to only toggle the LED
+	// after both buttons have been pressed.
+}
+
+// the debounce timer's interrupt, passed on to the library
+void ct16b0_handler(void) {
+	every_gpio_debounce_timer_handler();
+}
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Captures from the logiccapture example and writes a VCD file.
+
+Arms the capture (optionally with an edge trigger), receives the run-length
+encoded record stream until the device stops, the time limit is reached or
+Ctrl-C is pressed, and converts it to a Value Change Dump for GTKWave,
+PulseView, etc. A raw stream saved with --raw can be converted again later
+with --input. Live capture requires pyusb (pip install pyusb). See main.c for
+the stream format.
+
+usage: logic2vcd.py [-t rising|falling|both] [-p PIN] [-s SECONDS] [--raw FILE] OUT.vcd
+       logic2vcd.py --input FILE OUT.vcd
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+VENDOR_ID = 0x1234
+PRODUCT_ID = 0x567a
+DATA_IN_ENDPOINT = 0x83
+READ_SIZE = 64 * 64
+
+REQUEST_ARM = 1
+REQUEST_STOP = 2
+TRIGGERS = {"none": 0, "rising": 1, "falling": 2, "both": 3}
+
+PIN_BITS = 12
+MARKER = 0x80000000
+MARK_START = 0
+MARK_MASK = 1
+MARK_STOP = 2
+MARK_OVERFLOW = 3
+
+CAPTURE_PORT = 2
+
+
+def capture(args, raw):
+    """reads the record stream from the device. Returns the raw bytes."""
+    import usb.core
+    import usb.util
+
+    dev = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+    if dev is None:
+        sys.exit("device not found")
+    dev.set_configuration()
+    req_type = usb.util.build_request_type(usb.util.CTRL_OUT, usb.util.CTRL_TYPE_VENDOR,
+                                           usb.util.CTRL_RECIPIENT_INTERFACE)
+    dev.ctrl_transfer(req_type, REQUEST_ARM, TRIGGERS[args.trigger] | (args.pin << 8), 0)
+    print("armed (trigger: %s on P%d.%d)" % (args.trigger, CAPTURE_PORT, args.pin))
+
+    data = bytearray()
+    start = time.monotonic()
+    stopping = False
+    while True:
+        try:
+            if not stopping and args.seconds and time.monotonic() - start > args.seconds:
+                dev.ctrl_transfer(req_type, REQUEST_STOP, 0, 0)
+                stopping = True
+            try:
+                chunk = dev.read(DATA_IN_ENDPOINT, READ_SIZE, timeout=200)
+            except usb.core.USBTimeoutError:
+                continue
+            data.extend(chunk)
+            if raw:
+                raw.write(chunk)
+            if ends_capture(data):
+                break
+        except KeyboardInterrupt:
+            if stopping:
+                break
+            dev.ctrl_transfer(req_type, REQUEST_STOP, 0, 0)
+            stopping = True
+    return bytes(data)
+
+
+def ends_capture(data):
+    """true if the last complete record is a stop or overflow marker"""
+    n = len(data) - (len(data) % 4)
+    if n < 4:
+        return False
+    (record,) = struct.unpack_from("<I", data, n - 4)
+    return (record & MARKER) and ((record >> 24) & 0x7f) in (MARK_STOP, MARK_OVERFLOW)
+
+
+def decode(data):
+    """yields (tick, pin state) for each run, plus the sample rate, pin mask and end reason"""
+    rate = None
+    mask = (1 << PIN_BITS) - 1
+    reason = "end of data"
+    tick = 0
+    runs = []
+    for (record,) in struct.iter_unpack("<I", data[:len(data) - (len(data) % 4)]):
+        if record & MARKER:
+            mark = (record >> 24) & 0x7f
+            arg = record & 0xffffff
+            if mark == MARK_START:
+                rate = arg
+                tick = 0
+                runs = []
+            elif mark == MARK_MASK:
+                mask = arg
+            elif mark == MARK_STOP:
+                reason = "stopped"
+            elif mark == MARK_OVERFLOW:
+                reason = "buffer overflow"
+            continue
+        runs.append((tick, record & ((1 << PIN_BITS) - 1)))
+        tick += record >> PIN_BITS
+    if rate is None:
+        sys.exit("no capture start found in stream")
+    return runs, tick, rate, mask, reason
+
+
+def vcd_id(pin):
+    return chr(33 + pin)
+
+
+def write_vcd(out, runs, end_tick, rate, mask):
+    pins = [p for p in range(PIN_BITS) if mask & (1 << p)]
+    # tick duration in ns, exact for rates dividing 1 GHz
+    ns_per_tick = 1e9 / rate
+    out.write("$date %s $end\n" % time.strftime("%Y-%m-%d %H:%M:%S"))
+    out.write("$version logic2vcd (everykey logiccapture, %d Hz) $end\n" % rate)
+    out.write("$timescale 1 ns $end\n")
+    out.write("$scope module P%d $end\n" % CAPTURE_PORT)
+    for p in pins:
+        out.write("$var wire 1 %s P%d_%d $end\n" % (vcd_id(p), CAPTURE_PORT, p))
+    out.write("$upscope $end\n$enddefinitions $end\n")
+    last = None
+    for tick, state in runs:
+        changed = [p for p in pins if last is None or ((state ^ last) >> p) & 1]
+        if changed:
+            out.write("#%d\n" % round(tick * ns_per_tick))
+            for p in changed:
+                out.write("%d%s\n" % ((state >> p) & 1, vcd_id(p)))
+        last = state
+    out.write("#%d\n" % round(end_tick * ns_per_tick))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="VCD file to write")
+    parser.add_argument("-t", "--trigger", choices=sorted(TRIGGERS), default="none", help="trigger edge")
+    parser.add_argument("-p", "--pin", type=int, default=0, help="trigger pin on the captured port")
+    parser.add_argument("-s", "--seconds", type=float, default=0, help="stop after this time (0: until Ctrl-C)")
+    parser.add_argument("--raw", help="also save the raw record stream to this file")
+    parser.add_argument("--input", help="convert a saved raw stream instead of capturing")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input, "rb") as f:
+            data = f.read()
+    else:
+        raw = open(args.raw, "wb") if args.raw else None
+        data = capture(args, raw)
+        if raw:
+            raw.close()
+
+    runs, end_tick, rate, mask, reason = decode(data)
+    with open(args.output, "w") as out:
+        write_vcd(out, runs, end_tick, rate, mask)
+    print("%d runs, %.6f s at %d Hz (%s)" % (len(runs), end_tick / rate, rate, reason))
+    return 1 if reason == "buffer overflow" else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,328 @@
+#include "everykey/everykey.h"
+#include "everykey_usb/usb.h"
+
+/* Turns the Everykey into a simple logic analyzer for GPIO port 2. A timer samples the
+ whole port (GPIO[port].DATA) at a fixed rate. Runs of identical samples are collapsed
+ into one record on the fly, so RAM only fills up with transitions, not with time. The
+ records are streamed to the host over a vendor-specific bulk IN endpoint while the
+ capture is running. Use logic2vcd.py to capture and convert the stream to VCD.
+
+ The host arms the capture with a vendor request. Capture starts right away or when a
+ trigger pin (on the captured port) sees the selected edge, using the port's GPIO
+ interrupt. It runs until the host stops it or until the host doesn't keep up with
+ fetching records and the buffer overflows.
+
+ Stream format: little endian 32 bit records.
+   bit 31 = 0: sample record. bits 0..11: pin state, bits 12..30: number of sample
+               ticks the state lasted.
+   bit 31 = 1: marker record. bits 24..30: marker type (LOGIC_MARK_...), bits 0..23:
+               argument. */
+
+#define CAPTURE_PORT 2
+#define CAPTURE_MASK 0x0fff		//pins to capture (all of them)
+
+/* timer interrupt per sample tick: 500 kHz leaves the CPU enough room for USB */
+#define SAMPLE_RATE 500000
+#define SAMPLE_TIMER CT32B1
+
+/* 4 bytes per transition: 1024 transitions */
+#define RECORD_RING_SIZE 4096
+
+#define LOGIC_RECORD_SIZE 4
+#define LOGIC_PIN_BITS 12
+#define LOGIC_MAX_RUN 0x7ffff
+#define LOGIC_MARKER 0x80000000
+
+/* space kept free for the final sample and the stop marker */
+#define LOGIC_RESERVE (2 * LOGIC_RECORD_SIZE)
+
+typedef enum {
+	LOGIC_MARK_START = 0,		//capture started. argument: sample rate in Hz
+	LOGIC_MARK_MASK = 1,		//argument: captured pins
+	LOGIC_MARK_STOP = 2,		//capture stopped by the host
+	LOGIC_MARK_OVERFLOW = 3		//capture stopped because the buffer was full
+} LOGIC_MARK;
+
+/* vendor requests to the interface, no data phase */
+typedef enum {
+	LOGIC_REQUEST_ARM = 1,		//wValueL: trigger mode (every_gpio_interrupt_mode, TRIGGER_NONE starts immediately), wValueH: trigger pin
+	LOGIC_REQUEST_STOP = 2		//stop capture, flush remaining records
+} LOGIC_REQUEST;
+
+typedef enum {
+	LOGIC_IDLE = 0,
+	LOGIC_ARMED,
+	LOGIC_CAPTURING
+} LOGIC_STATE;
+
+#define DATA_IN_ENDPOINT_LOGICAL 0x83
+#define DATA_IN_ENDPOINT_PHYSICAL 7
+
+const uint8_t deviceDescriptor[] = {
+	18,                             //bLength: length of this structure in bytes (18)
+	USB_DESC_DEVICE,                //bDescriptorType: usb device descriptor
+	I16_TO_LE_BA(0x0200),           //bcdUSB: 0200 - USB 2.0 compliant
+	0x00,                           //bDeviceClass: Device class (0 = interfaces specify class)
+	0x00,                           //bDeviceSubClass: Device subclass (must be 0 if bDeviceClass is 0)
+	0x00,                           //bDeviceProtocol: 0 for no specific device-level protocols
+	USB_MAX_COMMAND_PACKET_SIZE,    //bMaxPacketSize0: Max packet size for control endpoint
+	I16_TO_LE_BA(0x1234),           //idVendor: 16 bit vendor id
+	I16_TO_LE_BA(0x567a),           //idProduct: 16 bit product id
+	I16_TO_LE_BA(0x0100),           //bcdDevice: Device release version
+	0x01,                           //iManufacturer: Manufacturer string index
+	0x02,                           //iProduct: Product string index
+	0x03,                           //iSerialNumber: Serial number string index
+	0x01                            //bNumConfigurations: Number of configurations
+};
+
+const uint8_t languages[] = {
+	0x04,                           //bLength: length of this descriptor in bytes (4)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	0x09,0x04                       //wLangID[]: An array of 16 bit language codes (LE). 0x0409: English (US)
+};
+
+const uint8_t manufacturerName[] = {
+	0x22,                           //bLength: length of this descriptor in bytes (34)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	'P',0,'r',0,'e',0,'s',0,'s',0,' ',0,'A',0,'n',0,'y',0,' ',0,'K',0,'e',0,'y',0,' ',0,'U',0,'G',0	//bString[]: String (UTF16LE, not terminated)
+};
+
+const uint8_t deviceName[] = {
+	0x1e,                           //bLength: length of this descriptor in bytes (30)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	'E',0,'v',0,'e',0,'r',0,'y',0,'K',0,'e',0,'y',0,' ',0,'L',0,'o',0,'g',0,'i',0,'c',0
+};
+
+const uint8_t serialName[] = {
+	0x0a,                           //bLength: length of this descriptor in bytes (10)
+	USB_DESC_STRING,                //bDescriptorType: string descriptor
+	'V',0,'1',0,'.',0,'0',0         //bString[]: String (UTF16LE, not terminated)
+};
+
+const uint8_t configDescriptor[] = {
+	0x09,                           //bLength: length of this descriptor in bytes (9)
+	USB_DESC_CONFIGURATION,         //bDescriptorType: configuration descriptor
+	I16_TO_LE_BA(0x19),             //wTotalLen: Total length, including attached interface and endpoint descriptors
+	0x01,                           //bNumInterfaces: Number of interfaces (1)
+	0x01,                           //bConfigurationValue: Number to set to activate this config
+	0x00,                           //iConfiguration: configuration string index (0 = not available)
+	0x80,                           //bmAttributes: Not self-powered, no remote wakeup
+	0x32,                           //bMaxPower: Max power in 2mA steps (0x32 = 50 = 100mA)
+
+	//interface 0
+	0x09,                           //bLength: length of this descriptor in bytes (9)
+	USB_DESC_INTERFACE,             //bDescriptor type: constant indicating that this is an interface descriptor
+	0x00,                           //bInterfaceNumber: Interface index, 0-based
+	0x00,                           //bAlternateSetting
+	0x01,                           //bNumEndpoints: Number of endpoints excluding control endpoint
+	0xff,                           //bInterfaceClass: interface class (0xff = vendor specific)
+	0x00,                           //bInterfaceSubClass
+	0xff,                           //bInterfaceProtocol (0xff = vendor specific)
+	0x00,                           //iInterface: String index (0x00 = not available)
+
+	//endpoint 3: capture data in (physical index: 7, double-buffered)
+	7,                              //bLength
+	USB_DESC_ENDPOINT,              //bDescriptorType
+	DATA_IN_ENDPOINT_LOGICAL,       //bEndpointAddress
+	USB_EPTYPE_BULK,                //bmAttributes
+	I16_TO_LE_BA(USB_MAX_BULK_DATA_SIZE),   //wMaxPacketSize
+	0                               //bInterval
+};
+
+uint8_t recordMem[sizeof(RingBufferDynamic) + RECORD_RING_SIZE];
+const RingBufferStatic recordBuffer = { RECORD_RING_SIZE, (RingBufferDynamic*)recordMem };
+
+/* capture state. Records are produced either by the sample timer interrupt (while
+ capturing) or by whoever changes the state (while the timer is stopped). */
+typedef struct {
+	volatile LOGIC_STATE state;
+	uint8_t triggerPin;
+	uint32_t last;				//pin state of the current run
+	uint32_t run;				//sample ticks of the current run
+} LogicCapture;
+
+LogicCapture capture;
+volatile bool endpointIdle = false;	//set when the endpoint had free buffers but nothing to send
+
+USB_Device_Struct usbDevice;
+
+/** appends a record. Sample records keep LOGIC_RESERVE bytes free so that the
+ final sample and the stop marker always fit.
+ @param record record to append
+ @param reserve number of bytes that must remain free afterwards
+ @return true if the record was appended, false if the buffer is full */
+static bool Logic_Emit(uint32_t record, uint16_t reserve) {
+	uint8_t* data;
+	if (RingBufferWriteBytesAvailable(&recordBuffer) < LOGIC_RECORD_SIZE + reserve) return false;
+	RingBufferPeekWrite(&recordBuffer, &data);	//records never wrap: ring size is a multiple of the record size
+	*((uint32_t*)data) = record;
+	RingBufferCommitWrite(&recordBuffer, LOGIC_RECORD_SIZE);
+	return true;
+}
+
+static void Logic_Mark(LOGIC_MARK mark, uint32_t arg) {
+	Logic_Emit(LOGIC_MARKER | (mark << 24) | arg, 0);
+}
+
+/** ends the capture: stops the timer, flushes the current run and appends a marker */
+static void Logic_Stop(LOGIC_MARK mark) {
+	Timer_Stop(SAMPLE_TIMER);
+	NVIC_DisableInterrupt(NVIC_CT16B0 + SAMPLE_TIMER);
+	every_gpio_set_interrupt_mode(CAPTURE_PORT, capture.triggerPin, TRIGGER_NONE);
+	if ((capture.state == LOGIC_CAPTURING) && (capture.run > 0)) {
+		Logic_Emit(capture.last | (capture.run << LOGIC_PIN_BITS), LOGIC_RECORD_SIZE);
+	}
+	if (capture.state != LOGIC_IDLE) Logic_Mark(mark, 0);
+	capture.state = LOGIC_IDLE;
+}
+
+static void Logic_Start() {
+	Logic_Mark(LOGIC_MARK_START, SAMPLE_RATE);
+	Logic_Mark(LOGIC_MARK_MASK, CAPTURE_MASK);
+	capture.last = LOGIC_MARKER;	//no pin state: the first tick starts a run without emitting
+	capture.run = 0;
+	capture.state = LOGIC_CAPTURING;
+	Timer_Reset(SAMPLE_TIMER);
+	Timer_Start(SAMPLE_TIMER);
+	NVIC_EnableInterrupt(NVIC_CT16B0 + SAMPLE_TIMER);
+}
+
+/** arms the capture.
+ @param mode trigger mode. TRIGGER_NONE starts immediately, level modes are not supported.
+ @param pin trigger pin on CAPTURE_PORT
+ @return true if armed, false if the parameters are invalid */
+static bool Logic_Arm(every_gpio_interrupt_mode mode, uint8_t pin) {
+	if ((mode > TRIGGER_BOTH_EDGES) || (pin >= LOGIC_PIN_BITS)) return false;
+	Logic_Stop(LOGIC_MARK_STOP);
+	RingBufferInit(&recordBuffer);
+	capture.triggerPin = pin;
+	if (mode == TRIGGER_NONE) {
+		Logic_Start();
+	} else {
+		capture.state = LOGIC_ARMED;
+		every_gpio_clear_interrupt_mask(CAPTURE_PORT, 1 << pin);
+		every_gpio_set_interrupt_mode(CAPTURE_PORT, pin, mode);
+		NVIC_EnableInterrupt(NVIC_PIO_0 - CAPTURE_PORT);
+	}
+	return true;
+}
+
+/* trigger: the interrupt of CAPTURE_PORT */
+void gpio2_handler(void) {
+	every_gpio_clear_interrupt_mask(CAPTURE_PORT, every_gpio_get_interrupt_mask(CAPTURE_PORT));
+	if (capture.state != LOGIC_ARMED) return;
+	every_gpio_set_interrupt_mode(CAPTURE_PORT, capture.triggerPin, TRIGGER_NONE);
+	Logic_Start();
+}
+
+/* sample tick. Runs at SAMPLE_RATE, so registers are accessed directly */
+void ct32b1_handler(void) {
+	TIMER[SAMPLE_TIMER].IR = TIMER_MR0INT;
+	uint32_t value = GPIO[CAPTURE_PORT].DATA & CAPTURE_MASK;
+	if ((value == capture.last) && (capture.run < LOGIC_MAX_RUN)) {
+		capture.run++;
+		return;
+	}
+	if (capture.run > 0) {
+		if (!Logic_Emit(capture.last | (capture.run << LOGIC_PIN_BITS), LOGIC_RESERVE)) {
+			Logic_Stop(LOGIC_MARK_OVERFLOW);
+			return;
+		}
+	}
+	capture.last = value;
+	capture.run = 1;
+}
+
+bool LogicControlSetupHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	USB_Setup_Packet* req = &(device->currentCommand);
+	if (req->bmRequestType != (USB_RT_TYPE_VENDOR | USB_RT_RECIPIENT_INTERFACE | USB_RT_DIR_HOST_TO_DEVICE)) return false;
+	if (req->wIndexL != 0) return false;
+	//keep the sample timer from producing records while we change the state
+	NVIC_DisableInterrupt(NVIC_CT16B0 + SAMPLE_TIMER);
+	bool handled = false;
+	switch (req->bRequest) {
+		case LOGIC_REQUEST_ARM:
+			handled = Logic_Arm(req->wValueL, req->wValueH);
+			break;
+		case LOGIC_REQUEST_STOP:
+			Logic_Stop(LOGIC_MARK_STOP);
+			handled = true;
+			break;
+		default:
+			break;
+	}
+	if (capture.state == LOGIC_CAPTURING) NVIC_EnableInterrupt(NVIC_CT16B0 + SAMPLE_TIMER);
+	endpointIdle = true;
+	return handled;
+}
+
+bool LogicEndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
+	if (epIdx != DATA_IN_ENDPOINT_PHYSICAL) return false;
+	uint8_t freeBuffers = USB_EP_GetFreeBuffers(device, epIdx);
+	while (freeBuffers > 0) {
+		uint16_t avail = RingBufferReadBytesAvailable(&recordBuffer);
+		//send full packets while capturing, flush the rest when done
+		if ((avail == 0) || ((avail < USB_MAX_BULK_DATA_SIZE) && (capture.state != LOGIC_IDLE))) break;
+		const uint8_t* block;
+		uint16_t len = RingBufferPeekRead(&recordBuffer, &block);
+		if (len > USB_MAX_BULK_DATA_SIZE) len = USB_MAX_BULK_DATA_SIZE;
+		USB_EP_Write(device, epIdx, block, len);
+		RingBufferCommitRead(&recordBuffer, len);
+		freeBuffers--;
+	}
+	endpointIdle = (freeBuffers > 0);
+	return true;
+}
+
+void LogicConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	Logic_Stop(LOGIC_MARK_STOP);
+	RingBufferInit(&recordBuffer);
+	endpointIdle = true;
+}
+
+const USB_Behaviour_Struct logicBehaviour = {
+	LogicControlSetupHandler,
+	LogicEndpointDataHandler,
+	NULL,
+	NULL,
+	LogicConfigChangeHandler
+};
+
+const USB_Device_Definition usbDefinition = {
+	deviceDescriptor,
+	1,
+	{ configDescriptor },
+	4,
+	{ languages, manufacturerName, deviceName, serialName },
+	1,
+	{ (USB_Behaviour_Struct*)(&logicBehaviour) }
+};
+
+void main(void) {
+	uint8_t pin;
+	for (pin = 0; pin < LOGIC_PIN_BITS; pin++) {
+		if (CAPTURE_MASK & (1 << pin)) every_gpio_set_dir(CAPTURE_PORT, pin, INPUT);
+	}
+
+	//sample clock: interrupt and restart every 1/SAMPLE_RATE s
+	Timer_Enable(SAMPLE_TIMER, true);
+	Timer_Stop(SAMPLE_TIMER);
+	Timer_SetPrescale(SAMPLE_TIMER, 0);
+	Timer_SetMatchValue(SAMPLE_TIMER, 0, (72000000 / SAMPLE_RATE) - 1);
+	Timer_SetMatchBehaviour(SAMPLE_TIMER, 0, TIMER_MATCH_INTERRUPT | TIMER_MATCH_RESET);
+	//sampling must not be held up by USB processing
+	NVIC_SetInterruptPriority(NVIC_CT16B0 + SAMPLE_TIMER, 0);
+	NVIC_SetInterruptPriority(NVIC_USBIRQ, 32);
+
+	USB_Init(&usbDefinition, &usbDevice);
+	USB_SoftConnect(&usbDevice);
+
+	while (1) {
+		uint16_t avail = RingBufferReadBytesAvailable(&recordBuffer);
+		if (endpointIdle && ((avail >= USB_MAX_BULK_DATA_SIZE) || ((avail > 0) && (capture.state == LOGIC_IDLE)))) {
+			endpointIdle = false;
+			USB_EP_TriggerInterrupt(&usbDevice, DATA_IN_ENDPOINT_PHYSICAL);
+		}
+		waitForInterrupt();
+	}
+}
@@ -5,10 +5,10 @@
 #define DATA_INTERFACE 1
 #define INTERRUPT_ENDPOINT_LOGICAL 0x82
 #define INTERRUPT_ENDPOINT_PHYSICAL 5
-#define DATA_OUT_ENDPOINT_LOGICAL 0x01
-#define DATA_OUT_ENDPOINT_PHYSICAL 2
-#define DATA_IN_ENDPOINT_LOGICAL 0x81
-#define DATA_IN_ENDPOINT_PHYSICAL 3
+#define DATA_OUT_ENDPOINT_LOGICAL 0x03
+#define DATA_OUT_ENDPOINT_PHYSICAL 6
+#define DATA_IN_ENDPOINT_LOGICAL 0x83
+#define DATA_IN_ENDPOINT_PHYSICAL 7
 #define FIFO_SIZE 2048
 
 // usb specific device descriptor which will be assmbled into a
@@ -122,7 +122,7 @@ const uint8_t configDescriptor[] = {
 	USB_CDC_DI_PROTOCOL_NONE,       //bInterfaceProtocol
 	0x00,                           //iInterface: String index (0x00 = not available)
 	
-	//endpoint 1: data out (physical index: 2)
+	//endpoint 3: data out (physical index: 6, double-buffered)
 	7,                              //bLength
 	USB_DESC_ENDPOINT,              //bDescriptorType
 	DATA_OUT_ENDPOINT_LOGICAL,      //bEndpointAddress
@@ -130,7 +130,7 @@ const uint8_t configDescriptor[] = {
 	I16_TO_LE_BA(USB_MAX_BULK_DATA_SIZE),   //wMaxPacketSize
 	0,                              //bInterval
 
-	//endpoint 2: data in (physical index: 3)
+	//endpoint 3: data in (physical index: 7, double-buffered)
 	7,                              //bLength
 	USB_DESC_ENDPOINT,              //bDescriptorType
 	DATA_IN_ENDPOINT_LOGICAL,       //bEndpointAddress
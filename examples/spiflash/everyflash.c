@@ -0,0 +1 @@
+../../libs/everyflash/everyflash.c
\ No newline at end of file
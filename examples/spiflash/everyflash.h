@@ -0,0 +1 @@
+../../libs/everyflash/everyflash.h
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "everykey/everykey.h"
 #include "everykey_usb/usb.h"
+#include "everyflash.h"
 
 const uint8_t deviceDescriptor[] = {
 	0x12,							//bLength: length of this structure in bytes (18)
@@ -78,46 +79,11 @@ USB_Device_Struct myUSBDevice;
 #define FLASHSEL_PORT 2
 #define FLASHSEL_PIN 4
 
-#define SPIFLASH_CMD_GETSTATUS 0x05
-#define SPIFLASH_CMD_GETJEDECID 0x9f
-#define SPIFLASH_STATUS_BUSY 0x01
-#define MAX_BUSY_RETRIES 100000000
+everyflash flash;
 
-
-void delay (uint32_t duration) {
-	volatile uint32_t wait;
-	for (wait = 0; wait < duration; wait++) { NOP }
-}
-
-void SPIFLASH_Init() {
-	every_gpio_set_dir(FLASHSEL_PORT, FLASHSEL_PIN, OUTPUT);
-	every_gpio_write(FLASHSEL_PORT, FLASHSEL_PIN, true);	//deselect chip (low active)
-	SSP_Init(4, 8, SSP_CR0_FRF_SPI, true, true, true);
-}
-
-bool SPIFLASH_WaitReady() {
-	uint32_t retries;
-	bool busy;
-	for (retries = 0; retries < MAX_BUSY_RETRIES; retries++) {
-		every_gpio_write(FLASHSEL_PORT, FLASHSEL_PIN, false);	// start talking to chip
-		SSP_Transfer(SPIFLASH_CMD_GETSTATUS);
-		uint16_t status = SSP_Transfer(0x00);
-		every_gpio_write (FLASHSEL_PORT, FLASHSEL_PIN, true);	// stop talking to chip
-		busy = (status & SPIFLASH_STATUS_BUSY);
-		if (!busy) break;
-		delay(100000);
-	}
-	return !busy;
-}
-
-uint32_t SPIFLASH_ReadDeviceId() {
-	every_gpio_write(FLASHSEL_PORT, FLASHSEL_PIN, false);	// start talking to chip
-	SSP_Transfer(SPIFLASH_CMD_GETJEDECID);					// write command JEDEC Device ID
-	uint8_t manufacturerId = SSP_Transfer(0x00);			// Read return
-	uint8_t memoryType = SSP_Transfer(0x00);				// Read return
-	uint8_t capacity = SSP_Transfer(0x00);					// Read return
-	every_gpio_write(FLASHSEL_PORT, FLASHSEL_PIN, true);	// stop talking to chip
-	return (manufacturerId << 16) | (memoryType << 8) | capacity;
+/** the flash driver polls the chip's busy state from this timer */
+void ct32b1_handler(void) {
+	everyflash_timer_handler(&flash);
 }
 
 uint8_t	NibbleToHexChar(uint8_t value) {
@@ -135,12 +101,11 @@ void main(void) {
 	every_gpio_set_dir(LED_PORT, LED_PIN, OUTPUT);
 	every_gpio_write(LED_PORT, LED_PIN, true);
 	
-	SPIFLASH_Init();
-	SPIFLASH_WaitReady();
+	everyflash_init(&flash, FLASHSEL_PORT, FLASHSEL_PIN, 4, CT32B1);
 
 	every_gpio_write(LED_PORT, LED_PIN, false);
 
-	uint32_t deviceId = SPIFLASH_ReadDeviceId();
+	uint32_t deviceId = everyflash_read_id(&flash);
 	
 	versionString[ 0] = 14;
 	versionString[ 1] = USB_DESC_STRING;
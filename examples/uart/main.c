@@ -4,32 +4,45 @@
 #define LED_PORT 0
 #define LED_PIN 7
 
+#define UART_FIFO_SIZE 256
 
+uint8_t uartTxMem[sizeof(RingBufferDynamic) + UART_FIFO_SIZE];
+uint8_t uartRxMem[sizeof(RingBufferDynamic) + UART_FIFO_SIZE];
+
+const RingBufferStatic uartTxBuffer = { UART_FIFO_SIZE, (RingBufferDynamic*)uartTxMem };
+const RingBufferStatic uartRxBuffer = { UART_FIFO_SIZE, (RingBufferDynamic*)uartRxMem };
 
 everycdc cdc;
 
-void main(void) {	
+void main(void) {
 	everycdc_init(&cdc);
 
 	every_gpio_set_dir(LED_PORT, LED_PIN, OUTPUT);
 	every_gpio_write(LED_PORT, LED_PIN, false);
 	UART_Init(9600, 8, UART_PARITY_NONE, 1, false, NULL);
+	RingBufferInit(&uartTxBuffer);
+	RingBufferInit(&uartRxBuffer);
+	UART_SetBuffers(&uartTxBuffer, &uartRxBuffer);
 
 	while (1) {
 		uint8_t ch;
 		int b = everycdc_read_byte(&cdc);
 		if (b > 0) {
 			ch = b;
-			while (!UART_Write(&ch,1)) {};
+			while (!UART_WriteBuffered(&ch,1)) {};
 			if (ch == 0x0d) {	//convert CR to CRLF
 				ch = 0x0a;
-				while (!UART_Write(&ch,1)) {};
+				while (!UART_WriteBuffered(&ch,1)) {};
 			}
 			every_gpio_write(LED_PORT, LED_PIN, !every_gpio_read(LED_PORT,LED_PIN));
 		}
 
-		if (UART_Read(&ch, 1)) {
-			while (!everycdc_write_byte(&cdc, ch)) {};
+		uint8_t buf[64];
+		uint16_t len = UART_ReadBuffered(buf, sizeof(buf));
+		if (len > 0) {
+			uint16_t written = 0;
+			while (written < len) written += everycdc_write(&cdc, buf + written, len - written);
+			everycdc_flush(&cdc);
 			every_gpio_write(LED_PORT, LED_PIN, !every_gpio_read(LED_PORT,LED_PIN));
 		}
 	}
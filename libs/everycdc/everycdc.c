@@ -5,10 +5,10 @@
 #define DATA_INTERFACE 1
 #define INTERRUPT_ENDPOINT_LOGICAL 0x82
 #define INTERRUPT_ENDPOINT_PHYSICAL 5
-#define DATA_OUT_ENDPOINT_LOGICAL 0x01
-#define DATA_OUT_ENDPOINT_PHYSICAL 2
-#define DATA_IN_ENDPOINT_LOGICAL 0x81
-#define DATA_IN_ENDPOINT_PHYSICAL 3
+#define DATA_OUT_ENDPOINT_LOGICAL 0x03
+#define DATA_OUT_ENDPOINT_PHYSICAL 6
+#define DATA_IN_ENDPOINT_LOGICAL 0x83
+#define DATA_IN_ENDPOINT_PHYSICAL 7
 #define FIFO_SIZE 2048
 
 
@@ -123,7 +123,7 @@ const uint8_t configDescriptor[] = {
 	USB_CDC_DI_PROTOCOL_NONE,       //bInterfaceProtocol
 	0x00,                           //iInterface: String index (0x00 = not available)
 	
-	//endpoint 1: data out (physical index: 2)
+	//endpoint 3: data out (physical index: 6, double-buffered)
 	7,                              //bLength
 	USB_DESC_ENDPOINT,              //bDescriptorType
 	DATA_OUT_ENDPOINT_LOGICAL,      //bEndpointAddress
@@ -131,7 +131,7 @@ const uint8_t configDescriptor[] = {
 	I16_TO_LE_BA(USB_MAX_BULK_DATA_SIZE),   //wMaxPacketSize
 	0,                              //bInterval
 
-	//endpoint 2: data in (physical index: 3)
+	//endpoint 3: data in (physical index: 7, double-buffered)
 	7,                              //bLength
 	USB_DESC_ENDPOINT,              //bDescriptorType
 	DATA_IN_ENDPOINT_LOGICAL,       //bEndpointAddress
@@ -187,6 +187,7 @@ void everycdc_init(everycdc *cdc) {
 	cdc->everycdc_behaviour  = &cdcBehaviour;
 	cdc->everycdc_device_def = &usbDefinition;
 	cdc->everycdc_device     = &cdcDevice;
+	cdc->everycdc_flush_pending = false;
 
 	USBCDC_ResetBehaviour(cdc->everycdc_behaviour);
 	USB_Init(cdc->everycdc_device_def, cdc->everycdc_device);
@@ -220,4 +221,51 @@ bool everycdc_write_byte(everycdc *cdc, uint8_t byte) {
 }
 
 
+uint16_t everycdc_read(everycdc *cdc, uint8_t* buf, uint16_t maxLen) {
+	return USBCDC_ReadBytes(cdc->everycdc_device, cdc->everycdc_behaviour, buf, maxLen);
+}
+
+uint16_t everycdc_write(everycdc *cdc, const uint8_t* buf, uint16_t len) {
+	const RingBufferStatic* rb = &(cdc->everycdc_behaviour->deviceToHostBuffer);
+	uint16_t written = RingBufferWriteBuffer(rb, buf, len);
+	if (written > 0) cdc->everycdc_flush_pending = true;
+	// buffer is full: no point in waiting for a flush, get it moving
+	if (written < len) everycdc_flush(cdc);
+	return written;
+}
+
+void everycdc_flush(everycdc *cdc) {
+	if (!cdc->everycdc_flush_pending) return;
+	cdc->everycdc_flush_pending = false;
+	USB_EP_TriggerInterrupt(cdc->everycdc_device, cdc->everycdc_behaviour->dataInEndpoint);
+}
+
+uint16_t everycdc_peek(everycdc *cdc, const uint8_t** data) {
+	return RingBufferPeekRead(&(cdc->everycdc_behaviour->hostToDeviceBuffer), data);
+}
 
+void everycdc_consume(everycdc *cdc, uint16_t len) {
+	if (len == 0) return;
+	RingBufferCommitRead(&(cdc->everycdc_behaviour->hostToDeviceBuffer), len);
+	// we've freed some space, let the OUT endpoint accept more data
+	USB_EP_TriggerInterrupt(cdc->everycdc_device, cdc->everycdc_behaviour->dataOutEndpoint);
+}
+
+uint16_t everycdc_line_length(everycdc *cdc) {
+	int32_t idx = RingBufferIndexOf(&(cdc->everycdc_behaviour->hostToDeviceBuffer), '\n');
+	return (idx < 0) ? 0 : idx + 1;
+}
+
+uint16_t everycdc_read_line(everycdc *cdc, char* buf, uint16_t maxLen) {
+	if (maxLen < 2) return 0;
+	uint16_t len = everycdc_line_length(cdc);
+	if ((len == 0) && (RingBufferWriteBytesAvailable(&(cdc->everycdc_behaviour->hostToDeviceBuffer)) == 0)) {
+		// receive buffer is full without a line end - hand out what we have, the line can't complete otherwise
+		len = maxLen - 1;
+	}
+	if (len == 0) return 0;
+	if (len > maxLen - 1) len = maxLen - 1;
+	len = everycdc_read(cdc, (uint8_t*)buf, len);
+	buf[len] = 0;
+	return len;
+}
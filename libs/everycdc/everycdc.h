@@ -17,6 +17,7 @@ typedef struct everycdc {
   const USBCDC_Behaviour_Struct *everycdc_behaviour;
   const USB_Device_Definition   *everycdc_device_def;
   USB_Device_Struct       *everycdc_device; 
+  bool                    everycdc_flush_pending;
 } everycdc;
 
 // prepare CDC for use.
@@ -30,4 +31,37 @@ int everycdc_read_byte(everycdc*);
 // indicates whether the value could be written.
 bool everycdc_write_byte(everycdc*, uint8_t);
 
+// read up to `maxLen` bytes from the CDC serial stream into `buf`.
+// returns the number of bytes actually read (0 if none available).
+uint16_t everycdc_read(everycdc*, uint8_t* buf, uint16_t maxLen);
+
+// queue up to `len` bytes for sending. Data is sent once
+// `everycdc_flush` is called (or when the buffer runs full), so
+// consecutive writes share a single USB interrupt. returns the number
+// of bytes actually queued.
+uint16_t everycdc_write(everycdc*, const uint8_t* buf, uint16_t len);
+
+// start sending everything queued by `everycdc_write`.
+void everycdc_flush(everycdc*);
+
+// zero-copy read access: points `data` to the next received bytes and
+// returns how many of them can be read there in one go (0 if none).
+// Nothing is removed until `everycdc_consume` is called.
+uint16_t everycdc_peek(everycdc*, const uint8_t** data);
+
+// remove `len` bytes (as returned by `everycdc_peek`) from the
+// receive buffer.
+void everycdc_consume(everycdc*, uint16_t len);
+
+// returns the length of the first complete line in the receive buffer
+// (including the terminating `\n`) or 0 if no complete line has
+// arrived yet. Use `everycdc_read` to fetch it.
+uint16_t everycdc_line_length(everycdc*);
+
+// read one complete line (including `\n`) into `buf` and terminate it
+// with 0. If the line doesn't fit, `maxLen`-1 bytes of it are returned
+// and the rest follows with the next call. returns the number of bytes
+// read, 0 if no complete line is available.
+uint16_t everycdc_read_line(everycdc*, char* buf, uint16_t maxLen);
+
 #endif
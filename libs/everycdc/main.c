@@ -12,23 +12,33 @@ void main(void) {
 	every_gpio_write  (LED, false);
 
 	while(true) {
-		int b;
-		if ( -1 !=  (b = everycdc_read_byte(&cdc)) ) {
-			uint8_t ch = b & 0xff;
-			++counter;
+		uint8_t buf[64];
+		uint16_t len = everycdc_read(&cdc, buf, sizeof(buf));
+		if (len > 0) {
+			uint16_t i;
+			for (i = 0; i < len; i++) {
+				uint8_t ch = buf[i];
+				++counter;
+				
+				if ((ch >= 'a') && (ch <= 'z')) ch -= 'a'-'A';
+				else if ((ch >= 'A') && (ch <= 'Z')) ch += 'a'-'A';
+				if ((ch == 'a') || (ch == 'A')) ch = '4';
+				if ((ch == 'i') || (ch == 'I')) ch = '1';
+				if ((ch == 'o') || (ch == 'O')) ch = '0';
+				if ((ch == 'e') || (ch == 'E')) ch = '3';
+				if ((ch == 'l') || (ch == 'L')) ch = '7';
+				if (ch == 's') ch = 'z';
+				if (ch == 'S') ch = 'Z';
+
+				buf[i] = ch;
+			}
 			every_gpio_write(LED, counter & 1);
-			
-			if ((ch >= 'a') && (ch <= 'z')) ch -= 'a'-'A';
-			else if ((ch >= 'A') && (ch <= 'Z')) ch += 'a'-'A';
-			if ((ch == 'a') || (ch == 'A')) ch = '4';
-			if ((ch == 'i') || (ch == 'I')) ch = '1';
-			if ((ch == 'o') || (ch == 'O')) ch = '0';
-			if ((ch == 'e') || (ch == 'E')) ch = '3';
-			if ((ch == 'l') || (ch == 'L')) ch = '7';
-			if (ch == 's') ch = 'z';
-			if (ch == 'S') ch = 'Z';
 
-			everycdc_write_byte(&cdc, ch);
+			uint16_t written = 0;
+			while (written < len) {
+				written += everycdc_write(&cdc, buf + written, len - written);
+			}
+			everycdc_flush(&cdc);
 		}
 	}
 }
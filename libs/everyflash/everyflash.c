@@ -0,0 +1,188 @@
+
+#include "everyflash.h"
+
+#define CMD_WRITE_ENABLE   0x06
+#define CMD_READ_STATUS    0x05
+#define CMD_PAGE_PROGRAM   0x02
+#define CMD_FAST_READ      0x0b
+#define CMD_SECTOR_ERASE   0x20
+#define CMD_BLOCK_ERASE    0xd8
+#define CMD_JEDEC_ID       0x9f
+
+#define STATUS_BUSY        0x01
+
+// busy polling interval in microseconds. Page programs take about 1ms,
+// sector erases 50ms and more, so this doesn't have to be very short.
+#define POLL_INTERVAL_US   100
+// give up if the chip isn't ready after this number of polls (4 s)
+#define MAX_POLL_TICKS     40000
+
+// everyflash_op values
+#define OP_IDLE            0
+#define OP_PROGRAM         1
+#define OP_ERASE           2
+
+
+static void everyflash_select(everyflash *flash, bool select) {
+	every_gpio_write(flash->everyflash_cs_port, flash->everyflash_cs_pin, !select);	// low active
+}
+
+// sends a command with 24 bit address and leaves the chip selected
+static void everyflash_command_addr(everyflash *flash, uint8_t cmd, uint32_t addr) {
+	uint8_t buf[4] = { cmd, (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff };
+	everyflash_select(flash, true);
+	SSP_TransferBlock(buf, NULL, 4, NULL);
+}
+
+static void everyflash_write_enable(everyflash *flash) {
+	uint8_t cmd = CMD_WRITE_ENABLE;
+	everyflash_select(flash, true);
+	SSP_TransferBlock(&cmd, NULL, 1, NULL);
+	everyflash_select(flash, false);
+}
+
+static bool everyflash_chip_busy(everyflash *flash) {
+	uint8_t cmd = CMD_READ_STATUS;
+	uint8_t status;
+	everyflash_select(flash, true);
+	SSP_TransferBlock(&cmd, NULL, 1, NULL);
+	SSP_TransferBlock(NULL, &status, 1, NULL);
+	everyflash_select(flash, false);
+	return (status & STATUS_BUSY);
+}
+
+// issues the next page program or erase command of the current
+// operation. returns false if there's nothing left to do.
+static bool everyflash_next_step(everyflash *flash) {
+	uint32_t remaining = flash->everyflash_remaining;
+	if (remaining == 0) return false;
+	uint32_t addr = flash->everyflash_addr;
+	uint32_t len;
+	everyflash_write_enable(flash);
+	if (flash->everyflash_op == OP_PROGRAM) {
+		// a page program wraps around within the page: split at the boundary
+		len = EVERYFLASH_PAGE_SIZE - (addr & (EVERYFLASH_PAGE_SIZE - 1));
+		if (len > remaining) len = remaining;
+		everyflash_command_addr(flash, CMD_PAGE_PROGRAM, addr);
+		SSP_TransferBlock(flash->everyflash_data, NULL, len, NULL);
+		flash->everyflash_data += len;
+	} else {
+		bool block = ((addr & (EVERYFLASH_BLOCK_SIZE - 1)) == 0) && (remaining >= EVERYFLASH_BLOCK_SIZE);
+		len = block ? EVERYFLASH_BLOCK_SIZE : EVERYFLASH_SECTOR_SIZE;
+		everyflash_command_addr(flash, block ? CMD_BLOCK_ERASE : CMD_SECTOR_ERASE, addr);
+	}
+	everyflash_select(flash, false);	// deselecting starts the internal operation
+	flash->everyflash_addr = addr + len;
+	flash->everyflash_remaining = remaining - len;
+	flash->everyflash_ticks = 0;
+	return true;
+}
+
+static void everyflash_finish(everyflash *flash, bool success) {
+	Timer_Stop(flash->everyflash_timer);
+	flash->everyflash_op = OP_IDLE;
+	if (flash->everyflash_callback) flash->everyflash_callback(flash, success);
+}
+
+static bool everyflash_start(everyflash *flash, uint8_t op, uint32_t addr, const uint8_t* data, uint32_t len, everyflash_callback callback) {
+	if (everyflash_busy(flash)) return false;
+	if (len == 0) {
+		if (callback) callback(flash, true);
+		return true;
+	}
+	flash->everyflash_op = op;
+	flash->everyflash_addr = addr;
+	flash->everyflash_data = data;
+	flash->everyflash_remaining = len;
+	flash->everyflash_callback = callback;
+	everyflash_next_step(flash);
+	Timer_Reset(flash->everyflash_timer);
+	Timer_Start(flash->everyflash_timer);
+	return true;
+}
+
+void everyflash_init(everyflash *flash, uint8_t cs_port, uint8_t cs_pin, uint8_t clock_div, TimerId timer) {
+	flash->everyflash_cs_port = cs_port;
+	flash->everyflash_cs_pin = cs_pin;
+	flash->everyflash_timer = timer;
+	flash->everyflash_op = OP_IDLE;
+	flash->everyflash_streaming = false;
+	flash->everyflash_callback = NULL;
+
+	every_gpio_set_dir(cs_port, cs_pin, OUTPUT);
+	everyflash_select(flash, false);
+	SSP_Init(clock_div, 8, SSP_CR0_FRF_SPI, true, true, true);
+
+	// polling timer: 1 MHz count, interrupt and restart every POLL_INTERVAL_US
+	Timer_Enable(timer, true);
+	Timer_Stop(timer);
+	Timer_SetPrescale(timer, 71);
+	Timer_SetMatchValue(timer, 0, POLL_INTERVAL_US);
+	Timer_SetMatchBehaviour(timer, 0, TIMER_MATCH_INTERRUPT | TIMER_MATCH_RESET);
+	NVIC_EnableInterrupt(NVIC_CT16B0 + timer);
+}
+
+uint32_t everyflash_read_id(everyflash *flash) {
+	if (everyflash_busy(flash)) return 0;
+	uint8_t cmd = CMD_JEDEC_ID;
+	uint8_t id[3];	// manufacturer id, memory type, capacity
+	everyflash_select(flash, true);
+	SSP_TransferBlock(&cmd, NULL, 1, NULL);
+	SSP_TransferBlock(NULL, id, 3, NULL);
+	everyflash_select(flash, false);
+	return (id[0] << 16) | (id[1] << 8) | id[2];
+}
+
+bool everyflash_busy(everyflash *flash) {
+	return (flash->everyflash_op != OP_IDLE) || flash->everyflash_streaming;
+}
+
+bool everyflash_read(everyflash *flash, uint32_t addr, uint8_t* buf, uint32_t len) {
+	if (!everyflash_stream_begin(flash, addr)) return false;
+	while (len > 0) {
+		uint16_t chunk = (len > 0xffff) ? 0xffff : len;
+		everyflash_stream_read(flash, buf, chunk);
+		buf += chunk;
+		len -= chunk;
+	}
+	everyflash_stream_end(flash);
+	return true;
+}
+
+bool everyflash_stream_begin(everyflash *flash, uint32_t addr) {
+	if (everyflash_busy(flash)) return false;
+	flash->everyflash_streaming = true;
+	everyflash_command_addr(flash, CMD_FAST_READ, addr);
+	uint8_t dummy;
+	SSP_TransferBlock(NULL, &dummy, 1, NULL);	// fast read needs one dummy byte
+	return true;
+}
+
+void everyflash_stream_read(everyflash *flash, uint8_t* buf, uint16_t len) {
+	SSP_TransferBlock(NULL, buf, len, NULL);
+}
+
+void everyflash_stream_end(everyflash *flash) {
+	everyflash_select(flash, false);
+	flash->everyflash_streaming = false;
+}
+
+bool everyflash_program(everyflash *flash, uint32_t addr, const uint8_t* data, uint32_t len, everyflash_callback callback) {
+	return everyflash_start(flash, OP_PROGRAM, addr, data, len, callback);
+}
+
+bool everyflash_erase(everyflash *flash, uint32_t addr, uint32_t len, everyflash_callback callback) {
+	if ((addr | len) & (EVERYFLASH_SECTOR_SIZE - 1)) return false;
+	return everyflash_start(flash, OP_ERASE, addr, NULL, len, callback);
+}
+
+void everyflash_timer_handler(everyflash *flash) {
+	Timer_ClearInterruptMask(flash->everyflash_timer, TIMER_MR0INT);
+	if (flash->everyflash_op == OP_IDLE) return;
+	if (everyflash_chip_busy(flash)) {
+		flash->everyflash_ticks++;
+		if (flash->everyflash_ticks > MAX_POLL_TICKS) everyflash_finish(flash, false);
+		return;
+	}
+	if (!everyflash_next_step(flash)) everyflash_finish(flash, true);
+}
@@ -0,0 +1,88 @@
+#ifndef EVERYFLASH_H
+#define EVERYFLASH_H
+
+#include "everykey/everykey.h"
+
+
+// driver for SPI NOR flash chips (25-series: W25Qxx, SST25, AT25, MX25
+// and similar) attached to the SSP port. Reads stream at SPI wire speed
+// using fast read, programming and erasing run in the background: the
+// driver polls the chip's busy flag from a timer interrupt and issues the
+// next page program / erase command as soon as the chip is ready.
+//
+// The timer interrupt handler of the timer passed to `everyflash_init`
+// must call `everyflash_timer_handler`, e.g.:
+//
+//     void ct32b1_handler(void) { everyflash_timer_handler(&flash); }
+
+// flash geometry (common to all supported chips)
+#define EVERYFLASH_PAGE_SIZE    256
+#define EVERYFLASH_SECTOR_SIZE  0x1000
+#define EVERYFLASH_BLOCK_SIZE   0x10000
+
+struct everyflash;
+
+// called from the timer interrupt when a program or erase operation
+// finished. `success` is false if the chip didn't get ready in time.
+typedef void (*everyflash_callback)(struct everyflash*, bool success);
+
+typedef struct everyflash {
+  // private
+  uint8_t                 everyflash_cs_port;
+  uint8_t                 everyflash_cs_pin;
+  TimerId                 everyflash_timer;
+  volatile uint8_t        everyflash_op;
+  bool                    everyflash_streaming;
+  uint32_t                everyflash_addr;
+  const uint8_t           *everyflash_data;
+  uint32_t                everyflash_remaining;
+  uint32_t                everyflash_ticks;
+  everyflash_callback     everyflash_callback;
+} everyflash;
+
+// prepare the flash driver: sets up the SSP port, the chip select pin
+// and the polling timer.
+// `clock_div`: SSP bus clock = 72 MHz / (2 * clock_div)
+// `timer`: timer used for busy polling, reserved for the driver.
+void everyflash_init(everyflash*, uint8_t cs_port, uint8_t cs_pin, uint8_t clock_div, TimerId timer);
+
+// returns the JEDEC id (manufacturer << 16 | memory type << 8 | capacity)
+// or 0 if a program or erase operation is running.
+uint32_t everyflash_read_id(everyflash*);
+
+// returns whether a program or erase operation is running. Reads are
+// not possible meanwhile.
+bool everyflash_busy(everyflash*);
+
+// read `len` bytes starting at `addr` into `buf`. returns false if the
+// flash is busy.
+bool everyflash_read(everyflash*, uint32_t addr, uint8_t* buf, uint32_t len);
+
+// start a continuous read at `addr`: the chip stays selected and
+// `everyflash_stream_read` fetches the next bytes without addressing
+// overhead, until `everyflash_stream_end` is called. Use this to feed
+// audio samples or firmware images. returns false if the flash is busy.
+bool everyflash_stream_begin(everyflash*, uint32_t addr);
+
+// read the next `len` bytes of a stream started with `everyflash_stream_begin`.
+void everyflash_stream_read(everyflash*, uint8_t* buf, uint16_t len);
+
+// end a stream and deselect the chip.
+void everyflash_stream_end(everyflash*);
+
+// program `len` bytes from `data` starting at `addr` in the background.
+// Writes are split at page boundaries automatically. The target area
+// must be erased. `data` must stay valid until `callback` (may be NULL)
+// was called. returns false if the flash is busy.
+bool everyflash_program(everyflash*, uint32_t addr, const uint8_t* data, uint32_t len, everyflash_callback callback);
+
+// erase `len` bytes starting at `addr` in the background. `addr` and
+// `len` must be multiples of EVERYFLASH_SECTOR_SIZE. 64K block erase is
+// used wherever possible, 4K sector erase elsewhere. returns false if
+// the flash is busy or the area is not aligned.
+bool everyflash_erase(everyflash*, uint32_t addr, uint32_t len, everyflash_callback callback);
+
+// to be called from the polling timer's interrupt handler.
+void everyflash_timer_handler(everyflash*);
+
+#endif
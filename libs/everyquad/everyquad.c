@@ -0,0 +1,88 @@
+
+#include "everyquad.h"
+
+// invalid transition marker in the lookup table
+#define ERR 2
+
+// step for each transition, indexed by (previous AB << 2) | current AB.
+// Gray code sequence forward: 00 -> 01 -> 11 -> 10 -> 00
+static const int8_t everyquad_steps[16] = {
+	 0, +1, -1, ERR,
+	-1,  0, ERR, +1,
+	+1, ERR,  0, -1,
+	ERR, -1, +1,  0
+};
+
+static everyquad *everyquad_encoders[EVERYQUAD_MAX_ENCODERS];
+static uint8_t everyquad_count = 0;
+
+// incremented on each position change, lets readers detect concurrent updates
+static volatile uint32_t everyquad_sequence = 0;
+
+static uint8_t everyquad_read_state(everyquad *quad) {
+	uint8_t a = every_gpio_read(quad->everyquad_port_a, quad->everyquad_pin_a);
+	uint8_t b = every_gpio_read(quad->everyquad_port_b, quad->everyquad_pin_b);
+	return (a << 1) | b;
+}
+
+// edge interrupt callback for all encoder pins
+static void everyquad_edge(uint8_t port, uint8_t pin) {
+	uint8_t i;
+	for (i = 0; i < everyquad_count; i++) {
+		everyquad *quad = everyquad_encoders[i];
+		if (((port == quad->everyquad_port_a) && (pin == quad->everyquad_pin_a)) ||
+		    ((port == quad->everyquad_port_b) && (pin == quad->everyquad_pin_b))) {
+			uint8_t state = everyquad_read_state(quad);
+			int8_t step = everyquad_steps[(quad->everyquad_state << 2) | state];
+			quad->everyquad_state = state;
+			if (step == ERR) {
+				quad->everyquad_errors++;
+			} else if (step) {
+				quad->everyquad_position += step;
+				everyquad_sequence++;
+			}
+			return;
+		}
+	}
+}
+
+bool everyquad_init(everyquad *quad, uint8_t port_a, uint8_t pin_a, uint8_t port_b, uint8_t pin_b) {
+	if (everyquad_count >= EVERYQUAD_MAX_ENCODERS) return false;
+	quad->everyquad_port_a = port_a;
+	quad->everyquad_pin_a = pin_a;
+	quad->everyquad_port_b = port_b;
+	quad->everyquad_pin_b = pin_b;
+	quad->everyquad_position = 0;
+	quad->everyquad_errors = 0;
+
+	every_gpio_set_dir(port_a, pin_a, INPUT);
+	every_gpio_set_dir(port_b, pin_b, INPUT);
+	quad->everyquad_state = everyquad_read_state(quad);
+	everyquad_encoders[everyquad_count++] = quad;
+
+	every_gpio_attach_interrupt(port_a, pin_a, TRIGGER_BOTH_EDGES, everyquad_edge, 0);
+	every_gpio_attach_interrupt(port_b, pin_b, TRIGGER_BOTH_EDGES, everyquad_edge, 0);
+	return true;
+}
+
+int32_t everyquad_position(everyquad *quad) {
+	return quad->everyquad_position;
+}
+
+void everyquad_set_position(everyquad *quad, int32_t position) {
+	quad->everyquad_position = position;
+	everyquad_sequence++;
+}
+
+uint32_t everyquad_errors(everyquad *quad) {
+	return quad->everyquad_errors;
+}
+
+void everyquad_snapshot(everyquad **encoders, int32_t* positions, uint8_t count) {
+	uint32_t sequence;
+	uint8_t i;
+	do {
+		sequence = everyquad_sequence;
+		for (i = 0; i < count; i++) positions[i] = encoders[i]->everyquad_position;
+	} while (sequence != everyquad_sequence);
+}
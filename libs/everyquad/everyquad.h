@@ -0,0 +1,56 @@
+#ifndef EVERYQUAD_H
+#define EVERYQUAD_H
+
+#include "everykey/everykey.h"
+
+
+// quadrature encoder decoder. Both channels of an encoder raise GPIO
+// interrupts on both edges (through `every_gpio_attach_interrupt`), a
+// lookup table turns the previous and current channel states into a
+// step of -1, 0 or +1, or an error if both channels changed at once
+// (the encoder was too fast or a signal is noisy).
+//
+// Timer count mode (COUNTMODE_BOTH) can count edges of one signal in
+// hardware, but it has no notion of direction, so it is not used here.
+//
+// Positions are updated from interrupts. Reading one position is atomic,
+// `everyquad_snapshot` reads several of them consistently (all taken at
+// the same time) without disabling interrupts.
+
+// maximum number of encoders
+#define EVERYQUAD_MAX_ENCODERS 4
+
+typedef struct everyquad {
+  // private
+  uint8_t                 everyquad_port_a;
+  uint8_t                 everyquad_pin_a;
+  uint8_t                 everyquad_port_b;
+  uint8_t                 everyquad_pin_b;
+  volatile uint8_t        everyquad_state;
+  volatile int32_t        everyquad_position;
+  volatile uint32_t       everyquad_errors;
+} everyquad;
+
+// set up an encoder: configures both pins as inputs and attaches their
+// interrupts. Pins must be set to GPIO function. The port interrupts
+// must not be handled by own gpioX_handler functions.
+// returns false if EVERYQUAD_MAX_ENCODERS are already in use.
+bool everyquad_init(everyquad*, uint8_t port_a, uint8_t pin_a, uint8_t port_b, uint8_t pin_b);
+
+// returns the current position in counts (4 counts per encoder cycle)
+int32_t everyquad_position(everyquad*);
+
+// sets the current position, e.g. for homing
+void everyquad_set_position(everyquad*, int32_t position);
+
+// returns the number of invalid transitions (both channels changed)
+// since `everyquad_init`. Each one means that the position may be off
+// by 2 counts.
+uint32_t everyquad_errors(everyquad*);
+
+// reads the positions of `count` encoders at the same instant: copies
+// are retried until no interrupt changed any encoder meanwhile. Must not
+// be called from an interrupt that could interrupt the encoder updates.
+void everyquad_snapshot(everyquad **encoders, int32_t* positions, uint8_t count);
+
+#endif
@@ -0,0 +1,243 @@
+/* feeds G-code lines to cnccontrol's gcode.c and checks the replies and the queued commands.
+ Lines with an error must not leave anything behind: no modal state (units, distance mode,
+ feed, motion mode, spindle), no position and no transaction IDs, even if the error is found
+ after the words that would change them. Targets out of the position unit range are errors.
+ Also checks arcs, dwells, comments, line ends, overlong lines and the GRBL flow control: "ok"
+ only goes out once the line's commands are queued. The parse rate on the host is printed,
+ it says little about the LPC1343 beyond the order of magnitude. */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "cnc_host.h"
+#include "examples/cnccontrol/gcode.h"
+#include "examples/cnccontrol/upstream.h"
+
+#define MAX_COMMANDS 8
+#define LINE_TEST_LENGTH 120	//longer than gcode.c's LINE_LENGTH
+
+static const char* input;
+static char output[64];
+static uint16_t outputLength;
+static bool ok = true;
+
+uint16_t Upstream_SerialRead(uint8_t* buffer, uint16_t maxLen) {
+	uint16_t n = 0;
+	while ((n < maxLen) && input[n]) {
+		buffer[n] = input[n];
+		n++;
+	}
+	input += n;
+	return n;
+}
+
+uint16_t Upstream_SerialWrite(const uint8_t* buffer, uint16_t len) {
+	uint16_t n = 0;
+	while ((n < len) && (outputLength < sizeof(output) - 1)) output[outputLength++] = buffer[n++];
+	output[outputLength] = 0;
+	return n;
+}
+
+static void Start() {
+	const int32_t origin[NUM_AXES] = { 0, 0, 0 };
+	CncReset(origin);
+	Gcode_Init();
+}
+
+/** sends one line, compares the reply */
+static void Line(const char* text, const char* reply) {
+	input = text;
+	outputLength = 0;
+	output[0] = 0;
+	Gcode_Poll();
+	if (strcmp(output, reply)) {
+		printf("FAIL %s", text);
+		printf("     replied %s", output);
+		ok = false;
+	}
+}
+
+/** takes the queued commands */
+static uint8_t Queued(CommandStruct* commands) {
+	uint8_t count = 0;
+	while ((count < MAX_COMMANDS) && CQ_GetCommand()) commands[count++] = currentCommand;
+	return count;
+}
+
+static void Check(const char* what, bool condition) {
+	if (!condition) {
+		printf("FAIL %s\n", what);
+		ok = false;
+	}
+}
+
+/** heartbeats of a length in mm at a feed in mm/min */
+static double Heartbeats(double length, double feed) {
+	return length / feed * 60 * HEARTBEAT_HZ;
+}
+
+static void Arcs() {
+	CommandStruct commands[MAX_COMMANDS];
+	const int32_t mm = unitsPerMm[0];
+	Start();
+	//quarter circle clockwise around (10, 0) from the origin to (10, 10), then the full
+	//circle counterclockwise around (10, 10) starting there (center relative to the start)
+	Line("G2X10Y10I10F600\n", "ok\r\n");
+	Line("G3I0J-10\n", "ok\r\n");				//no axis words: nothing moves
+	Line("G3X10Y10I0J-10Z-1\n", "ok\r\n");
+	uint8_t count = Queued(commands);
+	Check("arcs: two", count == 2);
+	const CommandStruct* quarter = &(commands[0]);
+	Check("quarter: clockwise", quarter->command == CMD_ARC_CW);
+	Check("quarter: center", (quarter->args.ARC.center[0] == 10 * mm) && (quarter->args.ARC.center[1] == 0));
+	Check("quarter: target", (quarter->args.ARC.target[0] == 10 * mm) && (quarter->args.ARC.target[1] == 10 * mm) &&
+		  (quarter->args.ARC.target[2] == 0));
+	Check("quarter: ticks", fabs(quarter->args.ARC.ticks - Heartbeats(10 * M_PI / 2, 600)) < 2);
+	const CommandStruct* full = &(commands[1]);
+	Check("full: counterclockwise", full->command == CMD_ARC_CCW);
+	Check("full: center", (full->args.ARC.center[0] == 10 * mm) && (full->args.ARC.center[1] == 0));
+	Check("full: target", (full->args.ARC.target[0] == 10 * mm) && (full->args.ARC.target[1] == 10 * mm) &&
+		  (full->args.ARC.target[2] == -mm));
+	Check("full: ticks", fabs(full->args.ARC.ticks - Heartbeats(hypot(20 * M_PI, 1), 600)) < 4);
+}
+
+static void Dwell() {
+	CommandStruct commands[MAX_COMMANDS];
+	Start();
+	Line("G4P1.5\n", "ok\r\n");
+	Line("G4P0.0005\n", "ok\r\n");
+	uint8_t count = Queued(commands);
+	Check("dwell: two waits", (count == 2) && (commands[0].command == CMD_WAIT) && (commands[1].command == CMD_WAIT));
+	Check("dwell: seconds", commands[0].args.WAIT.ticks == 3 * HEARTBEAT_HZ / 2);
+	Check("dwell: rounded", commands[1].args.WAIT.ticks == HEARTBEAT_HZ / 1000);
+}
+
+/** comments, lowercase and line ends: every line below is X+1 in G91 */
+static void Text() {
+	CommandStruct commands[MAX_COMMANDS];
+	const int32_t mm = unitsPerMm[0];
+	Start();
+	Line("g91 g1 f100 (relative; slow) x1\n", "ok\r\n");
+	Line("X1 ; comment (not closed\r", "ok\r\n");
+	Line("(whole line)\r\n", "ok\r\n");		//empty lines get an ok too
+	Line("x 1\r\n", "ok\r\n");
+	Line("\nX1(a)(b)\n", "ok\r\nok\r\n");		//LF after a lone LF is an empty line
+	uint8_t count = Queued(commands);
+	Check("text: four moves", count == 4);
+	int i;
+	for (i=0; i<count; i++) {
+		if (commands[i].args.MOVE_TO.target[0] != (i + 1) * mm) Check("text: targets", false);
+	}
+	char longLine[LINE_TEST_LENGTH + 2];
+	memset(longLine, '1', LINE_TEST_LENGTH);
+	longLine[0] = 'N';
+	longLine[LINE_TEST_LENGTH] = '\n';
+	longLine[LINE_TEST_LENGTH + 1] = 0;
+	Line(longLine, "error:11\r\n");
+	Line("X1\n", "ok\r\n");
+	Check("text: move after a long line", Queued(commands) == 1);
+}
+
+/** the queue is full: the line waits, and so does its "ok" */
+static void FlowControl() {
+	Start();
+	Line("G91G1F1000\n", "ok\r\n");
+	int free = CQ_EmptySlots(NULL);
+	int i;
+	for (i=0; i<free; i++) Line("X1\n", "ok\r\n");
+	Line("X1\nX1\n", "");
+	Check("flow: queue full", CQ_EmptySlots(NULL) == 0);
+	Line("", "");
+	CQ_GetCommand();
+	Line("", "ok\r\n");		//the line is in, the next one waits for room
+	CQ_GetCommand();
+	Line("", "ok\r\n");
+	Line("", "");
+	int left = 0;
+	while (CQ_GetCommand()) left++;
+	Check("flow: nothing lost", (left == free) && (currentCommand.transactionId == (uint32_t)free + 2));
+}
+
+/** lines per second on the host, each move taken from the queue right away */
+static void Rate() {
+	CommandStruct commands[MAX_COMMANDS];
+	const int lines = 200000;
+	char text[40];
+	Start();
+	Line("G1F3000\n", "ok\r\n");
+	clock_t start = clock();
+	int i;
+	for (i=0; i<lines; i++) {
+		snprintf(text, sizeof(text), "X%d.%03dY%d.%03d\n", i % 100, i % 1000, (i / 7) % 100, (i * 7) % 1000);
+		input = text;
+		outputLength = 0;
+		Gcode_Poll();
+		Queued(commands);
+	}
+	double seconds = (clock() - start) / (double)CLOCKS_PER_SEC;
+	printf("g-code rate: %.0f lines/s on the host\n", lines / seconds);
+}
+
+int main() {
+	CommandStruct commands[MAX_COMMANDS];
+	const int32_t mm = unitsPerMm[0];
+
+	//G20 and the feed come before the unsupported G99
+	Start();
+	Line("G20X1F100G99\n", "error:20\r\n");
+	Line("G1X1F100\n", "ok\r\n");
+	uint8_t count = Queued(commands);
+	Check("units: one move", (count == 1) && (commands[0].command == CMD_MOVE_TO));
+	Check("units: still millimeters", commands[0].args.MOVE_TO.target[0] == mm);
+	Check("units: first transaction ID", commands[0].transactionId == 1);
+
+	//the feed of a line with a missing dwell time isn't set
+	Start();
+	Line("F500G4\n", "error:28\r\n");
+	Line("G1X1\n", "error:22\r\n");
+	Check("feed: nothing queued", Queued(commands) == 0);
+
+	//spindle, distance mode and motion mode before an arc with a bad end point
+	Start();
+	Line("F100\n", "ok\r\n");
+	Line("M3S1000G91G2X1I5\n", "error:33\r\n");
+	Line("X2\n", "ok\r\n");
+	count = Queued(commands);
+	Check("arc: only the G0 move", (count == 1) && (commands[0].command == CMD_MOVE_TO));
+	Check("arc: still absolute", commands[0].args.MOVE_TO.target[0] == 2 * mm);
+	Check("arc: first transaction ID", commands[0].transactionId == 1);
+	Check("arc: rapid speed", commands[0].args.MOVE_TO.ticks == (2 * 60 * HEARTBEAT_HZ) / GCODE_RAPID_FEED);
+
+	//a valid line takes all of it, also for its own coordinates
+	Start();
+	Line("G20G91G1X1F10M3S500\n", "ok\r\n");
+	Line("X1\n", "ok\r\n");
+	count = Queued(commands);
+	Check("valid: spindle and two moves", (count == 3) && (commands[0].command == CMD_SPINDLE));
+	Check("valid: inches", (commands[1].args.MOVE_TO.target[0] == (254 * mm) / 10));
+	Check("valid: relative", (commands[2].args.MOVE_TO.target[0] == (2 * 254 * mm) / 10));
+	Check("valid: transaction IDs", (commands[0].transactionId == 1) && (commands[2].transactionId == 3));
+
+	//coordinates whose position units don't fit into int32 (about 209715 mm at 10240 units/mm)
+	Start();
+	Line("G1X300000F100\n", "error:33\r\n");
+	Line("G20X10000\n", "error:33\r\n");
+	Line("G2X0I300000F100\n", "error:33\r\n");
+	Line("G91X200000\n", "ok\r\n");
+	Line("X20000\n", "error:33\r\n");
+	Line("X-200000\n", "ok\r\n");
+	count = Queued(commands);
+	Check("range: two rapid moves", (count == 2) && (commands[0].command == CMD_MOVE_TO) && (commands[1].command == CMD_MOVE_TO));
+	Check("range: far target", commands[0].args.MOVE_TO.target[0] == 200000 * mm);
+	Check("range: back", commands[1].args.MOVE_TO.target[0] == 0);
+	Check("range: transaction IDs", commands[1].transactionId == 2);
+
+	Arcs();
+	Dwell();
+	Text();
+	FlowControl();
+	Rate();
+
+	printf("g-code lines: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
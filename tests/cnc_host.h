@@ -0,0 +1,68 @@
+/* the cnccontrol motion code on the host: pins, timers and interrupt control are stubs that do
+ nothing, the step pin values the motion stage prepares are kept in stepPinValues. The tests
+ call StartMove/MoveStep or Downstream_Tick directly instead of running the interrupts.
+ Include this once per test, link it against the cnccontrol sources it needs. */
+
+#include "examples/cnccontrol/state.h"
+#include "examples/cnccontrol/cmdqueue.h"
+#include "examples/cnccontrol/planner.h"
+#include "examples/cnccontrol/downstream.h"
+
+extern bool moveActive;
+extern bool moveDone;
+extern uint32_t moveSpeed;
+bool StartMove(bool chained);
+bool MoveStep();
+
+static uint32_t stepPinValues;
+
+void NVIC_EnableInterrupt(NVIC_INTERRUPT_INDEX interrupt) {}
+void NVIC_DisableInterrupt(NVIC_INTERRUPT_INDEX interrupt) {}
+void NVIC_SetInterruptPending(NVIC_INTERRUPT_INDEX interrupt) {}
+void NVIC_SetInterruptPriority(NVIC_INTERRUPT_INDEX interrupt, uint8_t prio) {}
+uint32_t maskInterrupts(uint8_t priority) { return 0; }
+void unmaskInterrupts(uint32_t previous) {}
+void Timer_Enable(TimerId timer, bool on) {}
+uint32_t Timer_GetValue(TimerId timer) { return 0; }
+void Timer_SetPrescale(TimerId timer, uint32_t prescale) {}
+void Timer_SetMatchValue(TimerId timer, uint8_t matchIdx, uint32_t value) {}
+void Timer_SetMatchBehaviour(TimerId timer, uint8_t matchIdx, uint8_t behaviour) {}
+void Timer_Start(TimerId timer) {}
+void Timer_Stop(TimerId timer) {}
+bool every_gpio_read(uint8_t port, uint8_t pin) { return false; }
+void every_gpio_set_dir(uint8_t port, uint8_t pin, every_gpio_direction dir) {}
+void every_gpio_set_function(HW_RW* pin, IOCON_IO_FUNC mode, IOCON_IO_ADMODE admode) {}
+void every_gpio_write(uint8_t port, uint8_t pin, bool value) {}
+void every_gpio_attach_interrupt(uint8_t port, uint8_t pin, every_gpio_interrupt_mode mode, every_gpio_handler handler, uint8_t debounceMs) {}
+void every_gpio_group_init(every_gpio_pin_group* group) {}
+int8_t every_gpio_group_add(every_gpio_pin_group* group, uint8_t port, uint8_t pin) { return 0; }
+void every_gpio_group_set_dir(const every_gpio_pin_group* group, every_gpio_direction dir) {}
+void every_gpio_group_write(const every_gpio_pin_group* group, uint32_t values) {}
+void every_gpio_group_prepare(const every_gpio_pin_group* group, uint32_t values, every_gpio_group_output* out) { stepPinValues = values; }
+void every_gpio_group_apply(const every_gpio_group_output* out) {}
+
+/** xorshift */
+static inline uint32_t CncRandom(uint32_t* state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/** the step pin value of a position */
+static inline uint8_t CncStepPin(int32_t position) {
+	return (position >> SUBSTEP_BITS) & 1;
+}
+
+/** puts the machine at rest at a given position with an empty queue */
+static inline void CncReset(const int32_t* position) {
+	int i;
+	for (i=0; i<NUM_AXES; i++) currentPosition[i] = position[i];
+	CQ_Init();
+	currentCommand.command = CMD_STOP;
+	moveActive = false;
+	moveDone = false;
+	moveSpeed = 0;
+}
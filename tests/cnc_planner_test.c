@@ -0,0 +1,287 @@
+/* runs paths of queued MOVE_TO commands through cnccontrol's queue, planner and motion stage
+ (Downstream_Tick), the queue is refilled whenever it has room like the USB host does. On every
+ step tick the axis speeds (path speed times the block's slope) are checked against the
+ planner limits: no axis faster than MAX_AXIS_SPEED, speed changes within a move of at most
+ MAX_AXIS_ACCEL per step tick, at junctions of at most MAX_JUNCTION_JERK plus two ticks of
+ acceleration: braking happens in whole ticks, so a move may end up to one tick of braking
+ above the planned junction speed, and the tick that finishes a move is still sampled with
+ its speed. Starting from and coming to rest may change the speed by PLANNER_MIN_SPEED.
+ The path has to end on its last target, and the moves of smooth paths must not stop in
+ between. Moves queued behind an immediate move have to run from where it ends. Arcs ending
+ off their circle have to get there without a jump on the last tick, and X and Y must not
+ change direction except where the arc turns them. */
+
+#include <stdio.h>
+#include <math.h>
+#include "cnc_host.h"
+
+#define MAX_SEGMENTS 3000
+#define MAX_TICKS (STEP_HZ * 60)
+#define UNITS_PER_MM (40 << SUBSTEP_BITS)
+
+/* rounding of the Q16 axis speeds */
+#define SLACK 4
+
+static int32_t path[MAX_SEGMENTS][NUM_AXES];
+static uint16_t segments;
+static bool ok = true;
+
+static void Add(double x, double y, double z) {
+	path[segments][0] = lround(x * UNITS_PER_MM);
+	path[segments][1] = lround(y * UNITS_PER_MM);
+	path[segments][2] = lround(z * UNITS_PER_MM);
+	segments++;
+}
+
+static void Fail(const char* name, const char* what, uint32_t tick) {
+	printf("FAIL %s: %s at step tick %u\n", name, what, tick);
+	ok = false;
+}
+
+/** axis speeds (Q16, signed) of the current move, 0 if nothing moves */
+static void AxisSpeeds(int64_t* speed) {
+	int i;
+	bool moving = IS_PATH_MOVE(currentCommand.command) && moveActive && !moveDone;
+	for (i=0; i<NUM_AXES; i++) {
+		speed[i] = moving ? currentBlock.direction[i] * (int64_t)(((uint64_t)moveSpeed * currentBlock.slope[i]) >> 32) : 0;
+	}
+}
+
+/** runs the path, feed in mm/s. Smooth paths must not stop before the end. */
+static void Run(const char* name, double feed, bool smooth) {
+	int32_t origin[NUM_AXES] = { 0, 0, 0 };
+	int32_t last[NUM_AXES] = { 0, 0, 0 };
+	int64_t lastSpeed[NUM_AXES] = { 0, 0, 0 };
+	uint32_t lastMove = 0;
+	uint16_t next = 0;
+	uint32_t stops = 0;
+	double maxSpeed = 0;
+	CncReset(origin);
+	Downstream_Init();
+	uint32_t tick;
+	for (tick=0; tick<MAX_TICKS; tick++) {
+		while ((next < segments) && (CQ_EmptySlots(NULL) > 0)) {
+			CommandStruct cmd;
+			cmd.command = CMD_MOVE_TO;
+			cmd.transactionId = next + 1;
+			double length = 0;
+			int i;
+			for (i=0; i<NUM_AXES; i++) {
+				int32_t from = next ? path[next-1][i] : 0;
+				length += pow((path[next][i] - from) / (double)UNITS_PER_MM, 2);
+				cmd.args.MOVE_TO.target[i] = path[next][i];
+			}
+			cmd.args.MOVE_TO.ticks = sqrt(length) / feed * HEARTBEAT_HZ;
+			CQ_AddCommand(&cmd);
+			next++;
+		}
+		Downstream_Tick();
+		if ((next >= segments) && !CQ_ReadAvail() && (currentCommand.command == CMD_STOP)) break;
+
+		int64_t speed[NUM_AXES];
+		AxisSpeeds(speed);
+		bool resting = true, wasResting = true;
+		int i;
+		for (i=0; i<NUM_AXES; i++) {
+			if (speed[i]) resting = false;
+			if (lastSpeed[i]) wasResting = false;
+		}
+		uint32_t move = currentCommand.transactionId;
+		int64_t limit = MAX_AXIS_ACCEL;
+		if (resting || wasResting) limit = PLANNER_MIN_SPEED + MAX_AXIS_ACCEL;
+		else if (move != lastMove) limit = MAX_JUNCTION_JERK + 2 * MAX_AXIS_ACCEL;
+		for (i=0; i<NUM_AXES; i++) {
+			int64_t change = speed[i] - lastSpeed[i];
+			if (change < 0) change = -change;
+			if (change > limit + SLACK) Fail(name, (move != lastMove) ? "junction speed change too large" : "acceleration too high", tick);
+			int64_t magnitude = (speed[i] < 0) ? -speed[i] : speed[i];
+			if (magnitude > MAX_AXIS_SPEED) Fail(name, "planned axis speed too high", tick);
+			if (magnitude / 65536.0 > maxSpeed) maxSpeed = magnitude / 65536.0;
+			int32_t travel = currentPosition[i] - last[i];
+			if (travel < 0) travel = -travel;
+			if (travel > (MAX_AXIS_SPEED >> 16) + 1) Fail(name, "axis moved too far in one step tick", tick);
+			last[i] = currentPosition[i];
+			lastSpeed[i] = speed[i];
+		}
+		if (resting && !wasResting && (next < segments || CQ_ReadAvail())) stops++;
+		lastMove = move;
+		if (!ok) return;
+	}
+	if (tick >= MAX_TICKS) Fail(name, "path didn't finish", tick);
+	int i;
+	for (i=0; i<NUM_AXES; i++) {
+		if (currentPosition[i] != path[segments-1][i]) Fail(name, "not on the last target", tick);
+	}
+	if (smooth && stops) Fail(name, "stopped between moves", tick);
+	printf("%-8s %4u moves in %7.3f s, %u stops, fastest axis %5.1f units/step tick\n",
+		   name, segments, tick / (double)STEP_HZ, stops, maxSpeed);
+}
+
+/** moves queued while an immediate move runs must start at its target: they used to be
+ planned from the position at the time they came in, and the step tick had to replan them */
+static void AfterImmediate() {
+	const int32_t origin[NUM_AXES] = { 0, 0, 0 };
+	const int32_t corner[NUM_AXES] = { 5 * UNITS_PER_MM, 2 * UNITS_PER_MM, 0 };
+	const uint16_t immediateSpeed = 100;	//units per command tick
+	CncReset(origin);
+	Downstream_Init();
+	CommandStruct cmd;
+	cmd.transactionId = 1;
+	cmd.command = CMD_MOVE_TO_IMM;
+	memmove(cmd.args.MOVE_TO_IMM.target, corner, sizeof(corner));
+	cmd.args.MOVE_TO_IMM.speed = immediateSpeed;
+	CQ_AddCommand(&cmd);
+	uint32_t tick;
+	for (tick=0; tick<STEP_HZ / 40; tick++) Downstream_Tick();	//half way
+
+	int i;
+	for (i=0; i<2; i++) {
+		cmd.transactionId = 2 + i;
+		cmd.command = CMD_MOVE_TO;
+		cmd.args.MOVE_TO.target[0] = 0;
+		cmd.args.MOVE_TO.target[1] = i ? 0 : corner[1];
+		cmd.args.MOVE_TO.target[2] = 0;
+		cmd.args.MOVE_TO.ticks = HEARTBEAT_HZ / 10;
+		CQ_AddCommand(&cmd);
+	}
+	int32_t last[NUM_AXES];
+	memmove(last, currentPosition, sizeof(last));
+	uint32_t moving = 0;
+	for (tick=0; (tick<MAX_TICKS) && (CQ_ReadAvail() || (currentCommand.command != CMD_STOP)); tick++) {
+		Downstream_Tick();
+		for (i=0; i<NUM_AXES; i++) {
+			int32_t travel = currentPosition[i] - last[i];
+			if (travel < 0) travel = -travel;
+			if (travel > immediateSpeed + (MAX_AXIS_SPEED >> 16)) Fail("immediate", "jumped", tick);
+			if (travel && (currentCommand.command == CMD_MOVE_TO)) moving++;
+			last[i] = currentPosition[i];
+		}
+		if (!ok) return;
+	}
+	for (i=0; i<NUM_AXES; i++) {
+		if (currentPosition[i] != origin[i]) Fail("immediate", "queued moves after it not on target", tick);
+	}
+	if (!moving) Fail("immediate", "queued moves skipped", tick);
+}
+
+/** a half circle around (radius, 0) whose end misses the circle by offEnd units. Slightly off:
+ the radius has to be blended towards the end, the last tick used to jump by the difference.
+ Far off: the move is planned as a line. X only moves up, Y turns once at the bottom (arc) or
+ not at all (line). */
+static void ArcEnd(const char* name, int32_t offEnd) {
+	const int32_t origin[NUM_AXES] = { 0, 0, 0 };
+	const int32_t radius = 10 * UNITS_PER_MM;
+	CncReset(origin);
+	Downstream_Init();
+	CommandStruct cmd;
+	cmd.transactionId = 1;
+	cmd.command = CMD_ARC_CCW;
+	cmd.args.ARC.center[0] = radius;
+	cmd.args.ARC.center[1] = 0;
+	cmd.args.ARC.target[0] = 2 * radius + offEnd;
+	cmd.args.ARC.target[1] = 0;
+	cmd.args.ARC.target[2] = 0;
+	cmd.args.ARC.ticks = HEARTBEAT_HZ;
+	CQ_AddCommand(&cmd);
+	int32_t last[NUM_AXES];
+	int32_t heading[NUM_AXES] = { 1, -1, 0 };
+	uint32_t turns[NUM_AXES] = { 0, 0, 0 };
+	memmove(last, currentPosition, sizeof(last));
+	uint32_t tick;
+	for (tick=0; (tick<MAX_TICKS) && (CQ_ReadAvail() || (currentCommand.command != CMD_STOP)); tick++) {
+		uint32_t speed = moveSpeed >> 16;
+		Downstream_Tick();
+		int i;
+		for (i=0; i<NUM_AXES; i++) {
+			int32_t travel = currentPosition[i] - last[i];
+			if (travel && ((travel < 0) != (heading[i] < 0))) {
+				heading[i] = -heading[i];
+				turns[i]++;
+			}
+			if (travel < 0) travel = -travel;
+			if (travel > speed + 4) Fail(name, "axis jumped", tick);
+			last[i] = currentPosition[i];
+		}
+		if (!ok) return;
+	}
+	if ((currentPosition[0] != cmd.args.ARC.target[0]) || (currentPosition[1] != 0)) Fail(name, "not on target", tick);
+	if (turns[0] || (turns[1] > 1)) Fail(name, "axis changed direction on the way", tick);
+}
+
+/** slow full circles around random centers: each axis turns twice. The rotation's noise used
+ to step an axis back and forth near its turning points. */
+static void Circles() {
+	uint32_t seed = 7;
+	int n;
+	for (n=0; n<200; n++) {
+		const int32_t origin[NUM_AXES] = { 0, 0, 0 };
+		CncReset(origin);
+		Downstream_Init();
+		CommandStruct cmd;
+		cmd.transactionId = 1;
+		cmd.command = (n & 1) ? CMD_ARC_CW : CMD_ARC_CCW;
+		cmd.args.ARC.center[0] = (int32_t)(CncRandom(&seed) % (20 * UNITS_PER_MM + 1)) - 10 * UNITS_PER_MM;
+		cmd.args.ARC.center[1] = (int32_t)(CncRandom(&seed) % (20 * UNITS_PER_MM + 1)) - 10 * UNITS_PER_MM;
+		memmove(cmd.args.ARC.target, origin, sizeof(origin));
+		cmd.args.ARC.ticks = 100 * HEARTBEAT_HZ;
+		CQ_AddCommand(&cmd);
+		int32_t last[NUM_AXES] = { 0, 0, 0 };
+		int32_t heading[NUM_AXES] = { 0, 0, 0 };
+		uint32_t turns = 0;
+		uint32_t tick;
+		for (tick=0; (tick<MAX_TICKS) && (CQ_ReadAvail() || (currentCommand.command != CMD_STOP)); tick++) {
+			Downstream_Tick();
+			int i;
+			for (i=0; i<2; i++) {
+				int32_t travel = currentPosition[i] - last[i];
+				if (travel) {
+					int32_t now = (travel < 0) ? -1 : 1;
+					if (heading[i] && (now != heading[i])) turns++;
+					heading[i] = now;
+				}
+				last[i] = currentPosition[i];
+			}
+		}
+		if (turns > 4) Fail("circles", "axis changed direction on the way", tick);
+		if (!ok) return;
+	}
+}
+
+int main() {
+	int k;
+	segments = 0;
+	Add(10, 0, 0); Add(10, 10, 0); Add(0, 10, 0); Add(0, 0, 0);
+	Run("square", 100, false);
+
+	segments = 0;
+	for (k=1; k<=360; k++) Add(20 * cos(k * M_PI / 180) - 20, 20 * sin(k * M_PI / 180), 0);
+	Run("circle", 100, true);
+
+	segments = 0;
+	uint32_t seed = 3;
+	double x = 0, y = 0, z = 0;
+	for (k=0; k<MAX_SEGMENTS; k++) {
+		x += ((int32_t)(CncRandom(&seed) % 2001) - 1000) / 5000.0;
+		y += ((int32_t)(CncRandom(&seed) % 2001) - 1000) / 5000.0;
+		z += ((int32_t)(CncRandom(&seed) % 201) - 100) / 5000.0;
+		Add(x, y, z);
+	}
+	Run("random", 50, false);
+
+	segments = 0;
+	for (k=1; k<=2000; k++) Add(5 * cos(k * M_PI / 90) - 5, 5 * sin(k * M_PI / 90), k * 0.002);
+	Run("helix", 30, true);
+
+	segments = 0;
+	Add(300, 150, 0); Add(300, 150, -5);
+	Run("long", 1000, false);
+
+	AfterImmediate();
+	ArcEnd("arc", 0);
+	ArcEnd("arc off", 100);
+	ArcEnd("arc far", 2 * UNITS_PER_MM);
+	Circles();
+
+	printf("planner limits: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
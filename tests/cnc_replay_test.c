@@ -0,0 +1,139 @@
+/* replays random MOVE_TO commands through StartMove/MoveStep of cnccontrol's downstream.c and
+ through the interpolator it replaced (one division per axis on every command tick). Both must
+ end exactly on the target and toggle every step pin as often as the step count between start
+ and target, no axis may move a full step within one step tick.
+
+ Excluded from the old/new comparison: moves faster than one step per command tick. The old
+ interpolator set the step pins once per command tick, so when an axis crossed two step
+ boundaries in one tick the pin didn't change and a step was lost, its toggle count is lower
+ than the real distance. The new code caps the axis speed below one step per step tick, these
+ moves are checked against the real step count only (and counted in the summary). */
+
+#include <stdio.h>
+#include "cnc_host.h"
+
+#define MOVES 10000
+#define RANGE 1000000
+#define MAX_DISTANCE 100000
+#define MAX_STEP_TICKS 4000000
+
+static bool ok = true;
+
+typedef struct {
+	int32_t end[NUM_AXES];
+	uint32_t toggles[NUM_AXES];
+	uint32_t maxDelta;			//largest axis change between two step pin updates
+} Replay;
+
+/** the constant speed interpolation before the step tick, one update per command tick */
+static void OldMove(const int32_t* start, const CommandStruct* cmd, Replay* out) {
+	int32_t position[NUM_AXES];
+	int i;
+	for (i=0; i<NUM_AXES; i++) {
+		position[i] = start[i];
+		out->toggles[i] = 0;
+	}
+	out->maxDelta = 0;
+	uint32_t tick;
+	for (tick=0; ; tick++) {
+		for (i=0; i<NUM_AXES; i++) {
+			int32_t last = position[i];
+			if (tick < cmd->args.MOVE_TO.ticks) {
+				int32_t remaining = cmd->args.MOVE_TO.ticks - tick;
+				position[i] += (cmd->args.MOVE_TO.target[i] - position[i]) / (remaining+1);
+			} else position[i] = cmd->args.MOVE_TO.target[i];
+			uint32_t delta = (position[i] > last) ? position[i] - last : last - position[i];
+			if (delta > out->maxDelta) out->maxDelta = delta;
+			if (CncStepPin(position[i]) != CncStepPin(last)) out->toggles[i]++;
+		}
+		if (tick >= cmd->args.MOVE_TO.ticks) break;
+	}
+	for (i=0; i<NUM_AXES; i++) out->end[i] = position[i];
+}
+
+/** the current motion stage: queued and planned like the host's commands, then stepped */
+static bool NewMove(const int32_t* start, CommandStruct* cmd, Replay* out) {
+	int i;
+	CncReset(start);
+	for (i=0; i<NUM_AXES; i++) out->toggles[i] = 0;
+	out->maxDelta = 0;
+	if (!CQ_AddCommand(cmd) || !CQ_GetCommand() || !StartMove(false)) return false;
+	uint32_t tick;
+	bool done = false;
+	for (tick=0; (tick < MAX_STEP_TICKS) && !done; tick++) {
+		int32_t last[NUM_AXES];
+		for (i=0; i<NUM_AXES; i++) last[i] = currentPosition[i];
+		done = MoveStep();
+		for (i=0; i<NUM_AXES; i++) {
+			uint32_t delta = (currentPosition[i] > last[i]) ? currentPosition[i] - last[i] : last[i] - currentPosition[i];
+			if (delta > out->maxDelta) out->maxDelta = delta;
+			if (CncStepPin(currentPosition[i]) != CncStepPin(last[i])) out->toggles[i]++;
+		}
+	}
+	for (i=0; i<NUM_AXES; i++) out->end[i] = currentPosition[i];
+	return done;
+}
+
+/** number of step boundaries between two positions */
+static uint32_t Steps(int32_t from, int32_t to) {
+	int32_t a = from >> SUBSTEP_BITS;
+	int32_t b = to >> SUBSTEP_BITS;
+	return (a > b) ? a - b : b - a;
+}
+
+static void Fail(uint32_t move, const char* what, const int32_t* start, const CommandStruct* cmd) {
+	if (ok) printf("FAIL move %u: %s (from %d %d %d to %d %d %d in %u ticks)\n", move, what,
+				   start[0], start[1], start[2], cmd->args.MOVE_TO.target[0], cmd->args.MOVE_TO.target[1],
+				   cmd->args.MOVE_TO.target[2], cmd->args.MOVE_TO.ticks);
+	ok = false;
+}
+
+int main() {
+	uint32_t seed = 0x2545f491;
+	uint32_t compared = 0, excluded = 0, aliased = 0;
+	uint32_t move;
+	for (move=0; move<MOVES; move++) {
+		int32_t start[NUM_AXES];
+		CommandStruct cmd;
+		cmd.command = CMD_MOVE_TO;
+		cmd.transactionId = move;
+		int i;
+		uint32_t longest = 0;
+		for (i=0; i<NUM_AXES; i++) {
+			start[i] = (int32_t)(CncRandom(&seed) % (2 * RANGE + 1)) - RANGE;
+			int32_t delta = (int32_t)(CncRandom(&seed) % (2 * MAX_DISTANCE + 1)) - MAX_DISTANCE;
+			if (move % 7 == 0) delta = (int32_t)(CncRandom(&seed) % 1025) - 512;	//within a step or two
+			else if ((move % 5 == 0) && (i > 0)) delta = 0;							//single axis
+			else if (move % 11 == 0) delta = -2 * start[i];							//long enough for full speed
+			cmd.args.MOVE_TO.target[i] = start[i] + delta;
+			uint32_t distance = (delta < 0) ? -delta : delta;
+			if (distance > longest) longest = distance;
+		}
+		//odd moves: 16 to 255 units per command tick, even ones mostly faster
+		if (move & 1) cmd.args.MOVE_TO.ticks = longest / (16 + CncRandom(&seed) % 240);
+		else cmd.args.MOVE_TO.ticks = CncRandom(&seed) % 50;
+
+		Replay old, new;
+		OldMove(start, &cmd, &old);
+		if (!NewMove(start, &cmd, &new)) {
+			Fail(move, "move didn't finish", start, &cmd);
+			continue;
+		}
+		bool fast = old.maxDelta >= (1 << SUBSTEP_BITS);
+		if (fast) excluded++;
+		else compared++;
+		if (new.maxDelta >= (1 << SUBSTEP_BITS)) Fail(move, "axis moved a full step in one step tick", start, &cmd);
+		for (i=0; i<NUM_AXES; i++) {
+			if ((old.end[i] != cmd.args.MOVE_TO.target[i]) || (new.end[i] != cmd.args.MOVE_TO.target[i])) {
+				Fail(move, "not on target", start, &cmd);
+			}
+			if (new.toggles[i] != Steps(start[i], cmd.args.MOVE_TO.target[i])) Fail(move, "steps lost", start, &cmd);
+			if (!fast && (new.toggles[i] != old.toggles[i])) Fail(move, "step count differs from the old interpolator", start, &cmd);
+		}
+		if (fast && memcmp(old.toggles, new.toggles, sizeof(old.toggles))) aliased++;
+	}
+
+	printf("move replay: %u compared with the old interpolator, %u faster than a step per command tick (%u lost steps in the old one): %s\n",
+		   compared, excluded, aliased, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
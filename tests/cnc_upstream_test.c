@@ -0,0 +1,134 @@
+/* sends HID OUT reports to cnccontrol's upstream.c and checks the queued commands. The USB
+ stack is stubbed out, the test fills the OUT report buffer and calls the report handler like
+ the HID endpoint does. Compact moves (BATCH_MOVE_DELTA) have to continue from where the
+ queue plans them: after an immediate command that's where it leaves the machine, not the
+ position at the time the report came in. */
+
+#include <stdio.h>
+#include "cnc_host.h"
+#include "everykey_usb/hid.h"
+#include "everykey_usb/cdc.h"
+#include "examples/cnccontrol/upstream.h"
+
+extern uint8_t outBuffer[BATCH_REPORT_SIZE];
+void receiveCommand(USB_Device_Struct* device, const USBHID_Behaviour_Struct* behaviour,
+					USB_HID_REPORTTYPE reportType, uint8_t reportId, uint16_t len);
+
+bool USB_Init(const USB_Device_Definition* definition, USB_Device_Struct* device) { return true; }
+void USB_SoftConnect(USB_Device_Struct* device) {}
+bool USBCDC_ExtendedControlSetupHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) { return false; }
+bool USBCDC_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) { return false; }
+void USBCDC_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {}
+bool USBCDC_InterfaceOwnerHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface) { return false; }
+void USBCDC_ResetBehaviour(const USBCDC_Behaviour_Struct* cdc) {}
+uint16_t USBCDC_ReadBytes(USB_Device_Struct* device, const USBCDC_Behaviour_Struct* cdc, uint8_t* buffer, uint16_t maxLen) { return 0; }
+uint16_t USBCDC_WriteBytes(USB_Device_Struct* device, const USBCDC_Behaviour_Struct* cdc, uint8_t* buffer, uint16_t len) { return 0; }
+void USBHID_PushReport(USB_Device_Struct* device, const USBHID_Behaviour_Struct* behaviour, USB_HID_REPORTTYPE reportType, uint8_t reportId) {}
+bool USBHID_ExtendedControlSetupHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) { return false; }
+bool USBHID_EndpointDataHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) { return false; }
+void USBHID_ConfigChangeHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {}
+bool USBHID_InterfaceOwnerHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface) { return false; }
+
+static uint16_t reportLength;
+static uint32_t nextId;
+static bool ok = true;
+
+static void Check(const char* what, bool condition) {
+	if (!condition) {
+		printf("FAIL %s\n", what);
+		ok = false;
+	}
+}
+
+static void AddCommand(uint32_t command, const int32_t* target) {
+	CommandStruct cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.transactionId = ++nextId;
+	cmd.command = command;
+	if (command == CMD_MOVE_TO_IMM) {
+		memmove(cmd.args.MOVE_TO_IMM.target, target, sizeof(cmd.args.MOVE_TO_IMM.target));
+		cmd.args.MOVE_TO_IMM.speed = 100;
+	} else if (command == CMD_MOVE_TO) {
+		memmove(cmd.args.MOVE_TO.target, target, sizeof(cmd.args.MOVE_TO.target));
+		cmd.args.MOVE_TO.ticks = 100;
+	}
+	outBuffer[reportLength++] = BATCH_COMMAND;
+	memmove(outBuffer + reportLength, &cmd, sizeof(cmd));
+	reportLength += sizeof(cmd);
+}
+
+static void AddDelta(const int16_t* delta) {
+	MoveDeltaStruct move;
+	memmove(move.delta, delta, sizeof(move.delta));
+	move.ticks = 100;
+	nextId++;
+	outBuffer[reportLength++] = BATCH_MOVE_DELTA;
+	memmove(outBuffer + reportLength, &move, sizeof(move));
+	reportLength += sizeof(move);
+}
+
+static void Send() {
+	memset(outBuffer + reportLength, BATCH_END, BATCH_REPORT_SIZE - reportLength);
+	receiveCommand(NULL, NULL, USB_HID_REPORTTYPE_OUTPUT, 0, BATCH_REPORT_SIZE);
+	reportLength = 0;
+}
+
+/** takes the next queued command, checks that it's the compact move from base + delta and
+ that it was planned from base */
+static void ExpectDelta(const char* what, const int32_t* base, const int16_t* delta) {
+	if (!CQ_GetCommand() || (currentCommand.command != CMD_MOVE_TO) || (currentCommand.transactionId != nextId)) {
+		printf("FAIL %s: compact move not queued\n", what);
+		ok = false;
+		return;
+	}
+	int i;
+	for (i=0; i<NUM_AXES; i++) {
+		if ((currentCommand.args.MOVE_TO.target[i] != base[i] + delta[i]) || (currentBlock.start[i] != base[i])) {
+			printf("FAIL %s: axis %i ends at %d, planned from %d\n", what, i,
+				   currentCommand.args.MOVE_TO.target[i], currentBlock.start[i]);
+			ok = false;
+		}
+	}
+}
+
+int main() {
+	const int32_t start[NUM_AXES] = { 10000, -20000, 3000 };
+	const int32_t first[NUM_AXES] = { 15000, -18000, 3000 };
+	const int32_t zero[NUM_AXES] = { 0, 0, 0 };
+	const int16_t delta[NUM_AXES] = { 700, -300, 50 };
+	CncReset(start);
+	Upstream_Init();
+
+	//a full move, then a compact one relative to its target, both in one report
+	AddCommand(CMD_MOVE_TO, first);
+	AddDelta(delta);
+	Send();
+	Check("full move queued", CQ_GetCommand() && (currentCommand.transactionId == 1));
+	ExpectDelta("after a full move", first, delta);
+
+	//SET_HOME: the motion stage hasn't zeroed the position yet when the next report comes in
+	AddCommand(CMD_SET_HOME, NULL);
+	Send();
+	AddDelta(delta);
+	Send();
+	ExpectDelta("after SET_HOME", zero, delta);
+
+	//MOVE_TO_IMM: the machine is somewhere on the way to its target
+	const int32_t immediate[NUM_AXES] = { 40000, 5000, -1000 };
+	AddCommand(CMD_MOVE_TO_IMM, immediate);
+	Send();
+	currentPosition[0] = 20000;
+	currentPosition[1] = 2500;
+	AddDelta(delta);
+	Send();
+	ExpectDelta("after MOVE_TO_IMM", immediate, delta);
+
+	//and in the same report
+	AddCommand(CMD_MOVE_TO_IMM, start);
+	AddDelta(delta);
+	Send();
+	ExpectDelta("after MOVE_TO_IMM in one report", start, delta);
+
+	printf("compact moves: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
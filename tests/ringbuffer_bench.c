@@ -0,0 +1,50 @@
+/* ring buffer benchmark: pushes data through a 1K ring in chunks of different sizes, once
+ with the current implementation and once with the old byte by byte one (ringbuffer_old.c).
+ Host numbers, only the ratio says something about the target. */
+
+#include <stdio.h>
+#include <time.h>
+#include "everykey/ringbuffer.h"
+#include "everykey/utils.h"
+
+uint16_t OldRingBufferReadBuffer(const RingBufferStatic* rb, uint8_t* data, uint16_t length);
+uint16_t OldRingBufferWriteBuffer(const RingBufferStatic* rb, const uint8_t* data, uint16_t length);
+
+#define LENGTH 1024
+#define BYTES (64 * 1024 * 1024)
+
+static uint8_t memory[sizeof(RingBufferDynamic) + LENGTH];
+static uint8_t chunk[LENGTH];
+
+typedef uint16_t (*Transfer)(const RingBufferStatic* rb, uint8_t* data, uint16_t length);
+
+static double Now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/** returns MB/s for writing and reading back chunkSize bytes at a time */
+static double Measure(Transfer write, Transfer read, uint16_t chunkSize) {
+	RingBufferStatic ring = { LENGTH, (RingBufferDynamic*)memory };
+	RingBufferInit(&ring);
+	uint32_t moved = 0;
+	double start = Now();
+	while (moved < BYTES) {
+		write(&ring, chunk, chunkSize);
+		moved += read(&ring, chunk, chunkSize);
+	}
+	return moved / (Now() - start) / 1e6;
+}
+
+int main() {
+	static const uint16_t sizes[] = { 1, 4, 16, 64, 256, 1000 };
+	uint8_t i;
+	printf("chunk    old MB/s    new MB/s   speedup\n");
+	for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+		double old = Measure((Transfer)OldRingBufferWriteBuffer, OldRingBufferReadBuffer, sizes[i]);
+		double new = Measure((Transfer)RingBufferWriteBuffer, RingBufferReadBuffer, sizes[i]);
+		printf("%5u %11.1f %11.1f %8.1fx\n", sizes[i], old, new, new / old);
+	}
+	return 0;
+}
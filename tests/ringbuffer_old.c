@@ -0,0 +1,55 @@
+/* the ring buffer before the lock-free rewrite (byte by byte, modulo indexes), kept as the
+ baseline for ringbuffer_bench. Same structures, functions renamed to OldRingBuffer... */
+
+#include "everykey/ringbuffer.h"
+
+uint16_t OldRingBufferReadBytesAvailable(const RingBufferStatic* rb) {
+	RingBufferDynamic* rbdyn = rb->dynamic;
+	uint16_t rIdx = rbdyn->readIdx;
+	uint16_t wIdx = rbdyn->writeIdx;
+	return (((rb->length)+wIdx)-rIdx) % (rb->length);
+}
+
+uint16_t OldRingBufferWriteBytesAvailable(const RingBufferStatic* rb) {
+	return (rb->length)- OldRingBufferReadBytesAvailable(rb) - 1;	//-1 to be safe
+}
+
+bool OldRingBufferReadByte(const RingBufferStatic* rb, uint8_t* data) {
+	if (OldRingBufferReadBytesAvailable(rb) > 0) {
+		RingBufferDynamic* rbdyn = rb->dynamic;
+		uint16_t idx = rbdyn->readIdx;
+		*data = rbdyn->data[idx];
+		idx = (idx+1) % (rb->length);
+		rbdyn->readIdx = idx;
+		return true;
+	} else return false;
+}
+
+bool OldRingBufferWriteByte(const RingBufferStatic* rb, uint8_t data) {
+	if (OldRingBufferWriteBytesAvailable(rb) > 0) {
+		RingBufferDynamic* rbdyn = rb->dynamic;
+		uint16_t idx = rbdyn->writeIdx;
+		rbdyn->data[idx] = data;
+		idx = (idx+1) % (rb->length);
+		rbdyn->writeIdx = idx;
+		return true;
+	} else return false;
+}
+
+uint16_t OldRingBufferReadBuffer(const RingBufferStatic* rb, uint8_t* data, uint16_t length) {
+	int read = 0;
+	while (read < length) {
+		if (!OldRingBufferReadByte(rb, &(data[read]))) break;
+		else read++;
+	}
+	return read;
+}
+
+uint16_t OldRingBufferWriteBuffer(const RingBufferStatic* rb, const uint8_t* data, uint16_t length) {
+	int written = 0;
+	while (written < length) {
+		if (!OldRingBufferWriteByte(rb, data[written])) break;
+		else written++;
+	}
+	return written;
+}
@@ -0,0 +1,160 @@
+/* ring buffer stress test: a writer and a reader thread move a pseudo random byte stream
+ through small ring buffers in random chunks, mixing the copying, zero-copy and single byte
+ calls. The free-running 16 bit indexes wrap around many times. The reader checks every
+ byte against the stream and that the fill level never exceeds the buffer length. */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include "everykey/ringbuffer.h"
+#include "everykey/utils.h"
+
+#define STREAM_BYTES (16 * 1024 * 1024)
+#define MAX_LENGTH 1024
+
+static uint8_t memory[sizeof(RingBufferDynamic) + MAX_LENGTH];
+static RingBufferStatic ring;
+static volatile bool failed;
+
+/** xorshift, one state per thread */
+static uint32_t Random(uint32_t* state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/** byte n of the test stream */
+static uint8_t StreamByte(uint32_t n) {
+	uint32_t x = n * 2654435761u;
+	return (uint8_t)(x >> 24);
+}
+
+/** random chunk size, up to a bit more than the buffer holds */
+static uint16_t ChunkSize(uint32_t* state) {
+	return 1 + Random(state) % (ring.length + 16);
+}
+
+static void* Writer(void* arg) {
+	uint32_t state = 0x12345678;
+	uint32_t pos = 0;
+	uint8_t chunk[MAX_LENGTH + 16];
+	while ((pos < STREAM_BYTES) && !failed) {
+		uint16_t len = ChunkSize(&state);
+		if (len > STREAM_BYTES - pos) len = STREAM_BYTES - pos;
+		uint16_t done = 0;
+		uint16_t i;
+		switch (Random(&state) % 3) {
+			case 0:
+				for (i=0; i<len; i++) chunk[i] = StreamByte(pos + i);
+				done = RingBufferWriteBuffer(&ring, chunk, len);
+				break;
+			case 1:
+			{
+				uint8_t* block;
+				uint16_t blockLen = RingBufferPeekWrite(&ring, &block);
+				if (blockLen > len) blockLen = len;
+				for (i=0; i<blockLen; i++) block[i] = StreamByte(pos + i);
+				RingBufferCommitWrite(&ring, blockLen);
+				done = blockLen;
+			}
+				break;
+			case 2:
+				while ((done < len) && RingBufferWriteByte(&ring, StreamByte(pos + done))) done++;
+				break;
+		}
+		pos += done;
+		if (!done) sched_yield();
+	}
+	return NULL;
+}
+
+static bool Check(const uint8_t* data, uint16_t len, uint32_t pos) {
+	uint16_t i;
+	for (i=0; i<len; i++) {
+		if (data[i] != StreamByte(pos + i)) {
+			printf("FAIL length %u: byte %u is 0x%02x, expected 0x%02x\n", ring.length,
+				   (unsigned)(pos + i), data[i], StreamByte(pos + i));
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool Reader() {
+	uint32_t state = 0x87654321;
+	uint32_t pos = 0;
+	uint8_t chunk[MAX_LENGTH + 16];
+	while (pos < STREAM_BYTES) {
+		uint16_t avail = RingBufferReadBytesAvailable(&ring);
+		if (avail > ring.length) {
+			printf("FAIL length %u: %u bytes available\n", ring.length, avail);
+			return false;
+		}
+		uint16_t len = ChunkSize(&state);
+		uint16_t done = 0;
+		switch (Random(&state) % 3) {
+			case 0:
+				done = RingBufferReadBuffer(&ring, chunk, len);
+				if (!Check(chunk, done, pos)) return false;
+				break;
+			case 1:
+			{
+				const uint8_t* block;
+				uint16_t blockLen = RingBufferPeekRead(&ring, &block);
+				if (blockLen > len) blockLen = len;
+				if (!Check(block, blockLen, pos)) return false;
+				RingBufferCommitRead(&ring, blockLen);
+				done = blockLen;
+			}
+				break;
+			case 2:
+				while ((done < len) && RingBufferReadByte(&ring, &(chunk[done]))) done++;
+				if (!Check(chunk, done, pos)) return false;
+				break;
+		}
+		pos += done;
+		if (!done) sched_yield();
+	}
+	return RingBufferReadBytesAvailable(&ring) == 0;
+}
+
+static bool Run(uint16_t length) {
+	ring.length = length;
+	ring.dynamic = (RingBufferDynamic*)memory;
+	RingBufferInit(&ring);
+	failed = false;
+	pthread_t writer;
+	pthread_create(&writer, NULL, Writer, NULL);
+	bool ok = Reader();
+	if (!ok) failed = true;
+	pthread_join(writer, NULL);
+	printf("length %4u: %s\n", length, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/** RingBufferIndexOf across the wrap point, single threaded */
+static bool IndexOf() {
+	uint8_t data[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	ring.length = 16;
+	ring.dynamic = (RingBufferDynamic*)memory;
+	RingBufferInit(&ring);
+	uint8_t skip[12];
+	RingBufferWriteBuffer(&ring, skip, 12);
+	RingBufferReadBuffer(&ring, skip, 12);
+	RingBufferWriteBuffer(&ring, data, 10);	//wraps after 4 bytes
+	bool ok = (RingBufferIndexOf(&ring, 1) == 0) && (RingBufferIndexOf(&ring, 5) == 4) &&
+		(RingBufferIndexOf(&ring, 10) == 9) && (RingBufferIndexOf(&ring, 11) == -1);
+	printf("index of: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main() {
+	bool ok = IndexOf();
+	ok = Run(16) && ok;
+	ok = Run(64) && ok;
+	ok = Run(MAX_LENGTH) && ok;
+	return ok ? 0 : 1;
+}
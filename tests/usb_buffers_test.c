@@ -0,0 +1,49 @@
+/* checks how free packet buffers are derived from the SIE SelectEndpoint status: every
+ B1FULL/B2FULL combination on single and double buffered endpoints, with all other status
+ bits set and cleared. usb.c is included to get at the static helper, the hardware
+ functions it references are stubbed out and never called. */
+
+#include <stdio.h>
+#include "everykey_usb/usb.c"
+
+void NVIC_EnableInterrupt(NVIC_INTERRUPT_INDEX interrupt) {}
+void NVIC_SetInterruptPending(NVIC_INTERRUPT_INDEX interrupt) {}
+void disableInterrupts() {}
+void enableInterrupts() {}
+uint32_t saveAndDisableInterrupts() { return 0; }
+void restoreInterrupts(uint32_t previous) {}
+void every_gpio_set_dir(uint8_t port, uint8_t pin, every_gpio_direction dir) {}
+void every_gpio_set_function(HW_RW* pin, IOCON_IO_FUNC mode, IOCON_IO_ADMODE admode) {}
+void every_gpio_write(uint8_t port, uint8_t pin, bool value) {}
+
+#define OTHER_BITS (USB_SELEP_FE | USB_SELEP_ST | USB_SELEP_STP | USB_SELEP_PO | USB_SELEP_EPN)
+
+int main() {
+	bool ok = true;
+	uint8_t epIdx;
+	for (epIdx = 0; epIdx < 10; epIdx++) {
+		bool doubleBuffered = ((epIdx >> 1) == USB_DOUBLE_BUFFERED_LOGICAL_EP);
+		if (USB_EP_GetBufferCount(epIdx) != (doubleBuffered ? 2 : 1)) {
+			printf("FAIL endpoint %u: %u buffers\n", epIdx, USB_EP_GetBufferCount(epIdx));
+			ok = false;
+		}
+		uint8_t full;
+		for (full = 0; full < 4; full++) {
+			bool b1 = full & 1;
+			bool b2 = full & 2;
+			uint8_t expected = doubleBuffered ? (2 - b1 - b2) : (b1 ? 0 : 1);	//B2FULL means nothing on single buffers
+			uint8_t other;
+			for (other = 0; other <= OTHER_BITS; other++) {
+				if (other & ~OTHER_BITS) continue;
+				uint8_t status = other | (b1 ? USB_SELEP_B1FULL : 0) | (b2 ? USB_SELEP_B2FULL : 0);
+				uint8_t free = USB_EP_FreeBuffersFromStatus(epIdx, status);
+				if (free != expected) {
+					printf("FAIL endpoint %u status 0x%02x: %u free, expected %u\n", epIdx, status, free, expected);
+					ok = false;
+				}
+			}
+		}
+	}
+	printf("free buffers from status: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+/* checks the endpoint-to-behaviour table of usb.c: endpoints are mapped to behaviours through
+ the interface they are declared in, a SET_CONFIGURATION taken over by a behaviour rebuilds
+ the table too, endpoints of unclaimed interfaces find their owner on first use, and events
+ nobody accepts stall the endpoint. Runs usb.c against the RAM peripheral of usb_host.h. */
+
+#include <stdio.h>
+#include "usb_host.h"
+
+/** a composite configuration: vendor interface without owner callback, HID, CDC */
+static const uint8_t config1[] = {
+	9, USB_DESC_CONFIGURATION, 94, 0, 4, 1, 0, 0x80, 50,
+	9, USB_DESC_INTERFACE, 0, 0, 1, 0xff, 0, 0, 0,	//vendor
+	7, USB_DESC_ENDPOINT, 0x02, 2, 64, 0, 0,			//physical 4
+	9, USB_DESC_INTERFACE, 1, 0, 1, 3, 0, 0, 0,		//HID
+	9, 0x21, 0x11, 0x01, 0, 1, 0x22, 20, 0,			//HID descriptor, must be skipped
+	7, USB_DESC_ENDPOINT, 0x81, 3, 8, 0, 10,			//physical 3
+	9, USB_DESC_INTERFACE, 2, 0, 1, 2, 2, 1, 0,		//CDC control
+	5, 0x24, 0, 0x10, 0x01,							//class specific, must be skipped
+	7, USB_DESC_ENDPOINT, 0x82, 3, 8, 0, 255,		//physical 5
+	9, USB_DESC_INTERFACE, 3, 0, 2, 10, 0, 0, 0,		//CDC data
+	7, USB_DESC_ENDPOINT, 0x03, 2, 64, 0, 0,			//physical 6
+	7, USB_DESC_ENDPOINT, 0x83, 2, 64, 0, 0			//physical 7
+};
+
+/** a second configuration that moves the HID endpoint */
+static const uint8_t config2[] = {
+	9, USB_DESC_CONFIGURATION, 25, 0, 1, 2, 0, 0x80, 50,
+	9, USB_DESC_INTERFACE, 1, 0, 1, 3, 0, 0, 0,		//HID
+	7, USB_DESC_ENDPOINT, 0x83, 3, 8, 0, 10			//physical 7
+};
+
+typedef struct {
+	bool greedy;					//accept events of all endpoints, like the HID behaviour does
+	uint16_t events[USB_MAX_TRANSFER_ENDPOINTS];
+} TestState;
+
+typedef struct {
+	USB_Behaviour_Struct baseBehaviour;
+	uint8_t interfaces;				//bitmask of claimed interfaces
+	uint8_t endpoints;				//bitmask of physical endpoints
+	TestState* state;
+} TestBehaviour;
+
+static bool TakeSetConfiguration(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour) {
+	if (device->currentCommand.bRequest != USB_REQ_SET_CONFIGURATION) return false;
+	device->currentConfiguration = device->currentCommand.wValueL;
+	return true;
+}
+
+static bool EndpointData(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
+	const TestBehaviour* test = (const TestBehaviour*)behaviour;
+	if (!(test->state->greedy || (test->endpoints & (1 << epIdx)))) return false;
+	test->state->events[epIdx]++;
+	return true;
+}
+
+static bool InterfaceOwner(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t interface) {
+	const TestBehaviour* test = (const TestBehaviour*)behaviour;
+	return (test->interfaces & (1 << interface)) ? true : false;
+}
+
+static TestState vendorState, hidState, cdcState;
+
+static const TestBehaviour vendor = {
+	{ TakeSetConfiguration, EndpointData, NULL, NULL, NULL },	//no owner callback
+	0x01, 1 << 4, &vendorState
+};
+
+static const TestBehaviour hid = {
+	{ NULL, EndpointData, NULL, NULL, NULL, InterfaceOwner },
+	0x02, (1 << 3) | (1 << 7), &hidState
+};
+
+static const TestBehaviour cdc = {
+	{ NULL, EndpointData, NULL, NULL, NULL, InterfaceOwner },
+	0x0c, (1 << 5) | (1 << 6) | (1 << 7), &cdcState
+};
+
+static const USB_Device_Definition definition = {
+	NULL,
+	2,
+	{ config1, config2 },
+	0,
+	{ NULL },
+	3,
+	{ (USB_Behaviour_Struct*)&vendor, (USB_Behaviour_Struct*)&hid, (USB_Behaviour_Struct*)&cdc }
+};
+
+static USB_Device_Struct device;
+static bool ok = true;
+
+static void Expect(const char* what, const uint8_t* expected) {
+	uint8_t i;
+	for (i=2; i<USB_MAX_TRANSFER_ENDPOINTS; i++) {
+		if (device.endpointBehaviours[i] != expected[i]) {
+			printf("FAIL %s: endpoint %u owner 0x%02x, expected 0x%02x\n", what, i,
+				   device.endpointBehaviours[i], expected[i]);
+			ok = false;
+		}
+	}
+}
+
+static void Check(const char* what, bool condition) {
+	if (!condition) {
+		printf("FAIL %s\n", what);
+		ok = false;
+	}
+}
+
+/** a standard SET_CONFIGURATION, handled by the core */
+static void SetConfiguration(uint8_t value) {
+	USB_Setup_Packet setup = { USB_RT_DIR_HOST_TO_DEVICE | USB_RT_RECIPIENT_DEVICE, USB_REQ_SET_CONFIGURATION, value, 0, 0, 0, 0, 0 };
+	device.currentCommand = setup;
+	USB_HandleSetConfiguration(&device);
+}
+
+/** dispatches one endpoint event, returns true if it stalled the endpoint */
+static bool Dispatch(uint8_t epIdx) {
+	fakeUsb.CMDCODE = 0;
+	USB_HandleData(&device, epIdx);
+	return FakeUsbStalled();
+}
+
+int main() {
+	const uint8_t I = USB_EP_BEHAVIOUR_INVALID;
+	const uint8_t U = USB_EP_BEHAVIOUR_UNKNOWN;
+	FakeUsbReset(0);
+	device.deviceDefinition = &definition;
+	_usbDevice = &device;
+	USB_Reset(&device);
+	const uint8_t afterReset[] = { I, I, I, I, I, I, I, I };
+	Expect("reset", afterReset);
+
+	SetConfiguration(1);
+	const uint8_t mapped[] = { I, I, I, 1, U, 2, 2, 2 };
+	Expect("config 1", mapped);
+
+	//CDC endpoints go to CDC although the greedy HID behaviour comes first
+	hidState.greedy = true;
+	Check("CDC data OUT not stalled", !Dispatch(6));
+	Check("CDC data OUT to CDC", (cdcState.events[6] == 1) && (hidState.events[6] == 0));
+
+	//the vendor interface has no owner callback: first use finds and remembers the owner
+	Check("vendor endpoint not stalled", !Dispatch(4));
+	Check("vendor endpoint to vendor", vendorState.events[4] == 1);
+	const uint8_t learned[] = { I, I, I, 1, 0, 2, 2, 2 };
+	Expect("learned owner", learned);
+
+	//endpoints outside the configuration are still offered, but not remembered
+	Check("unconfigured endpoint taken by greedy HID", !Dispatch(2) && (hidState.events[2] == 1));
+	Expect("unconfigured endpoint not remembered", learned);
+
+	//... and stall if nobody wants them
+	hidState.greedy = false;
+	Check("unclaimed endpoint stalls", Dispatch(2));
+
+	//SET_CONFIGURATION taken over by a behaviour: the setup packet is read from the fake
+	//peripheral, which repeats one word: 00 09 02 00 (bmRequestType bRequest wValue)
+	fakeUsb.CMDDATA = USB_SELEP_FE | USB_SELEP_STP;
+	fakeUsb.RXPLEN = USB_RXPLEN_DV | sizeof(USB_Setup_Packet);
+	fakeUsb.RXDATA = (USB_REQ_SET_CONFIGURATION << 8) | (2 << 16);
+	USB_Control_HandleSetup(&device);
+	fakeUsb.CMDDATA = 0;
+	Check("intercepted SET_CONFIGURATION applied", device.currentConfiguration == 2);
+	const uint8_t moved[] = { I, I, I, I, I, I, I, 1 };
+	Expect("intercepted config 2", moved);
+	Check("moved HID endpoint not stalled", !Dispatch(7));
+	Check("moved HID endpoint to HID", (hidState.events[7] == 1) && (cdcState.events[7] == 0));
+
+	SetConfiguration(0);
+	Expect("config 0", afterReset);
+
+	printf("endpoint dispatch: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
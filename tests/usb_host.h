@@ -0,0 +1,34 @@
+/* usb.c on the host: the USB peripheral is replaced by a struct in RAM. DEVINTST keeps the
+ SIE command done flags set, so SIE commands complete at once. The last SIE command or data
+ write stays in CMDCODE, CMDDATA is what SIE reads return (the SelectEndpoint status).
+ Include this once per test instead of usb.c. */
+
+#include "everykey/memorymap.h"
+
+static USB_STRUCT fakeUsb;
+#undef USB
+#define USB (&fakeUsb)
+
+#include "everykey_usb/usb.c"
+
+void NVIC_EnableInterrupt(NVIC_INTERRUPT_INDEX interrupt) {}
+void NVIC_SetInterruptPending(NVIC_INTERRUPT_INDEX interrupt) {}
+void disableInterrupts() {}
+void enableInterrupts() {}
+uint32_t saveAndDisableInterrupts() { return 0; }
+void restoreInterrupts(uint32_t previous) {}
+void every_gpio_set_dir(uint8_t port, uint8_t pin, every_gpio_direction dir) {}
+void every_gpio_set_function(HW_RW* pin, IOCON_IO_FUNC mode, IOCON_IO_ADMODE admode) {}
+void every_gpio_write(uint8_t port, uint8_t pin, bool value) {}
+
+/** resets the fake peripheral: SIE idle, no interrupts pending, SIE reads return status */
+static inline void FakeUsbReset(uint8_t status) {
+	fakeUsb.DEVINTST = USB_DEVINT_CC_EMPTY | USB_DEVINT_CD_FULL;
+	fakeUsb.CMDCODE = 0;
+	fakeUsb.CMDDATA = status;
+}
+
+/** true if the last SIE operation stalled an endpoint */
+static inline bool FakeUsbStalled() {
+	return fakeUsb.CMDCODE == ((USB_EPSTAT_ST << 16) | USB_CMDCODE_PHASE_WRITE);
+}
@@ -0,0 +1,264 @@
+/* checks the transfer engine of usb.c and its users against the RAM peripheral of usb_host.h:
+ packet splitting, zero length packets with and without termination, OUT transfers ending on a
+ short packet, a full buffer or truncation, HID reports and the CDC device-to-host path, which
+ sends ring buffer blocks through the engine. Every call of USB_HandleData is one endpoint
+ event, i.e. the host took the previous packet (IN) or sent a new one (OUT). */
+
+#include <stdio.h>
+#include "usb_host.h"
+#include "everykey_usb/hid.h"
+#include "everykey_usb/cdc.h"
+
+#define NO_PACKET 0xffffffff
+#define RING_LENGTH 256
+
+static const uint8_t config[] = {
+	9, USB_DESC_CONFIGURATION, 64, 0, 3, 1, 0, 0x80, 50,
+	9, USB_DESC_INTERFACE, 0, 0, 1, 3, 0, 0, 0,		//HID
+	7, USB_DESC_ENDPOINT, 0x81, 3, 8, 0, 10,			//physical 3
+	9, USB_DESC_INTERFACE, 1, 0, 1, 2, 2, 1, 0,		//CDC control
+	7, USB_DESC_ENDPOINT, 0x83, 3, 8, 0, 255,		//physical 7
+	9, USB_DESC_INTERFACE, 2, 0, 2, 10, 0, 0, 0,		//CDC data
+	7, USB_DESC_ENDPOINT, 0x02, 2, 64, 0, 0,			//physical 4
+	7, USB_DESC_ENDPOINT, 0x82, 2, 64, 0, 0			//physical 5
+};
+
+static uint8_t hidIn[8];
+static uint8_t hidIdle, hidProtocol;
+static uint16_t reportsRequested;
+
+static uint16_t InReport(USB_Device_Struct* device, const USBHID_Behaviour_Struct* behaviour,
+						 USB_HID_REPORTTYPE reportType, uint8_t reportId) {
+	reportsRequested++;
+	uint8_t i;
+	for (i=0; i<sizeof(hidIn); i++) hidIn[i] = reportsRequested;
+	return sizeof(hidIn);
+}
+
+static const USBHID_Behaviour_Struct hid = {
+	MAKE_USBHID_BASE_BEHAVIOUR,
+	0, NULL, NULL, 0, InReport, NULL, hidIn, NULL, &hidIdle, &hidProtocol
+};
+
+static uint16_t dataInEvents;
+
+/** wraps the CDC handler like cdcuart does, counts data in events */
+static bool WrappedCDCHandler(USB_Device_Struct* device, const USB_Behaviour_Struct* behaviour, uint8_t epIdx) {
+	if (epIdx == ((const USBCDC_Behaviour_Struct*)behaviour)->dataInEndpoint) dataInEvents++;
+	return USBCDC_EndpointDataHandler(device, behaviour, epIdx);
+}
+
+static USB_CDC_Linecoding_Struct lineCoding;
+static uint8_t rxMemory[sizeof(RingBufferDynamic) + RING_LENGTH];
+static uint8_t txMemory[sizeof(RingBufferDynamic) + RING_LENGTH];
+static bool idle;
+static uint8_t controlLines;
+
+static const USBCDC_Behaviour_Struct cdc = {
+	{ USBCDC_ExtendedControlSetupHandler, WrappedCDCHandler, NULL, NULL, USBCDC_ConfigChangeHandler, USBCDC_InterfaceOwnerHandler },
+	NULL, NULL, NULL, NULL, NULL,
+	{ 115200, USB_CDC_LINECODING_STOP_1, USB_CDC_PARITY_NONE, 8 },
+	&lineCoding,
+	{ RING_LENGTH, (RingBufferDynamic*)rxMemory },
+	{ RING_LENGTH, (RingBufferDynamic*)txMemory },
+	&idle,
+	&controlLines,
+	1, 2, 5, 4, 7
+};
+
+static const USB_Device_Definition definition = {
+	NULL,
+	1,
+	{ config },
+	0,
+	{ NULL },
+	2,
+	{ (USB_Behaviour_Struct*)&hid, (USB_Behaviour_Struct*)&cdc }
+};
+
+static USB_Device_Struct device;
+static bool ok = true;
+
+static void Check(const char* what, bool condition) {
+	if (!condition) {
+		printf("FAIL %s\n", what);
+		ok = false;
+	}
+}
+
+static uint32_t completions;
+static uint32_t completedLength;
+
+static void Completed(USB_Device_Struct* device, uint8_t epIdx, uint8_t* buffer, uint32_t length) {
+	completions++;
+	completedLength = length;
+}
+
+/** one IN endpoint event, returns the length of the packet written or NO_PACKET */
+static uint32_t InEvent(uint8_t epIdx) {
+	fakeUsb.TXPLEN = NO_PACKET;
+	USB_HandleData(&device, epIdx);
+	return fakeUsb.TXPLEN;
+}
+
+/** runs IN events until nothing more is sent, compares the packet lengths */
+static void ExpectPackets(const char* what, uint8_t epIdx, const uint32_t* lengths, uint8_t count) {
+	uint8_t n = 0;
+	uint32_t len;
+	while ((len = InEvent(epIdx)) != NO_PACKET) {
+		if ((n >= count) || (len != lengths[n])) {
+			printf("FAIL %s: packet %u has %u bytes\n", what, n, len);
+			ok = false;
+			return;
+		}
+		n++;
+	}
+	if (n != count) {
+		printf("FAIL %s: %u packets, expected %u\n", what, n, count);
+		ok = false;
+	}
+}
+
+static void EngineIn() {
+	static uint8_t data[128];
+	const uint32_t terminated[] = { 64, 64, 0 };
+	const uint32_t open[] = { 64, 64 };
+	const uint32_t shortLast[] = { 64, 36 };
+	completions = 0;
+	USB_EP_SubmitTransfer(&device, 5, data, 128, true, Completed);
+	ExpectPackets("IN multiple of 64, terminated", 5, terminated, 3);
+	Check("IN terminated completion", (completions == 1) && (completedLength == 128));
+	USB_EP_SubmitTransfer(&device, 5, data, 128, false, Completed);
+	ExpectPackets("IN multiple of 64, not terminated", 5, open, 2);
+	USB_EP_SubmitTransfer(&device, 5, data, 100, true, Completed);
+	ExpectPackets("IN short last packet", 5, shortLast, 2);
+	Check("IN completions", (completions == 3) && (completedLength == 100));
+	Check("IN engine idle", !USB_EP_TransferActive(&device, 5));
+}
+
+/** submits an OUT transfer and lets one packet event arrive. The fake peripheral returns the
+ same packet over and over, so the transfer runs until it ends on its own. */
+static uint32_t EngineOut(uint32_t bufferLength, uint32_t packetLength) {
+	static uint32_t buffer[256 / 4];
+	completions = 0;
+	completedLength = 0;
+	USB_EP_SubmitTransfer(&device, 4, (uint8_t*)buffer, bufferLength, true, Completed);
+	fakeUsb.CMDDATA = USB_SELEP_FE;
+	fakeUsb.RXPLEN = USB_RXPLEN_DV | packetLength;
+	fakeUsb.RXDATA = 0x04030201;
+	USB_HandleData(&device, 4);
+	fakeUsb.CMDDATA = 0;
+	bool filled = (buffer[0] == 0x04030201) || (completedLength == 0);
+	Check("OUT data read", filled);
+	return (completions == 1) ? completedLength : NO_PACKET;
+}
+
+static void Hid() {
+	reportsRequested = 0;
+	USBHID_PushReport(&device, &hid, USB_HID_REPORTTYPE_INPUT, 0);
+	USBHID_PushReport(&device, &hid, USB_HID_REPORTTYPE_INPUT, 0);	//still queued: skipped
+	Check("HID report queued once", reportsRequested == 1);
+	const uint32_t report[] = { sizeof(hidIn) };
+	ExpectPackets("HID report", USBHID_IN_ENDPOINT, report, 1);
+	Check("HID report content", (fakeUsb.TXDATA & 0xff) == 1);
+	USBHID_PushReport(&device, &hid, USB_HID_REPORTTYPE_INPUT, 0);
+	Check("HID next report", reportsRequested == 2);
+	ExpectPackets("HID next report", USBHID_IN_ENDPOINT, report, 1);
+}
+
+static uint32_t streamOut, streamIn;
+
+static uint8_t StreamByte(uint32_t n) {
+	return (uint8_t)((n * 2654435761u) >> 24);
+}
+
+static void CdcWrite(uint16_t count) {
+	uint8_t data[RING_LENGTH];
+	uint16_t i;
+	for (i=0; i<count; i++) data[i] = StreamByte(streamOut + i);
+	Check("CDC write fits", USBCDC_WriteBytes(&device, &cdc, data, count) == count);
+	streamOut += count;
+}
+
+/** drains the CDC ring, compares packet lengths and the last word of each packet. Events
+ that only queue a transfer don't send anything, so go on while one is running. */
+static void CdcExpect(const char* what, const uint32_t* lengths, uint8_t count) {
+	uint8_t n = 0;
+	uint32_t len;
+	while (((len = InEvent(5)) != NO_PACKET) || USB_EP_TransferActive(&device, 5)) {
+		if (len == NO_PACKET) continue;
+		if ((n >= count) || (len != lengths[n])) {
+			printf("FAIL %s: packet %u has %u bytes\n", what, n, len);
+			ok = false;
+			return;
+		}
+		if (len > 0) {
+			uint32_t lastWord = (len - 1) & ~3;
+			uint32_t i;
+			for (i=lastWord; i<len; i++) {
+				uint8_t byte = fakeUsb.TXDATA >> (8 * (i - lastWord));
+				if (byte != StreamByte(streamIn + i)) {
+					printf("FAIL %s: packet %u byte %u is 0x%02x, expected 0x%02x\n", what, n, i, byte, StreamByte(streamIn + i));
+					ok = false;
+				}
+			}
+		}
+		streamIn += len;
+		n++;
+	}
+	if (n != count) {
+		printf("FAIL %s: %u packets, expected %u\n", what, n, count);
+		ok = false;
+	}
+	Check("CDC ring drained", RingBufferReadBytesAvailable(&(cdc.deviceToHostBuffer)) == 0);
+	Check("CDC stream complete", streamIn == streamOut);
+}
+
+static void Cdc() {
+	//contiguous, not a multiple of 64: no termination needed
+	CdcWrite(200);
+	Check("CDC first event queues", InEvent(5) == NO_PACKET);
+	Check("CDC block in flight", RingBufferWriteBytesAvailable(&(cdc.deviceToHostBuffer)) == RING_LENGTH - 200);
+	const uint32_t first[] = { 64, 64, 64, 8 };
+	dataInEvents = 0;
+	CdcExpect("CDC 200", first, 4);
+	Check("CDC wrapper sees completion", dataInEvents == 1);
+
+	//56 bytes to the ring end, 72 behind: one assembled packet, then 64 and a zero length packet
+	CdcWrite(128);
+	const uint32_t wrapped[] = { 64, 64, 0 };
+	CdcExpect("CDC across ring end", wrapped, 3);
+
+	//184 to the ring end, 66 behind: whole packets first, the rest with the assembled packet
+	CdcWrite(250);
+	const uint32_t rest[] = { 64, 64, 64, 58 };
+	CdcExpect("CDC whole packets before ring end", rest, 4);
+
+	//stalled: data stays in the ring
+	CdcWrite(10);
+	fakeUsb.CMDDATA = USB_SELEP_ST;
+	Check("CDC stalled sends nothing", InEvent(5) == NO_PACKET);
+	fakeUsb.CMDDATA = 0;
+	const uint32_t resumed[] = { 10 };
+	CdcExpect("CDC after stall", resumed, 1);
+}
+
+int main() {
+	FakeUsbReset(0);
+	device.deviceDefinition = &definition;
+	_usbDevice = &device;
+	USB_Reset(&device);
+	device.currentCommand.bmRequestType = USB_RT_DIR_HOST_TO_DEVICE | USB_RT_RECIPIENT_DEVICE;
+	device.currentCommand.wValueL = 1;
+	USB_HandleSetConfiguration(&device);
+
+	EngineIn();
+	Check("OUT short packet", EngineOut(256, 10) == 10);
+	Check("OUT buffer filled", EngineOut(256, 64) == 256);
+	Check("OUT truncated", EngineOut(100, 64) == 100);
+	Hid();
+	Cdc();
+
+	printf("transfers: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+/* memory function benchmark: bytes per cycle of memset, memcpy and memcmp from
+ everykey/utils.c against the old byte loops (utils_old.c), for several lengths and
+ source/destination alignments. Cycles are TSC ticks on x86 (nanoseconds elsewhere), host
+ numbers, only the ratio says something about the target. */
+
+#include <stdio.h>
+#include <time.h>
+#include "everykey/utils.h"
+
+void* OldMemset(void* b, int c, uint32_t len);
+void* OldMemcpy(void* to, const void* from, uint32_t len);
+int OldMemcmp(const void *s1, const void *s2, uint32_t n);
+
+#define REPEAT_BYTES (32 * 1024 * 1024)
+
+static uint8_t a[4096 + 8] __attribute__((aligned(16)));
+static uint8_t b[4096 + 8] __attribute__((aligned(16)));
+static volatile int sink;
+
+static uint64_t Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+typedef enum { SET, COPY, COMPARE } Operation;
+
+static double BytesPerCycle(Operation op, bool old, uint32_t len, int dst, int src) {
+	uint32_t rounds = REPEAT_BYTES / len;
+	uint32_t i;
+	uint64_t start = Cycles();
+	for (i=0; i<rounds; i++) {
+		switch (op) {
+			case SET:
+				if (old) OldMemset(a + dst, i, len);
+				else memset(a + dst, i, len);
+				break;
+			case COPY:
+				if (old) OldMemcpy(a + dst, b + src, len);
+				else memcpy(a + dst, b + src, len);
+				break;
+			case COMPARE:
+				if (old) sink = OldMemcmp(a + dst, b + src, len);
+				else sink = memcmp(a + dst, b + src, len);
+				break;
+		}
+	}
+	return (double)rounds * len / (Cycles() - start);
+}
+
+int main() {
+	static const uint32_t lengths[] = { 4, 16, 64, 256, 1024, 4096 };
+	static const int alignments[][2] = { { 0, 0 }, { 1, 1 }, { 0, 1 }, { 2, 3 } };
+	static const char* names[] = { "memset", "memcpy", "memcmp" };
+	int op, l, k;
+	printf("bytes per cycle, old -> new\n");
+	for (op=SET; op<=COMPARE; op++) {
+		for (k=0; k<4; k++) {
+			int dst = alignments[k][0];
+			int src = alignments[k][1];
+			if ((op == SET) && (dst != src)) continue;
+			if (op == COMPARE) memcpy(a + dst, b + src, 4096);	//equal, compare all the way
+			printf("%s dst+%d src+%d:", names[op], dst, src);
+			for (l=0; l<sizeof(lengths)/sizeof(lengths[0]); l++) {
+				double before = BytesPerCycle(op, true, lengths[l], dst, src);
+				double after = BytesPerCycle(op, false, lengths[l], dst, src);
+				printf("  %u: %.2f->%.2f", lengths[l], before, after);
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,35 @@
+/* the memory functions before the word-wide rewrite (plain byte loops), kept as the
+ baseline for utils_bench. Renamed to Old... There was no real memmove. */
+
+#include "everykey/types.h"
+
+void* OldMemset(void* b, int c, uint32_t len) {
+        uint8_t* buf = b;
+        uint32_t i;
+        for (i=0; i<len; i++) {
+                buf[i] = c;
+        }
+        return b;
+}
+
+void* OldMemcpy(void* to, const void* from, uint32_t len) {
+        uint8_t* dst = to;
+        const uint8_t* src = from;
+        uint32_t i;
+        for (i=0; i<len; i++) {
+                dst[i] = src[i];
+        }
+        return to;
+}
+
+int OldMemcmp(const void *s1, const void *s2, uint32_t n) {
+    uint32_t i;
+    const uint8_t* buf1 = s1;
+    const uint8_t* buf2 = s2;
+    for (i=0; i<n; i++) {
+        if (buf1[i] != buf2[i]) {
+            return buf2[i] - buf1[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+/* checks memset, memcpy, memmove and memcmp from everykey/utils.c against plain byte loops
+ for all lengths up to 80 bytes and every combination of source and destination alignment,
+ including overlapping moves in both directions. */
+
+#include <stdio.h>
+#include "everykey/utils.h"
+
+#define SIZE 128
+#define MAX_LEN 80
+
+static uint8_t a[SIZE], b[SIZE], expected[SIZE];
+
+static void Fill(uint8_t* buf, uint8_t seed) {
+	int i;
+	for (i=0; i<SIZE; i++) buf[i] = (uint8_t)(seed + i * 7);
+}
+
+static bool Same(const char* name, uint32_t len, int dstOffset, int srcOffset) {
+	int i;
+	for (i=0; i<SIZE; i++) {
+		if (a[i] != expected[i]) {
+			printf("FAIL %s length %u dst +%d src +%d: byte %d\n", name, len, dstOffset, srcOffset, i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static int Sign(int x) {
+	return (x > 0) - (x < 0);
+}
+
+int main() {
+	bool ok = true;
+	uint32_t len;
+	int d, s, i;
+	for (len=0; len<=MAX_LEN; len++) {
+		for (d=0; d<4; d++) {
+			Fill(a, 1);
+			Fill(expected, 1);
+			for (i=0; i<len; i++) expected[d + i] = 0x5a;
+			memset(a + d, 0x5a, len);
+			ok = Same("memset", len, d, 0) && ok;
+			for (s=0; s<4; s++) {
+				Fill(a, 1);
+				Fill(b, 99);
+				Fill(expected, 1);
+				for (i=0; i<len; i++) expected[d + i] = b[s + i];
+				memcpy(a + d, b + s, len);
+				ok = Same("memcpy", len, d, s) && ok;
+
+				//overlapping moves, destination before and after the source
+				int from = 8 + s;
+				int to[2] = { from - 5 + d, from + 3 + d };
+				int k;
+				for (k=0; k<2; k++) {
+					Fill(a, 1);
+					Fill(expected, 1);
+					for (i=0; i<len; i++) expected[to[k] + i] = a[from + i];
+					memmove(a + to[k], a + from, len);
+					ok = Same("memmove", len, to[k], from) && ok;
+				}
+
+				//memcmp: equal, then one byte differing at each position
+				Fill(a, 1);
+				Fill(b, 1);
+				if (memcmp(a + d, b + d, len) != 0) {
+					printf("FAIL memcmp equal length %u\n", len);
+					ok = false;
+				}
+				if ((d == s) && (len > 0)) {
+					int pos = (len * 5 + s) % len;
+					b[d + pos] += (len & 1) ? 1 : -1;
+					int result = memcmp(a + d, b + d, len);
+					if (Sign(result) != Sign(b[d + pos] - a[d + pos])) {
+						printf("FAIL memcmp length %u offset %d differing at %d\n", len, d, pos);
+						ok = false;
+					}
+				}
+			}
+		}
+	}
+	printf("memory functions: %s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}